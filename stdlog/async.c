@@ -0,0 +1,329 @@
+/* The stdlog async driver. It wraps another channel, given in the
+ * driver argument, and decouples the caller from that channel's
+ * output. Log calls just format the message into a preallocated ring
+ * buffer. A dedicated flusher thread drains the ring and hands the
+ * messages to the wrapped channel's driver.
+ *
+ * The ring is a bounded multi-producer/single-consumer queue in the
+ * spirit of Dmitry Vyukov's bounded MPMC queue: each slot carries a
+ * sequence number which tells producers and the consumer whether the
+ * slot is free or ready. Producers only need an atomic compare and
+ * swap to claim a slot, so the logging path takes no locks. The
+ * flusher is woken via a pipe, and only if it went to sleep because
+ * the ring was empty. As write() is async-signal-safe, the logging
+ * path is signal-safe as long as the channel is opened with
+ * STDLOG_SIGSAFE. A signal handler may have interrupted a producer
+ * between claiming and publishing its slot, which the flusher then
+ * cannot get past; so in signal-safe mode, a log call waits for a
+ * full ring only ASYNC_SIGSAFE_PAUSES times and then drops the message.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define ASYNC_DFLT_SIZE	256	/* default ring capacity (messages) */
+#define ASYNC_IDLE_MS	1000	/* max time the flusher sleeps unwoken */
+#define ASYNC_PAUSE_NS	100000	/* producer back-off if ring is full */
+#define ASYNC_SIGSAFE_PAUSES 100	/* sigsafe mode: max back-offs per call */
+
+struct __stdlog_async_slot {
+	uint64_t seq;	/* pos+1: ready to drain; pos+capacity: free again */
+	time_t t;	/* time the message was logged */
+	int severity;
+	char msg[];	/* msgsize bytes, '\0'-terminated */
+};
+
+struct __stdlog_async_ring {
+	uint64_t enq_pos;	/* next slot to claim (producers) */
+	char pad[64 - sizeof(uint64_t)]; /* keep producers off consumer line */
+	uint64_t deq_pos;	/* next slot to drain (flusher only) */
+	uint64_t ndone;		/* messages handed to child, for flushing */
+	uint64_t capacity;	/* always a power of 2 */
+	size_t stride;		/* size of a slot including msg */
+	size_t msgsize;
+	int drop_when_full;
+	int sleeping;		/* flusher waits for wakeup */
+	int stop;		/* flusher shall terminate */
+	int wakefd[2];
+	pthread_t flusher;
+	char *slots;
+};
+
+#define ASYNC_SLOT(ring, pos) \
+	((struct __stdlog_async_slot *) \
+	 ((ring)->slots + ((pos) & ((ring)->capacity - 1)) * (ring)->stride))
+
+/* wake the flusher, if it sleeps. This is signal-safe. */
+static void
+async_wake(struct __stdlog_async_ring *const ring)
+{
+	ssize_t __attribute__((unused)) r;
+
+	if(__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+		r = write(ring->wakefd[1], "", 1);
+}
+
+static void
+async_pause(void)
+{
+	struct timespec ts = { 0, ASYNC_PAUSE_NS };
+	nanosleep(&ts, NULL);
+}
+
+/* returns the slot at deq_pos if it is ready to be drained, else NULL */
+static struct __stdlog_async_slot *
+async_ready_slot(struct __stdlog_async_ring *const ring)
+{
+	struct __stdlog_async_slot *const slot = ASYNC_SLOT(ring, ring->deq_pos);
+
+	if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == ring->deq_pos + 1)
+		return slot;
+	return NULL;
+}
+
+static void *
+async_flusher(void *arg)
+{
+	stdlog_channel_t ch = (stdlog_channel_t) arg;
+	struct __stdlog_async_ring *const ring = ch->d.async.ring;
+	struct __stdlog_async_slot *slot;
+	struct pollfd pfd;
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+	char drainbuf[64];
+
+	pfd.fd = ring->wakefd[0];
+	pfd.events = POLLIN;
+	while(1) {
+		if((slot = async_ready_slot(ring)) != NULL) {
+			__stdlog_pinned_time = slot->t;
+			__stdlog_drvr_log_msg(ch->d.async.child, slot->severity,
+				wrkbuf, sizeof(wrkbuf), slot->msg);
+			__stdlog_pinned_time = 0;
+			__atomic_store_n(&slot->seq, ring->deq_pos + ring->capacity,
+				__ATOMIC_RELEASE);
+			++ring->deq_pos;
+			__atomic_store_n(&ring->ndone, ring->deq_pos, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		/* ring is empty, go to sleep -- but re-check after announcing
+		 * it, a producer may have published in the meantime.
+		 */
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+		if(async_ready_slot(ring) != NULL) {
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		if(__atomic_load_n(&ring->stop, __ATOMIC_SEQ_CST))
+			break;
+		poll(&pfd, 1, ASYNC_IDLE_MS);
+		while(read(ring->wakefd[0], drainbuf, sizeof(drainbuf)) > 0)
+			/* just drain */;
+		__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+static void
+async_free(stdlog_channel_t ch)
+{
+	struct __stdlog_async_ring *const ring = ch->d.async.ring;
+
+	if(ring != NULL) {
+		if(ring->wakefd[0] != -1) {
+			close(ring->wakefd[0]);
+			close(ring->wakefd[1]);
+		}
+		free(ring->slots);
+		free(ring);
+		ch->d.async.ring = NULL;
+	}
+	if(ch->d.async.child != NULL) {
+		stdlog_close(ch->d.async.child);
+		ch->d.async.child = NULL;
+	}
+}
+
+static int
+async_init(stdlog_channel_t ch)
+{
+	struct __stdlog_async_ring *ring;
+	int64_t size;
+	uint64_t i;
+	int r;
+
+	size = __stdlog_chanspec_param_int(ch->spec, "size", ASYNC_DFLT_SIZE);
+	if(size < 2 || size > (1 << 24)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if((ch->d.async.child = stdlog_open(ch->ident, ch->options, ch->facility,
+	                                    __stdlog_chanspec_arg(ch->spec))) == NULL)
+		return -1;
+	if((ring = calloc(1, sizeof(struct __stdlog_async_ring))) == NULL)
+		goto fail_nomem;
+	ch->d.async.ring = ring;
+	ring->wakefd[0] = ring->wakefd[1] = -1;
+	for(ring->capacity = 2 ; (int64_t) ring->capacity < size ; ring->capacity <<= 1)
+		/* round up to power of 2 */;
+	ring->msgsize = __STDLOG_MSGBUF_SIZE;
+	ring->stride = (sizeof(struct __stdlog_async_slot) + ring->msgsize + 7) & ~7;
+	ring->drop_when_full = __stdlog_chanspec_param_is(ch->spec, "full", "drop");
+	if((ring->slots = malloc(ring->capacity * ring->stride)) == NULL)
+		goto fail_nomem;
+	for(i = 0 ; i < ring->capacity ; ++i)
+		ASYNC_SLOT(ring, i)->seq = i;
+
+	if(pipe(ring->wakefd) != 0)
+		goto fail;
+	for(i = 0 ; i < 2 ; ++i) {
+		fcntl(ring->wakefd[i], F_SETFL, O_NONBLOCK);
+		fcntl(ring->wakefd[i], F_SETFD, FD_CLOEXEC);
+	}
+	if((r = pthread_create(&ring->flusher, NULL, async_flusher, ch)) != 0) {
+		errno = r;
+		goto fail;
+	}
+	return 0;
+
+fail_nomem:
+	errno = ENOMEM;
+fail:
+	r = errno;
+	async_free(ch);
+	errno = r;
+	return -1;
+}
+
+static void
+async_open(stdlog_channel_t ch)
+{
+	ch->d.async.child->drvr.open(ch->d.async.child);
+}
+
+/* Closing drains all messages still in the ring. */
+static void
+async_close(stdlog_channel_t ch)
+{
+	struct __stdlog_async_ring *const ring = ch->d.async.ring;
+
+	__atomic_store_n(&ring->stop, 1, __ATOMIC_SEQ_CST);
+	async_wake(ring);
+	pthread_join(ring->flusher, NULL);
+	async_free(ch);
+}
+
+/* Waits until everything logged before the call has been handed to
+ * the wrapped channel, then flushes that channel.
+ */
+static int
+async_flush(stdlog_channel_t ch)
+{
+	struct __stdlog_async_ring *const ring = ch->d.async.ring;
+	const uint64_t target = __atomic_load_n(&ring->enq_pos, __ATOMIC_ACQUIRE);
+
+	while(__atomic_load_n(&ring->ndone, __ATOMIC_ACQUIRE) < target) {
+		async_wake(ring);
+		async_pause();
+	}
+	return stdlog_flush(ch->d.async.child);
+}
+
+static int
+async_log(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char __attribute__((unused)) *__restrict__ const wrkbuf,
+	const size_t buflen)
+{
+	struct __stdlog_async_ring *const ring = ch->d.async.ring;
+	struct __stdlog_async_slot *slot;
+	uint64_t pos;
+	int64_t diff;
+	int npauses = 0;
+
+	pos = __atomic_load_n(&ring->enq_pos, __ATOMIC_RELAXED);
+	while(1) {
+		slot = ASYNC_SLOT(ring, pos);
+		diff = (int64_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if(diff == 0) {
+			if(__atomic_compare_exchange_n(&ring->enq_pos, &pos, pos + 1,
+			       1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if(diff < 0) {
+			/* ring is full */
+			if(ring->drop_when_full
+			   || ((ch->options & STDLOG_SIGSAFE)
+			       && ++npauses > ASYNC_SIGSAFE_PAUSES)) {
+				/* counted by the caller as a failed call */
+				errno = EAGAIN;
+				return -1;
+			}
+			async_wake(ring);
+			async_pause();
+			pos = __atomic_load_n(&ring->enq_pos, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&ring->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->t = __STDLOG_MSGTIME();
+	slot->severity = severity;
+	ch->f_vsnprintf(slot->msg, (buflen < ring->msgsize) ? buflen : ring->msgsize,
+		fmt, ap);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST))
+		async_wake(ring);
+	return 0;
+}
+
+/* nothing buffered here needs to move, so just pass it on */
+static int
+async_reopen(stdlog_channel_t ch)
+{
+	return stdlog_reopen(ch->d.async.child);
+}
+
+void
+__stdlog_set_async_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = async_init;
+	ch->drvr.open = async_open;
+	ch->drvr.close = async_close;
+	ch->drvr.log = async_log;
+	ch->drvr.flush = async_flush;
+	ch->drvr.reopen = async_reopen;
+}
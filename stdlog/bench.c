@@ -0,0 +1,511 @@
+/* stdlog-bench: measures the throughput and per-call latency of the
+ * stdlog drivers, so that regressions can be tracked over time.
+ *
+ * For each driver, thread count (1, 2, 4, ... up to the maximum),
+ * formatting mode (signal-safe or vsnprintf) and message size, every
+ * thread logs the given number of messages to a shared channel. Each
+ * call is timed; we report messages per second (including the final
+ * stdlog_flush()) and the 50th, 99th and 99.9th percentile as well as
+ * the maximum of the call latencies, one line (CSV) or object (JSON)
+ * per combination. Timing adds two clock_gettime() calls per message,
+ * which show up in the latencies.
+ *
+ * Besides plain "file", the file driver is measured buffered
+ * ("filebuf"), with io_uring ("fileuring") and buffered while its file
+ * is rotated every millisecond ("filerotate"), by renaming it and
+ * calling stdlog_reopen(), as logrotate(8) would.
+ *
+ * Files and sockets are created in a temporary directory. The socket
+ * drivers talk to receiver threads of our own, which just drain them.
+ *
+ * With -T, the RFC 3164 timestamp rendering every file and socket
+ * message needs is measured instead, with and without the per-thread
+ * cache, including the time() call a log call makes.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "stdlog.h"
+#include "stdlog-intern.h"
+
+#define BENCH_DFLT_MSGS	20000	/* per thread */
+#define BENCH_DFLT_THREADS 4
+#define BENCH_MAX_THREADS 256
+#define BENCH_MAX_SIZES	16
+#define BENCH_MAX_DRIVERS 64
+#define BENCH_MAXCONN	64	/* stream receiver connections */
+
+static const char *const dflt_drivers[] = { "file", "filebuf", "fileuring",
+	"filerotate", "mmapfile", "uxsock", "uxstream", "async",
+#ifdef ENABLE_JOURNAL
+	"journal",
+#endif
+	NULL };
+
+static char dir[] = "/tmp/stdlog-bench.XXXXXX";
+static volatile int stop_receivers = 0;
+
+struct bench_run {
+	stdlog_channel_t ch;
+	pthread_barrier_t start;
+	int nmsgs;
+	const char *payload;
+	uint32_t *lat;	/* nmsgs per thread, in ns */
+	int nfailed;
+	int done;	/* all threads have finished logging */
+};
+
+struct bench_thread {
+	struct bench_run *run;
+	int idx;
+	uint64_t tstart;	/* ns, when the thread began logging */
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+cmp_lat(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *) a;
+	const uint32_t y = *(const uint32_t *) b;
+	return (x > y) - (x < y);
+}
+
+/* Drains a unix socket: datagrams are just received, stream
+ * connections are accepted and read. Runs until stop_receivers is set.
+ */
+static void *
+receiver(void *arg)
+{
+	const char *const sockname = (const char *) arg;
+	const int stream = (strstr(sockname, "stream") != NULL);
+	struct sockaddr_un addr;
+	struct pollfd pfd[BENCH_MAXCONN + 1];
+	char buf[64 * 1024];
+	int rcvbuf = 4 * 1024 * 1024;
+	int nconn = 0;
+	int i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sockname, sizeof(addr.sun_path) - 1);
+	if((pfd[0].fd = socket(AF_UNIX, stream ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0
+	   || bind(pfd[0].fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+	   || (stream && listen(pfd[0].fd, 8) != 0)) {
+		perror(sockname);
+		return NULL;
+	}
+	setsockopt(pfd[0].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	pfd[0].events = POLLIN;
+	while(!stop_receivers) {
+		if(poll(pfd, nconn + 1, 100) <= 0)
+			continue;
+		for(i = nconn ; i > 0 ; --i) {
+			if(pfd[i].revents == 0 || read(pfd[i].fd, buf, sizeof(buf)) > 0)
+				continue;
+			close(pfd[i].fd);
+			pfd[i] = pfd[nconn--];
+		}
+		if(!(pfd[0].revents & POLLIN))
+			continue;
+		if(!stream) {
+			while(recv(pfd[0].fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+				/* just drain */;
+		} else if(nconn < BENCH_MAXCONN
+		          && (pfd[nconn + 1].fd = accept(pfd[0].fd, NULL, NULL)) >= 0) {
+			pfd[++nconn].events = POLLIN;
+		}
+	}
+	for(i = 0 ; i <= nconn ; ++i)
+		close(pfd[i].fd);
+	unlink(sockname);
+	return NULL;
+}
+
+static void *
+bench_thread(void *arg)
+{
+	struct bench_thread *const thr = (struct bench_thread *) arg;
+	struct bench_run *const run = thr->run;
+	uint32_t *const lat = run->lat + (size_t) thr->idx * run->nmsgs;
+	uint64_t t;
+	int nfailed = 0;
+	int i;
+
+	pthread_barrier_wait(&run->start);
+	thr->tstart = now_ns();
+	for(i = 0 ; i < run->nmsgs ; ++i) {
+		t = now_ns();
+		if(stdlog_log(run->ch, STDLOG_INFO, "bench %08d %s", i, run->payload) != 0)
+			++nfailed;
+		t = now_ns() - t;
+		lat[i] = (t > UINT32_MAX) ? UINT32_MAX : t;
+	}
+	__atomic_add_fetch(&run->nfailed, nfailed, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* "filerotate": rotates the file every millisecond while the threads log */
+static void *
+rotate_thread(void *arg)
+{
+	struct bench_run *const run = (struct bench_run *) arg;
+	char name[sizeof(dir) + 32];
+	char oldname[sizeof(dir) + 32];
+
+	snprintf(name, sizeof(name), "%s/filerotate.log", dir);
+	snprintf(oldname, sizeof(oldname), "%s/filerotate.log.1", dir);
+	while(!__atomic_load_n(&run->done, __ATOMIC_ACQUIRE)) {
+		usleep(1000);
+		rename(name, oldname);
+		stdlog_reopen(run->ch);
+	}
+	return NULL;
+}
+
+/* Expands a driver name into the channel spec we benchmark. Anything
+ * containing a colon is taken as a channel spec as is.
+ */
+static void
+driver_spec(const char *const drvr, char *const spec, const size_t lenspec)
+{
+	if(strchr(drvr, ':') != NULL)
+		snprintf(spec, lenspec, "%s", drvr);
+	else if(!strcmp(drvr, "uxsock"))
+		snprintf(spec, lenspec, "uxsock:%s/dgram.sock", dir);
+	else if(!strcmp(drvr, "uxstream"))
+		snprintf(spec, lenspec, "uxstream:%s/stream.sock", dir);
+	else if(!strcmp(drvr, "async"))
+		snprintf(spec, lenspec, "async:file:%s/async.log", dir);
+	else if(!strcmp(drvr, "filebuf"))
+		snprintf(spec, lenspec, "file,bufsize=64k:%s/filebuf.log", dir);
+	else if(!strcmp(drvr, "fileuring"))
+		snprintf(spec, lenspec, "file,io=uring:%s/fileuring.log", dir);
+	else if(!strcmp(drvr, "filerotate"))
+		snprintf(spec, lenspec, "file,bufsize=64k:%s/filerotate.log", dir);
+	else if(!strcmp(drvr, "journal"))
+		snprintf(spec, lenspec, "journal:");
+	else
+		snprintf(spec, lenspec, "%s:%s/%s.log", drvr, dir, drvr);
+}
+
+/* removes the files a run left behind, so they do not pile up */
+static void
+cleanup_files(void)
+{
+	static const char *const names[] = { "file.log", "filebuf.log",
+		"fileuring.log", "filerotate.log", "filerotate.log.1",
+		"mmapfile.log", "async.log" };
+	char path[sizeof(dir) + 32];
+	size_t i;
+
+	for(i = 0 ; i < sizeof(names) / sizeof(names[0]) ; ++i) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		unlink(path);
+	}
+}
+
+static int
+bench(const char *const drvr, const int nthreads, const int sigsafe,
+	const int msgsize, const int nmsgs, const int json, int *const first)
+{
+	struct bench_run run;
+	struct bench_thread thr[BENCH_MAX_THREADS];
+	pthread_t tid[BENCH_MAX_THREADS];
+	pthread_t rotator;
+	char spec[1024];
+	char *payload;
+	size_t nlat = (size_t) nthreads * nmsgs;
+	uint64_t t;
+	double secs;
+	int i;
+
+	driver_spec(drvr, spec, sizeof(spec));
+	/* "bench 00000000 " takes 15 bytes of the message */
+	if((payload = malloc(msgsize > 15 ? msgsize - 15 + 1 : 1)) == NULL
+	   || (run.lat = malloc(nlat * sizeof(uint32_t))) == NULL) {
+		perror("stdlog-bench");
+		return -1;
+	}
+	memset(payload, 'x', msgsize > 15 ? msgsize - 15 : 0);
+	payload[msgsize > 15 ? msgsize - 15 : 0] = '\0';
+	run.payload = payload;
+	run.nmsgs = nmsgs;
+	run.nfailed = 0;
+	run.done = 0;
+	if((run.ch = stdlog_open("stdlog-bench", sigsafe ? STDLOG_SIGSAFE : 0,
+	                         STDLOG_LOCAL0, spec)) == NULL) {
+		perror(spec);
+		free(run.lat);
+		free(payload);
+		return -1;
+	}
+	stdlog_log(run.ch, STDLOG_INFO, "warm-up"); /* lazy driver open */
+	stdlog_flush(run.ch);
+
+	pthread_barrier_init(&run.start, NULL, nthreads + 1);
+	for(i = 0 ; i < nthreads ; ++i) {
+		thr[i].run = &run;
+		thr[i].idx = i;
+		pthread_create(&tid[i], NULL, bench_thread, &thr[i]);
+	}
+	if(!strcmp(drvr, "filerotate"))
+		pthread_create(&rotator, NULL, rotate_thread, &run);
+	pthread_barrier_wait(&run.start);
+	for(i = 0 ; i < nthreads ; ++i)
+		pthread_join(tid[i], NULL);
+	stdlog_flush(run.ch);
+	if(!strcmp(drvr, "filerotate")) {
+		__atomic_store_n(&run.done, 1, __ATOMIC_RELEASE);
+		pthread_join(rotator, NULL);
+	}
+	/* from the first thread starting to everything being flushed */
+	t = now_ns();
+	for(i = 0 ; i < nthreads ; ++i)
+		if(thr[i].tstart < t)
+			t = thr[i].tstart;
+	t = now_ns() - t;
+	pthread_barrier_destroy(&run.start);
+	stdlog_close(run.ch);
+	cleanup_files();
+
+	qsort(run.lat, nlat, sizeof(uint32_t), cmp_lat);
+	secs = t / 1e9;
+	if(json) {
+		printf("%s  {\"driver\": \"%s\", \"threads\": %d, \"format\": \"%s\", "
+		       "\"msgsize\": %d, \"msgs\": %zu, \"failed\": %d, \"seconds\": %.6f, "
+		       "\"msgs_per_sec\": %.0f, \"p50_ns\": %u, \"p99_ns\": %u, "
+		       "\"p999_ns\": %u, \"max_ns\": %u}",
+		       *first ? "" : ",\n", drvr, nthreads, sigsafe ? "sigsafe" : "vsnprintf",
+		       msgsize, nlat, run.nfailed, secs, nlat / secs,
+		       run.lat[nlat / 2], run.lat[nlat * 99 / 100],
+		       run.lat[nlat * 999 / 1000], run.lat[nlat - 1]);
+	} else {
+		printf("%s%s%s,%d,%s,%d,%zu,%d,%.6f,%.0f,%u,%u,%u,%u\n",
+		       strchr(drvr, ',') ? "\"" : "", drvr, strchr(drvr, ',') ? "\"" : "",
+		       nthreads, sigsafe ? "sigsafe" : "vsnprintf",
+		       msgsize, nlat, run.nfailed, secs, nlat / secs,
+		       run.lat[nlat / 2], run.lat[nlat * 99 / 100],
+		       run.lat[nlat * 999 / 1000], run.lat[nlat - 1]);
+	}
+	fflush(stdout);
+	*first = 0;
+	free(run.lat);
+	free(payload);
+	return 0;
+}
+
+/* Renders nmsgs timestamps for the current time, the way a log call
+ * does, cached or not. Returns the time taken in ns.
+ */
+static uint64_t
+bench_ts_run(const int nmsgs, const int cached)
+{
+	struct tm tm;
+	char buf[16];
+	volatile char sink = 0;
+	uint64_t t;
+	time_t now;
+	int i;
+
+	t = now_ns();
+	for(i = 0 ; i < nmsgs ; ++i) {
+		now = time(NULL);
+		if(cached) {
+			__stdlog_formatTimestamp3164_cached(now, buf);
+		} else {
+			__stdlog_timesub(&now, 0, &tm);
+			__stdlog_formatTimestamp3164(&tm, buf);
+		}
+		sink ^= buf[14];
+	}
+	return now_ns() - t;
+}
+
+static void
+bench_timestamps(const int nmsgs, const int json)
+{
+	uint64_t t;
+	int cached;
+
+	if(json)
+		printf("[\n");
+	else
+		printf("timestamp,msgs,seconds,ns_per_msg\n");
+	for(cached = 0 ; cached <= 1 ; ++cached) {
+		bench_ts_run(nmsgs / 10 + 1, cached); /* warm-up */
+		t = bench_ts_run(nmsgs, cached);
+		if(json)
+			printf("%s  {\"timestamp\": \"%s\", \"msgs\": %d, \"seconds\": %.6f, "
+			       "\"ns_per_msg\": %.1f}", cached ? ",\n" : "",
+			       cached ? "cached" : "uncached", nmsgs, t / 1e9,
+			       (double) t / nmsgs);
+		else
+			printf("%s,%d,%.6f,%.1f\n", cached ? "cached" : "uncached",
+			       nmsgs, t / 1e9, (double) t / nmsgs);
+	}
+	if(json)
+		printf("\n]\n");
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: stdlog-bench [-n msgs] [-t maxthreads] [-s size,...] "
+	                "[-d driver]... [-j]\n"
+	                "       stdlog-bench -T [-n msgs] [-j]\n"
+	                "  -n  messages per thread (default %d)\n"
+	                "  -t  run with 1, 2, 4, ... up to this many threads (default %d)\n"
+	                "  -s  message sizes in bytes (default 64,256,1024)\n"
+	                "  -d  driver name (file, filebuf, fileuring, filerotate, mmapfile,\n"
+	                "      uxsock, uxstream, async, journal) or channel spec, may be\n"
+	                "      repeated (default: all)\n"
+	                "  -j  JSON output instead of CSV\n"
+	                "  -T  measure timestamp rendering, cached and uncached\n",
+	                BENCH_DFLT_MSGS, BENCH_DFLT_THREADS);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int nmsgs = BENCH_DFLT_MSGS;
+	int maxthreads = BENCH_DFLT_THREADS;
+	int sizes[BENCH_MAX_SIZES] = { 64, 256, 1024 };
+	int nsizes = 3;
+	const char *drivers[BENCH_MAX_DRIVERS + 1];
+	int ndrivers = 0;
+	char dgramsock[sizeof(dir) + 16];
+	char streamsock[sizeof(dir) + 16];
+	pthread_t rcv[2];
+	char *save;
+	char *tok;
+	int json = 0;
+	int timestamps = 0;
+	int first = 1;
+	int nthreads;
+	int sigsafe;
+	int opt;
+	int d;
+	int i;
+	int r = 0;
+
+	while((opt = getopt(argc, argv, "n:t:s:d:jT")) != -1) {
+		switch(opt) {
+		case 'n':
+			if((nmsgs = atoi(optarg)) < 1)
+				usage();
+			break;
+		case 't':
+			if((maxthreads = atoi(optarg)) < 1 || maxthreads > BENCH_MAX_THREADS)
+				usage();
+			break;
+		case 's':
+			for(nsizes = 0, tok = strtok_r(optarg, ",", &save) ;
+			    tok != NULL && nsizes < BENCH_MAX_SIZES ;
+			    tok = strtok_r(NULL, ",", &save))
+				if((sizes[nsizes++] = atoi(tok)) < 1)
+					usage();
+			if(nsizes == 0)
+				usage();
+			break;
+		case 'd':
+			if(ndrivers == BENCH_MAX_DRIVERS)
+				usage();
+			drivers[ndrivers++] = optarg;
+			break;
+		case 'j':
+			json = 1;
+			break;
+		case 'T':
+			timestamps = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind != argc)
+		usage();
+	if(timestamps) {
+		bench_timestamps(nmsgs, json);
+		return 0;
+	}
+	if(ndrivers == 0)
+		for( ; dflt_drivers[ndrivers] != NULL ; ++ndrivers)
+			drivers[ndrivers] = dflt_drivers[ndrivers];
+
+	if(mkdtemp(dir) == NULL) {
+		perror(dir);
+		return 1;
+	}
+	snprintf(dgramsock, sizeof(dgramsock), "%s/dgram.sock", dir);
+	snprintf(streamsock, sizeof(streamsock), "%s/stream.sock", dir);
+	pthread_create(&rcv[0], NULL, receiver, dgramsock);
+	pthread_create(&rcv[1], NULL, receiver, streamsock);
+	usleep(100000); /* let them bind */
+
+	stdlog_init(0);
+	if(json)
+		printf("[\n");
+	else
+		printf("driver,threads,format,msgsize,msgs,failed,seconds,msgs_per_sec,"
+		       "p50_ns,p99_ns,p999_ns,max_ns\n");
+	for(d = 0 ; d < ndrivers ; ++d) {
+		for(nthreads = 1 ; ; nthreads = (2 * nthreads > maxthreads) ? maxthreads : 2 * nthreads) {
+			for(sigsafe = 1 ; sigsafe >= 0 ; --sigsafe)
+				for(i = 0 ; i < nsizes ; ++i)
+					if(bench(drivers[d], nthreads, sigsafe, sizes[i], nmsgs,
+					         json, &first) != 0)
+						r = 1;
+			if(nthreads == maxthreads)
+				break;
+		}
+	}
+	if(json)
+		printf("\n]\n");
+	stdlog_deinit();
+
+	stop_receivers = 1;
+	pthread_join(rcv[0], NULL);
+	pthread_join(rcv[1], NULL);
+	rmdir(dir);
+	return r;
+}
@@ -0,0 +1,254 @@
+/* Helpers for parsing stdlog channel specifications.
+ *
+ * A channel specification has the form
+ *
+ *    driver[,param[=value]]...:driver-argument
+ *
+ * The optional comma-separated parameter list sits between the driver
+ * name and the first colon. Parameter values can thus contain neither
+ * ',' nor ':'. Everything after the first colon belongs to the driver
+ * (e.g. a file name or, for wrapping drivers, another channel spec).
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include "stdlog-intern.h"
+
+/* returns 1 if spec selects driver drvrname, 0 otherwise */
+int
+__stdlog_chanspec_is(const char *__restrict__ const spec,
+	const char *__restrict__ const drvrname)
+{
+	const size_t len = strlen(drvrname);
+
+	return !strncmp(spec, drvrname, len)
+	       && (spec[len] == ':' || spec[len] == ',');
+}
+
+/* returns the driver argument, that is everything after the first
+ * colon. If there is no colon, an empty string is returned.
+ */
+const char *
+__stdlog_chanspec_arg(const char *const spec)
+{
+	const char *const colon = strchr(spec, ':');
+
+	return (colon == NULL) ? "" : colon + 1;
+}
+
+/* Searches the parameter list of spec for parameter name. If found,
+ * returns a pointer to its value (which is NOT '\0'-terminated) and
+ * stores the value length in *lenval. Parameters without a value
+ * ("flags") return a pointer to an empty value. Returns NULL if the
+ * parameter is not present.
+ */
+const char *
+__stdlog_chanspec_param(const char *__restrict__ const spec,
+	const char *__restrict__ const name,
+	size_t *__restrict__ const lenval)
+{
+	const size_t lenname = strlen(name);
+	const char *p;
+	size_t lenparam;
+
+	for(p = spec ; *p != ',' ; ++p)
+		if(*p == ':' || *p == '\0')
+			return NULL;	/* no parameter list */
+
+	while(*p == ',') {
+		++p;
+		for(lenparam = 0 ; p[lenparam] != '\0' && p[lenparam] != ','
+		                   && p[lenparam] != ':' ; ++lenparam)
+			/* just count */;
+		if(   lenparam >= lenname && !strncmp(p, name, lenname)
+		   && (lenparam == lenname || p[lenname] == '=')) {
+			*lenval = (lenparam == lenname) ? 0 : lenparam - lenname - 1;
+			return (lenparam == lenname) ? p + lenparam : p + lenname + 1;
+		}
+		p += lenparam;
+	}
+	return NULL;
+}
+
+/* returns 1 if parameter name is present, 0 otherwise */
+int
+__stdlog_chanspec_has_param(const char *__restrict__ const spec,
+	const char *__restrict__ const name)
+{
+	size_t lenval;
+	return __stdlog_chanspec_param(spec, name, &lenval) != NULL;
+}
+
+/* returns 1 if parameter name has exactly the value val, 0 otherwise */
+int
+__stdlog_chanspec_param_is(const char *__restrict__ const spec,
+	const char *__restrict__ const name,
+	const char *__restrict__ const val)
+{
+	size_t lenval;
+	const char *const v = __stdlog_chanspec_param(spec, name, &lenval);
+
+	return v != NULL && lenval == strlen(val) && !strncmp(v, val, lenval);
+}
+
+/* Returns the numerical value of parameter name or dflt if it is not
+ * present or not a number. A "k", "m" or "g" suffix multiplies the
+ * value by 1024, 1024^2 or 1024^3, respectively.
+ */
+int64_t
+__stdlog_chanspec_param_int(const char *__restrict__ const spec,
+	const char *__restrict__ const name,
+	const int64_t dflt)
+{
+	size_t lenval;
+	size_t i;
+	int64_t n = 0;
+	const char *const v = __stdlog_chanspec_param(spec, name, &lenval);
+
+	if(v == NULL || lenval == 0 || v[0] < '0' || v[0] > '9')
+		return dflt;
+	for(i = 0 ; i < lenval && v[i] >= '0' && v[i] <= '9' ; ++i)
+		n = n * 10 + v[i] - '0';
+	if(i == lenval)
+		return n;
+	if(i + 1 != lenval)
+		return dflt;
+	switch(v[i]) {
+	case 'k':
+	case 'K':
+		return n * 1024;
+	case 'm':
+	case 'M':
+		return n * 1024 * 1024;
+	case 'g':
+	case 'G':
+		return n * 1024 * 1024 * 1024;
+	default:
+		return dflt;
+	}
+}
+
+/* Returns the severity given by the lenval bytes at val, or dflt if it
+ * is invalid. Severities may be given numerically or by their
+ * traditional syslog names ("err", "warning", ...).
+ */
+int
+__stdlog_parse_sev(const char *__restrict__ const val, const size_t lenval,
+	const int dflt)
+{
+	static const char *const sevnames[8] = { "emerg", "alert", "crit",
+		"err", "warning", "notice", "info", "debug" };
+	int i;
+
+	if(lenval == 1 && val[0] >= '0' && val[0] <= '7')
+		return val[0] - '0';
+	for(i = 0 ; i < 8 ; ++i)
+		if(lenval == strlen(sevnames[i]) && !strncmp(val, sevnames[i], lenval))
+			return i;
+	return dflt;
+}
+
+/* Returns the severity given by parameter name or dflt if it is not
+ * present or invalid, see __stdlog_parse_sev().
+ */
+int
+__stdlog_chanspec_param_sev(const char *__restrict__ const spec,
+	const char *__restrict__ const name,
+	const int dflt)
+{
+	size_t lenval;
+	const char *const v = __stdlog_chanspec_param(spec, name, &lenval);
+
+	if(v == NULL)
+		return dflt;
+	return __stdlog_parse_sev(v, lenval, dflt);
+}
+
+/* Resolves the "host[:port]" argument of a network driver spec into a
+ * socket address. IPv6 addresses must be enclosed in brackets if a port
+ * is given ("[::1]:514"). The port defaults to 514, the syslog port.
+ * Returns 0 on success, -1 with errno set otherwise.
+ */
+int
+__stdlog_chanspec_resolve(const char *__restrict__ const spec,
+	const int socktype,
+	struct sockaddr_storage *__restrict__ const addr,
+	socklen_t *__restrict__ const lenaddr)
+{
+	const char *const arg = __stdlog_chanspec_arg(spec);
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	char host[256];
+	const char *port = "514";
+	const char *end;
+	size_t lenhost;
+	int r = -1;
+
+	if(arg[0] == '[') {
+		if((end = strchr(arg, ']')) == NULL)
+			goto inval;
+		lenhost = end - (arg + 1);
+		memcpy(host, arg + 1, lenhost < sizeof(host) ? lenhost : 0);
+		if(end[1] == ':')
+			port = end + 2;
+		else if(end[1] != '\0')
+			goto inval;
+	} else {
+		end = strrchr(arg, ':');
+		if(end != NULL && strchr(arg, ':') != end)
+			end = NULL; /* unbracketed IPv6 address, no port */
+		lenhost = (end == NULL) ? strlen(arg) : (size_t) (end - arg);
+		memcpy(host, arg, lenhost < sizeof(host) ? lenhost : 0);
+		if(end != NULL)
+			port = end + 1;
+	}
+	if(lenhost == 0 || lenhost >= sizeof(host) || *port == '\0')
+		goto inval;
+	host[lenhost] = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socktype;
+	if(getaddrinfo(host, port, &hints, &res) != 0 || res == NULL) {
+		errno = EHOSTUNREACH;
+		goto done;
+	}
+	memcpy(addr, res->ai_addr, res->ai_addrlen);
+	*lenaddr = res->ai_addrlen;
+	r = 0;
+	goto done;
+
+inval:	errno = EINVAL;
+done:	if(res != NULL)
+		freeaddrinfo(res);
+	return r;
+}
@@ -0,0 +1,639 @@
+/* The stdlog deferred driver. It wraps another channel, given in the
+ * driver argument, and moves message formatting off the caller's
+ * thread. A log call only records the format string pointer, the
+ * message time and the raw argument values (strings are copied) into
+ * a ring buffer owned by the calling thread. A consumer thread turns
+ * the records into text with the stdlog formatter and hands them to
+ * the wrapped channel's driver.
+ *
+ * Each logging thread claims one ring from a preallocated pool when it
+ * first logs to the channel and returns it when it terminates, so the
+ * rings are single-producer/single-consumer and need no atomic
+ * read-modify-write operations on the fast path. As a consequence,
+ * messages are ordered per thread, but not across threads.
+ *
+ * To avoid parsing the format string on each call, every ring caches
+ * the argument types of the format strings recently used by its
+ * thread, keyed by the format string's address. This assumes format
+ * strings are constant, which is the case for all sane callers.
+ *
+ * If a message cannot be deferred (no ring left, more than
+ * DEFER_MAXARGS arguments, or the call happened in a signal handler
+ * that interrupted a log call on the same thread), it is passed to the
+ * wrapped channel directly.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define DEFER_DFLT_BUFSIZE	(64 * 1024) /* per-thread ring size (bytes) */
+#define DEFER_DFLT_THREADS	64	/* max. threads with their own ring */
+#define DEFER_MAXARGS		32	/* max. arguments per message */
+#define DEFER_NCACHE		64	/* format cache entries per ring */
+#define DEFER_IDLE_MS		1000	/* max time the consumer sleeps unwoken */
+#define DEFER_PAUSE_NS		100000	/* producer back-off if ring is full */
+#define DEFER_NSLOTS		8	/* deferred channels with a ring per thread */
+
+/* A record in a ring. It is followed by the copies of the string
+ * arguments, whose args[] entries point to these copies. A record
+ * with fmt == NULL just pads the ring up to its end.
+ */
+struct defer_rec {
+	uint32_t size;	/* total record size, multiple of 8 */
+	uint8_t severity;
+	uint8_t nargs;
+	time_t t;	/* time the message was logged */
+	const char *fmt;
+	union __stdlog_fmt_arg args[];
+};
+
+struct defer_fmtinfo {
+	const char *fmt;
+	int nargs;	/* -1: too many arguments */
+	uint8_t types[DEFER_MAXARGS];
+	int precs[DEFER_MAXARGS];	/* string precisions */
+};
+
+struct defer_ring {
+	uint64_t head;		/* write position (producer) */
+	char pad[64 - sizeof(uint64_t)]; /* keep producer off consumer line */
+	uint64_t tail;		/* read position (consumer) */
+	int in_use;		/* claimed by a thread */
+	int orphaned;		/* owning thread has terminated */
+	int busy;		/* owning thread is inside a log call */
+	char *buf;
+	struct defer_fmtinfo cache[DEFER_NCACHE]; /* owning thread only */
+};
+
+struct __stdlog_defer {
+	uint64_t id;		/* unique while open, 0 once closed */
+	struct __stdlog_defer *next; /* free list, once closed */
+	int nrings;
+	struct defer_ring *rings;
+	uint64_t bufsize;	/* always a power of 2 */
+	int drop_when_full;
+	int sleeping;		/* consumer waits for wakeup */
+	int stop;		/* consumer shall terminate */
+	int wakefd[2];
+	pthread_t consumer;
+};
+
+#define DEFER_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+/* The calling thread's rings, one per deferred channel it logs to.
+ * A slot is stale if its channel has been closed, which shows in the
+ * id: channel structures are never freed, but kept for reuse, so that
+ * reading dfr->id is always safe, also from a signal handler. The
+ * pthread key only serves to learn about the thread's termination; it
+ * is set once per thread, and being the library's only key for this
+ * purpose, it is created early enough for glibc to store its value
+ * without allocating memory.
+ */
+static __thread struct defer_slot {
+	struct __stdlog_defer *dfr;
+	uint64_t id;
+	struct defer_ring *ring;
+} defer_slots[DEFER_NSLOTS] __attribute__((tls_model("initial-exec")));
+static __thread int defer_registered __attribute__((tls_model("initial-exec"))) = 0;
+
+static pthread_once_t defer_once = PTHREAD_ONCE_INIT;
+static pthread_key_t defer_key;
+static int defer_key_err = 0;
+static pthread_mutex_t defer_mut = PTHREAD_MUTEX_INITIALIZER; /* guards ids */
+static uint64_t defer_nextid = 1;
+static struct __stdlog_defer *defer_freelist = NULL;
+
+/* wake the consumer, if it sleeps. This is signal-safe. */
+static void
+defer_wake(struct __stdlog_defer *const dfr)
+{
+	ssize_t __attribute__((unused)) r;
+
+	if(__atomic_exchange_n(&dfr->sleeping, 0, __ATOMIC_SEQ_CST))
+		r = write(dfr->wakefd[1], "", 1);
+}
+
+static void
+defer_pause(void)
+{
+	struct timespec ts = { 0, DEFER_PAUSE_NS };
+	nanosleep(&ts, NULL);
+}
+
+/* pthread key destructor: the calling thread terminates. For each
+ * channel still open, the consumer returns the thread's ring to the
+ * pool once it has drained it.
+ */
+static void
+defer_thread_exit(void __attribute__((unused)) *arg)
+{
+	int i;
+
+	pthread_mutex_lock(&defer_mut);
+	for(i = 0 ; i < DEFER_NSLOTS ; ++i)
+		if(defer_slots[i].ring != NULL && defer_slots[i].dfr->id == defer_slots[i].id)
+			__atomic_store_n(&defer_slots[i].ring->orphaned, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&defer_mut);
+}
+
+static void
+defer_key_create(void)
+{
+	defer_key_err = pthread_key_create(&defer_key, defer_thread_exit);
+}
+
+/* returns the calling thread's ring, NULL if it has none yet */
+static inline struct defer_ring *
+defer_ring(struct __stdlog_defer *const dfr)
+{
+	int i;
+
+	for(i = 0 ; i < DEFER_NSLOTS ; ++i)
+		if(defer_slots[i].dfr == dfr && defer_slots[i].id == dfr->id)
+			return defer_slots[i].ring;
+	return NULL;
+}
+
+/* claims a free ring for the calling thread, returns NULL if none left
+ * or if the thread already logs to DEFER_NSLOTS other deferred channels
+ */
+static struct defer_ring *
+defer_claim_ring(struct __stdlog_defer *const dfr)
+{
+	struct defer_slot *slot = NULL;
+	struct defer_ring *ring;
+	int expected;
+	int i;
+
+	for(i = 0 ; i < DEFER_NSLOTS && slot == NULL ; ++i)
+		if(   defer_slots[i].ring == NULL
+		   || __atomic_load_n(&defer_slots[i].dfr->id, __ATOMIC_ACQUIRE) != defer_slots[i].id)
+			slot = &defer_slots[i];
+	if(slot == NULL)
+		return NULL;
+	if(!defer_registered) {
+		if(pthread_setspecific(defer_key, defer_slots) != 0)
+			return NULL;
+		defer_registered = 1;
+	}
+
+	for(i = 0 ; i < dfr->nrings ; ++i) {
+		ring = &dfr->rings[i];
+		expected = 0;
+		if(__atomic_compare_exchange_n(&ring->in_use, &expected, 1, 0,
+		       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			slot->ring = NULL;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			slot->dfr = dfr;
+			slot->id = dfr->id;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			slot->ring = ring;
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+/* returns the cached argument types for fmt */
+static struct defer_fmtinfo *
+defer_fmtinfo(struct defer_ring *const ring, const char *const fmt)
+{
+	struct defer_fmtinfo *const info =
+		&ring->cache[((uintptr_t) fmt >> 3) % DEFER_NCACHE];
+
+	if(info->fmt != fmt) {
+		info->nargs = __stdlog_fmt_argtypes(fmt, info->types, info->precs,
+			DEFER_MAXARGS);
+		info->fmt = fmt;
+	}
+	return info;
+}
+
+/* Reserves size contiguous bytes in the ring, padding to its end if
+ * needed. Returns the new head position to publish once the record is
+ * written, 0 with errno set if the record can never fit (EMSGSIZE) or
+ * the ring is full and messages shall be dropped (EAGAIN).
+ * *rec is set to where the record goes.
+ */
+static uint64_t
+defer_reserve(struct __stdlog_defer *const dfr, struct defer_ring *const ring,
+	const size_t size, struct defer_rec **const rec)
+{
+	const uint64_t head = ring->head;
+	const size_t off = head & (dfr->bufsize - 1);
+	size_t skip = 0;
+	struct defer_rec *pad;
+
+	if(off + size > dfr->bufsize)
+		skip = dfr->bufsize - off;
+	if(skip + size > dfr->bufsize) {	/* would wait forever */
+		errno = EMSGSIZE;
+		return 0;
+	}
+	while(head + skip + size - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+	      > dfr->bufsize) {
+		if(dfr->drop_when_full) {
+			errno = EAGAIN;
+			return 0;
+		}
+		defer_wake(dfr);
+		defer_pause();
+	}
+	if(skip > 0 && skip >= sizeof(struct defer_rec)) {
+		pad = (struct defer_rec *) (ring->buf + off);
+		pad->size = skip;
+		pad->fmt = NULL;
+	}
+	*rec = (struct defer_rec *) (ring->buf + ((head + skip) & (dfr->bufsize - 1)));
+	return head + skip + size;
+}
+
+/* hands a message directly to the wrapped channel */
+static int
+defer_log_direct(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	return __stdlog_drvr_log_va(ch->d.defer.child, severity, wrkbuf, buflen,
+		fmt, ap);
+}
+
+static int
+defer_log(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+	struct defer_ring *ring;
+	struct defer_fmtinfo *info;
+	struct defer_rec *rec;
+	union __stdlog_fmt_arg args[DEFER_MAXARGS];
+	size_t lenstr[DEFER_MAXARGS];
+	size_t lenstrs = 0;
+	size_t maxstrs;
+	size_t room;
+	size_t size;
+	uint64_t newhead;
+	char *strs;
+	int i;
+	int r = 0;
+
+	ring = defer_ring(dfr);
+	if(ring == NULL && (ring = defer_claim_ring(dfr)) == NULL)
+		return defer_log_direct(ch, severity, fmt, ap, wrkbuf, buflen);
+	if(ring->busy)	/* we interrupted ourselves, ring is in flux */
+		return defer_log_direct(ch, severity, fmt, ap, wrkbuf, buflen);
+	ring->busy = 1;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	info = defer_fmtinfo(ring, fmt);
+	if(info->nargs < 0) {
+		r = defer_log_direct(ch, severity, fmt, ap, wrkbuf, buflen);
+		goto done;
+	}
+
+	/* strings are limited to what fits into a message */
+	maxstrs = (buflen < __STDLOG_MSGBUF_SIZE) ? buflen : __STDLOG_MSGBUF_SIZE;
+	for(i = 0 ; i < info->nargs ; ++i) {
+		__STDLOG_FMT_VA_ARG(ap, info->types[i], args[i]);
+		if(info->types[i] == __STDLOG_ARG_STR && args[i].s != NULL) {
+			lenstr[i] = __stdlog_fmt_strarg_len(args, i, info->precs[i]);
+			room = (lenstrs >= maxstrs) ? 0 : maxstrs - lenstrs;
+			if(lenstr[i] + 1 > room)
+				lenstr[i] = (room > 0) ? room - 1 : 0;
+			lenstrs += lenstr[i] + 1;
+		}
+	}
+
+	size = DEFER_ALIGN(sizeof(struct defer_rec)
+	                   + info->nargs * sizeof(union __stdlog_fmt_arg) + lenstrs);
+	if((newhead = defer_reserve(dfr, ring, size, &rec)) == 0) {
+		r = -1;
+		goto done;
+	}
+	rec->size = size;
+	rec->severity = severity;
+	rec->nargs = info->nargs;
+	rec->t = __STDLOG_MSGTIME();
+	rec->fmt = fmt;
+	strs = (char *) (rec->args + info->nargs);
+	for(i = 0 ; i < info->nargs ; ++i) {
+		if(info->types[i] == __STDLOG_ARG_STR && args[i].s != NULL) {
+			memcpy(strs, args[i].s, lenstr[i]);
+			strs[lenstr[i]] = '\0';
+			args[i].s = strs;
+			strs += lenstr[i] + 1;
+		}
+		rec->args[i] = args[i];
+	}
+	__atomic_store_n(&ring->head, newhead, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&dfr->sleeping, __ATOMIC_SEQ_CST))
+		defer_wake(dfr);
+
+done:
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	ring->busy = 0;
+	return r;
+}
+
+/* returns 1 if any ring has records to drain, 0 otherwise */
+static int
+defer_have_data(struct __stdlog_defer *const dfr)
+{
+	struct defer_ring *ring;
+	int i;
+
+	for(i = 0 ; i < dfr->nrings ; ++i) {
+		ring = &dfr->rings[i];
+		if(   __atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE)
+		   && (   __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail
+		       || __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE)))
+			return 1;
+	}
+	return 0;
+}
+
+/* Drains a ring. Returns the number of records processed. */
+static int
+defer_drain(stdlog_channel_t ch, struct defer_ring *const ring,
+	char *const msgbuf, char *const wrkbuf)
+{
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+	const int orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE);
+	const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	struct defer_rec *rec;
+	size_t off;
+	int n = 0;
+
+	while(ring->tail != head) {
+		off = ring->tail & (dfr->bufsize - 1);
+		if(dfr->bufsize - off < sizeof(struct defer_rec)) {
+			/* too small for a padding record */
+			ring->tail += dfr->bufsize - off;
+			continue;
+		}
+		rec = (struct defer_rec *) (ring->buf + off);
+		if(rec->fmt != NULL) {
+			__stdlog_truncated = 0;
+			__stdlog_fmt_render_args(msgbuf, __STDLOG_MSGBUF_SIZE,
+				rec->fmt, rec->args);
+			if(__stdlog_truncated) /* the log call could not know */
+				__STDLOG_STATS_ADD(ch, truncated, 1);
+			__stdlog_pinned_time = rec->t;
+			__stdlog_drvr_log_msg(ch->d.defer.child, rec->severity,
+				wrkbuf, __STDLOG_MSGBUF_SIZE, msgbuf);
+			__stdlog_pinned_time = 0;
+			++n;
+		}
+		__atomic_store_n(&ring->tail, ring->tail + rec->size, __ATOMIC_RELEASE);
+	}
+
+	if(orphaned) {
+		/* the thread is gone and has logged its last message,
+		 * so return the ring to the pool. Positions are kept, so
+		 * that a concurrent defer_flush() does not get confused.
+		 */
+		memset(ring->cache, 0, sizeof(ring->cache));
+		ring->orphaned = 0;
+		__atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+	}
+	return n;
+}
+
+static void *
+defer_consumer(void *arg)
+{
+	stdlog_channel_t ch = (stdlog_channel_t) arg;
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+	struct pollfd pfd;
+	char msgbuf[__STDLOG_MSGBUF_SIZE];
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+	char drainbuf[64];
+	int n;
+	int i;
+
+	pfd.fd = dfr->wakefd[0];
+	pfd.events = POLLIN;
+	while(1) {
+		n = 0;
+		for(i = 0 ; i < dfr->nrings ; ++i)
+			if(__atomic_load_n(&dfr->rings[i].in_use, __ATOMIC_ACQUIRE))
+				n += defer_drain(ch, &dfr->rings[i], msgbuf, wrkbuf);
+		if(n > 0)
+			continue;
+
+		/* nothing to do, go to sleep -- but re-check after announcing
+		 * it, a producer may have published in the meantime.
+		 */
+		__atomic_store_n(&dfr->sleeping, 1, __ATOMIC_SEQ_CST);
+		if(defer_have_data(dfr)) {
+			__atomic_store_n(&dfr->sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		if(__atomic_load_n(&dfr->stop, __ATOMIC_SEQ_CST))
+			break;
+		poll(&pfd, 1, DEFER_IDLE_MS);
+		while(read(dfr->wakefd[0], drainbuf, sizeof(drainbuf)) > 0)
+			/* just drain */;
+		__atomic_store_n(&dfr->sleeping, 0, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+static void
+defer_free(stdlog_channel_t ch)
+{
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+	int i;
+
+	if(dfr != NULL) {
+		/* threads may still have it in their slots, so keep it */
+		pthread_mutex_lock(&defer_mut);
+		__atomic_store_n(&dfr->id, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&defer_mut);
+		if(dfr->wakefd[0] != -1) {
+			close(dfr->wakefd[0]);
+			close(dfr->wakefd[1]);
+		}
+		if(dfr->rings != NULL) {
+			for(i = 0 ; i < dfr->nrings ; ++i)
+				free(dfr->rings[i].buf);
+			free(dfr->rings);
+		}
+		pthread_mutex_lock(&defer_mut);
+		dfr->next = defer_freelist;
+		defer_freelist = dfr;
+		pthread_mutex_unlock(&defer_mut);
+		ch->d.defer.dfr = NULL;
+	}
+	if(ch->d.defer.child != NULL) {
+		stdlog_close(ch->d.defer.child);
+		ch->d.defer.child = NULL;
+	}
+}
+
+static int
+defer_init(stdlog_channel_t ch)
+{
+	struct __stdlog_defer *dfr;
+	int64_t bufsize;
+	int64_t nthreads;
+	int i;
+	int r;
+
+	bufsize = __stdlog_chanspec_param_int(ch->spec, "bufsize", DEFER_DFLT_BUFSIZE);
+	nthreads = __stdlog_chanspec_param_int(ch->spec, "threads", DEFER_DFLT_THREADS);
+	if(   bufsize < 4 * __STDLOG_MSGBUF_SIZE || bufsize > 64 * 1024 * 1024
+	   || nthreads < 1 || nthreads > 4096) {
+		errno = EINVAL;
+		return -1;
+	}
+	if((ch->d.defer.child = stdlog_open(ch->ident, ch->options, ch->facility,
+	                                    __stdlog_chanspec_arg(ch->spec))) == NULL)
+		return -1;
+	pthread_once(&defer_once, defer_key_create);
+	if(defer_key_err != 0) {
+		errno = defer_key_err;
+		goto fail;
+	}
+	pthread_mutex_lock(&defer_mut);
+	if((dfr = defer_freelist) != NULL)
+		defer_freelist = dfr->next;
+	pthread_mutex_unlock(&defer_mut);
+	if(dfr == NULL && (dfr = malloc(sizeof(struct __stdlog_defer))) == NULL)
+		goto fail_nomem;
+	/* other threads may check the id of a reused one concurrently */
+	memset((char *) dfr + sizeof(dfr->id), 0,
+	       sizeof(struct __stdlog_defer) - sizeof(dfr->id));
+	dfr->wakefd[0] = dfr->wakefd[1] = -1;
+	pthread_mutex_lock(&defer_mut);
+	__atomic_store_n(&dfr->id, defer_nextid++, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&defer_mut);
+	ch->d.defer.dfr = dfr;
+	for(dfr->bufsize = 4096 ; (int64_t) dfr->bufsize < bufsize ; dfr->bufsize <<= 1)
+		/* round up to power of 2 */;
+	dfr->drop_when_full = __stdlog_chanspec_param_is(ch->spec, "full", "drop");
+	dfr->nrings = nthreads;
+	if((dfr->rings = calloc(nthreads, sizeof(struct defer_ring))) == NULL)
+		goto fail_nomem;
+	for(i = 0 ; i < dfr->nrings ; ++i)
+		if((dfr->rings[i].buf = malloc(dfr->bufsize)) == NULL)
+			goto fail_nomem;
+
+	if(pipe(dfr->wakefd) != 0)
+		goto fail;
+	for(i = 0 ; i < 2 ; ++i) {
+		fcntl(dfr->wakefd[i], F_SETFL, O_NONBLOCK);
+		fcntl(dfr->wakefd[i], F_SETFD, FD_CLOEXEC);
+	}
+	if((r = pthread_create(&dfr->consumer, NULL, defer_consumer, ch)) != 0) {
+		errno = r;
+		goto fail;
+	}
+	return 0;
+
+fail_nomem:
+	errno = ENOMEM;
+fail:
+	r = errno;
+	defer_free(ch);
+	errno = r;
+	return -1;
+}
+
+static void
+defer_open(stdlog_channel_t ch)
+{
+	ch->d.defer.child->drvr.open(ch->d.defer.child);
+}
+
+/* Closing drains all records still in the rings. No thread must log
+ * to the channel while or after it is closed.
+ */
+static void
+defer_close(stdlog_channel_t ch)
+{
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+
+	__atomic_store_n(&dfr->stop, 1, __ATOMIC_SEQ_CST);
+	defer_wake(dfr);
+	pthread_join(dfr->consumer, NULL);
+	defer_free(ch);
+}
+
+/* Waits until everything logged before the call has been handed to
+ * the wrapped channel, then flushes that channel.
+ */
+static int
+defer_flush(stdlog_channel_t ch)
+{
+	struct __stdlog_defer *const dfr = ch->d.defer.dfr;
+	struct defer_ring *ring;
+	uint64_t target;
+	int i;
+
+	for(i = 0 ; i < dfr->nrings ; ++i) {
+		ring = &dfr->rings[i];
+		if(!__atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE))
+			continue;
+		target = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		while(   __atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE)
+		      && __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < target) {
+			defer_wake(dfr);
+			defer_pause();
+		}
+	}
+	return stdlog_flush(ch->d.defer.child);
+}
+
+/* the child channel owns the output, so it does the reopening */
+static int
+defer_reopen(stdlog_channel_t ch)
+{
+	return stdlog_reopen(ch->d.defer.child);
+}
+
+void
+__stdlog_set_defer_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = defer_init;
+	ch->drvr.open = defer_open;
+	ch->drvr.close = defer_close;
+	ch->drvr.log = defer_log;
+	ch->drvr.flush = defer_flush;
+	ch->drvr.reopen = defer_reopen;
+}
@@ -33,33 +33,40 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <time.h>
 #include <errno.h>
+#include <pthread.h>
 #include "stdlog-intern.h"
 #include "stdlog.h"
 
-static int
-build_file_line(stdlog_channel_t ch,
+#define FILE_DFLT_FLUSHMS 1000		/* default flush interval if buffered */
+#define FILE_MAX_BUFSIZE (64*1024*1024)	/* sanity limit for buffer size */
+#define FILE_LOCK_SPINS 1000	/* sigsafe mode: max tries to get buffer lock */
+#define FILE_ROTATE_CHECKMS 250	/* check for due rotation this often */
+#define FILE_DFLT_KEEP 5	/* default number of rotated files kept */
+#define FILE_MAX_KEEP 999
+#define FILE_DFLT_URING_BUFSIZE (64*1024)	/* default buffer size for io=uring */
+#define FILE_DFLT_URING_DEPTH 8	/* default number of io_uring buffers */
+#define FILE_MAX_URING_DEPTH 256
+
+/* Builds a line as written by the file drivers. The line ends with
+ * '\n' and is not NUL-terminated. Returns its length.
+ */
+size_t
+__stdlog_build_file_line(stdlog_channel_t ch,
 	char *__restrict__ const linebuf,
 	const size_t lenline,
 	const char *fmt,
 	va_list ap)
 {
 	int i = 0;
-	struct tm tm;
-	const time_t t = time(NULL);
+	const time_t t = __STDLOG_MSGTIME();
 
-	__stdlog_timesub(&t, 0, &tm);
-	i += __stdlog_formatTimestamp3164(&tm, linebuf+i);
-	__STDLOG_STRBUILD_ADD_CHAR(linebuf, lenline, i, ' ');
-	__stdlog_fmt_print_str(linebuf, lenline, &i, ch->ident);
-	if (ch->options & STDLOG_PID) {
-		__STDLOG_STRBUILD_ADD_CHAR(linebuf, lenline, i, '[');
-		__stdlog_fmt_print_int(linebuf, lenline, &i, getpid());
-		__STDLOG_STRBUILD_ADD_CHAR(linebuf, lenline, i, ']');
-	}
-	__STDLOG_STRBUILD_ADD_CHAR(linebuf, lenline, i, ':');
+	i += __stdlog_formatTimestamp3164_cached(t, linebuf+i);
 	__STDLOG_STRBUILD_ADD_CHAR(linebuf, lenline, i, ' ');
+	__stdlog_hdr_add_tag(ch, linebuf, lenline, &i);
 	/* note: we do not need to reserve space for '\0', as we
 	 * will overwrite it with the '\n' below. We don't need 
 	 * a string, just a buffer, so we don't need '\0'!
@@ -69,25 +76,415 @@ build_file_line(stdlog_channel_t ch,
 	return i;
 }
 
+/* Writes iovcnt buffers with a single system call. Partial writes
+ * are reported as an error with errno EAGAIN, just as for
+ * unbuffered writes.
+ */
+static int
+file_writev(stdlog_channel_t ch, const struct iovec *iov, const int iovcnt)
+{
+	ssize_t lenWritten;
+	ssize_t lenTotal = 0;
+	int i;
+	int r;
+
+	for(i = 0 ; i < iovcnt ; ++i)
+		lenTotal += iov[i].iov_len;
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	lenWritten = (iovcnt == 1) ? write(ch->d.file.fd, iov[0].iov_base, iov[0].iov_len)
+	                           : writev(ch->d.file.fd, iov, iovcnt);
+	if(lenWritten == -1) {
+		r = -1;
+	} else if(lenWritten != lenTotal) {
+		__STDLOG_STATS_ADD(ch, eagain, 1);
+		r = -1;
+		errno = EAGAIN;
+	} else {
+		r = 0;
+	}
+	if(lenWritten > 0)
+		__STDLOG_STATS_ADD(ch, bytes, lenWritten);
+	if(lenWritten > 0 && ch->d.file.maxsize > 0)
+		__atomic_add_fetch(&ch->d.file.written, lenWritten, __ATOMIC_RELAXED);
+	return r;
+}
+
+/* Submits the buffer to io_uring and continues with the next one.
+ * The kernel reads the submitted buffer until the write completes, so
+ * if we cannot get the next one, we wait for all writes and try again.
+ * If that fails, too, the ring is broken and we cannot tell when any
+ * buffer is free: the buffer size is set to 0, so that all further
+ * lines bypass the buffers and are written by file_writev().
+ * Must be called with the buffer mutex locked.
+ */
+static int
+file_uring_submit(stdlog_channel_t ch)
+{
+	char *next;
+
+	__STDLOG_STATS_ADD(ch, bytes, ch->d.file.used);
+	if(ch->d.file.maxsize > 0)
+		__atomic_add_fetch(&ch->d.file.written, ch->d.file.used, __ATOMIC_RELAXED);
+	__stdlog_uring_write(ch->d.file.uring, ch->d.file.fd,
+	                     ch->d.file.buf, ch->d.file.used);
+	ch->d.file.used = 0;
+	if((next = __stdlog_uring_buf(ch->d.file.uring)) != NULL) {
+		ch->d.file.buf = next;
+		return 0;
+	}
+	__stdlog_uring_wait(ch->d.file.uring);
+	if((next = __stdlog_uring_buf(ch->d.file.uring)) != NULL)
+		ch->d.file.buf = next;
+	else
+		ch->d.file.lenbuf = 0;
+	return -1;
+}
+
+/* must be called with the buffer mutex locked */
+static int
+file_flush_locked(stdlog_channel_t ch)
+{
+	struct iovec iov;
+	int r = 0;
+
+	if(ch->d.file.used > 0 && ch->d.file.fd >= 0) {
+		if(ch->d.file.uring != NULL)
+			return file_uring_submit(ch);
+		iov.iov_base = ch->d.file.buf;
+		iov.iov_len = ch->d.file.used;
+		r = file_writev(ch, &iov, 1);
+		ch->d.file.used = 0;
+	}
+	return r;
+}
+
+static int
+file_flush(stdlog_channel_t ch)
+{
+	int r;
+
+	if(ch->d.file.buf == NULL)
+		return 0;
+	pthread_mutex_lock(&ch->d.file.mut);
+	r = file_flush_locked(ch);
+	if(ch->d.file.uring != NULL && __stdlog_uring_wait(ch->d.file.uring) != 0)
+		r = -1;
+	pthread_mutex_unlock(&ch->d.file.mut);
+	return r;
+}
+
+/* Appends a line to the channel buffer, writing the buffer if needed.
+ * If the line does not fit into the buffer, buffer and line are
+ * written together via writev(). With io_uring, the buffer is
+ * submitted instead and the line goes to the next one.
+ * In signal-safe mode, we must not block on the buffer mutex, as we
+ * may have interrupted its owner. So we try a bounded number of times
+ * and, if it is still busy, write the line directly. It may then be
+ * emitted ahead of lines still in the buffer.
+ * The line is given as iov[1] to iov[iovcnt-1], of total length
+ * lenline; iov[0] is used for the buffer.
+ * Note: memcpy() is async-signal-safe as of POSIX.1-2008 TC2.
+ */
+static int
+file_buffered_write(stdlog_channel_t ch, const int severity,
+	struct iovec *const iov, const int iovcnt, const size_t lenline)
+{
+	int spins = 0;
+	int r = 0;
+	int i;
+
+	if(ch->options & STDLOG_SIGSAFE) {
+		while(pthread_mutex_trylock(&ch->d.file.mut) != 0) {
+			if(++spins < FILE_LOCK_SPINS)
+				continue;
+			return file_writev(ch, iov + 1, iovcnt - 1);
+		}
+	} else {
+		pthread_mutex_lock(&ch->d.file.mut);
+	}
+
+	if(ch->d.file.uring != NULL && ch->d.file.used + lenline > ch->d.file.lenbuf) {
+		if(ch->d.file.used > 0)
+			r = file_uring_submit(ch);
+		if(lenline > ch->d.file.lenbuf) {
+			/* a large caller-provided buffer, or the ring broke */
+			if(__stdlog_uring_wait(ch->d.file.uring) != 0)
+				r = -1;
+			if(file_writev(ch, iov + 1, iovcnt - 1) != 0)
+				r = -1;
+			goto done;
+		}
+	}
+	if(ch->d.file.used + lenline > ch->d.file.lenbuf) {
+		iov[0].iov_base = ch->d.file.buf;
+		iov[0].iov_len = ch->d.file.used;
+		r = (ch->d.file.used == 0) ? file_writev(ch, iov + 1, iovcnt - 1)
+		                           : file_writev(ch, iov, iovcnt);
+		ch->d.file.used = 0;
+	} else {
+		for(i = 1 ; i < iovcnt ; ++i) {
+			memcpy(ch->d.file.buf + ch->d.file.used, iov[i].iov_base, iov[i].iov_len);
+			ch->d.file.used += iov[i].iov_len;
+		}
+		if(severity <= ch->d.file.flushsev)
+			r = file_flush_locked(ch);
+	}
+
+done:	pthread_mutex_unlock(&ch->d.file.mut);
+	return r;
+}
+
+/* Replaces the file behind the channel's descriptor with a freshly
+ * opened one of the configured name. dup2() does the switch atomically:
+ * writes in progress complete to the old file, all later ones go to the
+ * new one. So loggers keep writing during a reopen, need no lock and can
+ * never see a closed descriptor. Only async-signal-safe calls are used.
+ */
+static int
+file_reopen(stdlog_channel_t ch)
+{
+	struct stat st;
+	const int oldfd = __atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE);
+	int fd;
+	int r = -1;
+
+	if(oldfd < 0)
+		return 0; /* not yet opened, nothing to do */
+	if((fd = open(ch->d.file.name, O_WRONLY|O_CREAT|O_APPEND, 0660)) < 0)
+		goto done;
+	__atomic_store_n(&ch->d.file.written, (fstat(fd, &st) == 0) ? st.st_size : 0,
+	                 __ATOMIC_RELAXED);
+	if(dup2(fd, oldfd) != -1)
+		r = 0;
+	close(fd);
+done:	return r;
+}
+
+/* Returns the time the next periodic rotation is due. Periods of up to
+ * a day are aligned to local midnight, so that e.g. period=3600 rotates
+ * at the full hour; longer ones are simply counted from now.
+ */
+static time_t
+file_next_rotation(const int period, const time_t now)
+{
+	struct tm tm;
+	int sod;
+
+	if(period > 86400 || localtime_r(&now, &tm) == NULL)
+		return now + period;
+	sod = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+	return now + period - sod % period;
+}
+
+/* Rotates the file: name.keep-1 becomes name.keep, ..., name becomes
+ * name.1 and a new file is opened under the original name. Loggers keep
+ * writing to the renamed file until file_reopen() swaps in the new one.
+ * Called from the ticker thread only, so rotations never overlap.
+ */
+static int
+file_rotate(stdlog_channel_t ch)
+{
+	const size_t lenname = strlen(ch->d.file.name) + 8;
+	int i;
+
+	if(ch->d.file.buf != NULL)
+		file_flush(ch); /* keep buffered lines with their file */
+	for(i = ch->d.file.keep - 1 ; i > 0 ; --i) {
+		snprintf(ch->d.file.oldname, lenname, "%s.%d", ch->d.file.name, i);
+		snprintf(ch->d.file.newname, lenname, "%s.%d", ch->d.file.name, i + 1);
+		rename(ch->d.file.oldname, ch->d.file.newname);
+	}
+	snprintf(ch->d.file.newname, lenname, "%s.1", ch->d.file.name);
+	if(rename(ch->d.file.name, ch->d.file.newname) != 0 && errno != ENOENT)
+		return -1;
+	return file_reopen(ch);
+}
+
+/* ticker callback: rotates the file once it is due */
+static int
+file_rotate_check(stdlog_channel_t ch)
+{
+	const time_t now = time(NULL);
+	int due = 0;
+	int r = 0;
+
+	if(__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) < 0)
+		return 0;
+	if(ch->d.file.maxsize > 0 && __atomic_load_n(&ch->d.file.written,
+	   __ATOMIC_RELAXED) >= (uint64_t) ch->d.file.maxsize)
+		due = 1;
+	if(ch->d.file.period > 0 && now >= ch->d.file.nextrot) {
+		due = 1;
+		ch->d.file.nextrot = file_next_rotation(ch->d.file.period, now);
+	}
+	if(due)
+		r = file_rotate(ch);
+	return r;
+}
+
+static int
+file_init_rotation(stdlog_channel_t ch)
+{
+	int64_t keep;
+	int64_t period;
+	size_t lenname;
+
+	ch->d.file.maxsize = __stdlog_chanspec_param_int(ch->spec, "maxsize", 0);
+	period = __stdlog_chanspec_param_int(ch->spec, "period", 0);
+	if(ch->d.file.maxsize <= 0 && period <= 0) {
+		ch->d.file.maxsize = 0;
+		return 0;
+	}
+	if(ch->d.file.maxsize < 0)
+		ch->d.file.maxsize = 0;
+	ch->d.file.period = (period > 0 && period <= INT32_MAX) ? (int) period : 0;
+	keep = __stdlog_chanspec_param_int(ch->spec, "keep", FILE_DFLT_KEEP);
+	if(keep < 1)
+		keep = 1;
+	if(keep > FILE_MAX_KEEP)
+		keep = FILE_MAX_KEEP;
+	ch->d.file.keep = keep;
+	if(ch->d.file.period > 0)
+		ch->d.file.nextrot = file_next_rotation(ch->d.file.period, time(NULL));
+
+	lenname = strlen(ch->d.file.name) + 8; /* ".NNN" */
+	ch->d.file.oldname = malloc(lenname);
+	ch->d.file.newname = malloc(lenname);
+	if(ch->d.file.oldname == NULL || ch->d.file.newname == NULL) {
+		errno = ENOMEM;
+		goto fail;
+	}
+	if(__stdlog_ticker_register(ch, FILE_ROTATE_CHECKMS, file_rotate_check) != 0)
+		goto fail;
+	return 0;
+
+fail:
+	free(ch->d.file.oldname);
+	free(ch->d.file.newname);
+	ch->d.file.oldname = ch->d.file.newname = NULL;
+	ch->d.file.maxsize = ch->d.file.period = 0;
+	return -1;
+}
+
+static void
+file_free_rotation(stdlog_channel_t ch)
+{
+	if(ch->d.file.oldname == NULL)
+		return;
+	__stdlog_ticker_unregister(ch, file_rotate_check);
+	free(ch->d.file.oldname);
+	free(ch->d.file.newname);
+	ch->d.file.oldname = ch->d.file.newname = NULL;
+}
+
+/* frees the buffer(s) of a buffered channel, the caller must also
+ * take care of the mutex
+ */
 static void
+file_free_buf(stdlog_channel_t ch)
+{
+	if(ch->d.file.uring != NULL)
+		__stdlog_uring_free(ch->d.file.uring);
+	else
+		free(ch->d.file.buf);
+	ch->d.file.uring = NULL;
+	ch->d.file.buf = NULL;
+}
+
+static int
 file_init(stdlog_channel_t ch)
 {
+	const int uring = __stdlog_chanspec_param_is(ch->spec, "io", "uring");
+	int64_t lenbuf;
+	int64_t depth;
+	int flushms;
+
 	ch->d.file.fd = -1;
-	ch->d.file.name = strdup(ch->spec+5);
+	ch->d.file.kvstyle = __stdlog_chanspec_param_is(ch->spec, "fields", "json")
+		? __STDLOG_KV_JSON : __STDLOG_KV_LOGFMT;
+	if((ch->d.file.name = strdup(__stdlog_chanspec_arg(ch->spec))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	lenbuf = __stdlog_chanspec_param_int(ch->spec, "bufsize",
+	                                     uring ? FILE_DFLT_URING_BUFSIZE : 0);
+	if(lenbuf > 0) {
+		if(lenbuf > FILE_MAX_BUFSIZE)
+			lenbuf = FILE_MAX_BUFSIZE;
+		flushms = __stdlog_chanspec_param_int(ch->spec, "flushms", FILE_DFLT_FLUSHMS);
+		ch->d.file.flushsev = __stdlog_chanspec_param_sev(ch->spec, "flushsev", STDLOG_ERR);
+		if(uring) {
+			depth = __stdlog_chanspec_param_int(ch->spec, "depth", FILE_DFLT_URING_DEPTH);
+			if(depth < 2)
+				depth = 2;
+			if(depth > FILE_MAX_URING_DEPTH)
+				depth = FILE_MAX_URING_DEPTH;
+			/* if io_uring is not available, we use a plain buffer */
+			if((ch->d.file.uring = __stdlog_uring_new(depth, lenbuf, ch->stats)) != NULL)
+				ch->d.file.buf = __stdlog_uring_buf(ch->d.file.uring);
+		}
+		if(ch->d.file.buf == NULL && (ch->d.file.buf = malloc(lenbuf)) == NULL) {
+			errno = ENOMEM;
+			goto fail;
+		}
+		ch->d.file.lenbuf = lenbuf;
+		ch->d.file.used = 0;
+		pthread_mutex_init(&ch->d.file.mut, NULL);
+		if(flushms > 0 && __stdlog_ticker_register(ch, flushms, file_flush) != 0) {
+			pthread_mutex_destroy(&ch->d.file.mut);
+			goto fail;
+		}
+	}
+	if(file_init_rotation(ch) != 0) {
+		if(ch->d.file.buf != NULL) {
+			__stdlog_ticker_unregister(ch, file_flush);
+			pthread_mutex_destroy(&ch->d.file.mut);
+		}
+		goto fail;
+	}
+	return 0;
+
+fail:
+	file_free_buf(ch);
+	free(ch->d.file.name);
+	return -1;
 }
 
+/* Opens the file. Threads logging their first message at the same
+ * time may all get here; only one descriptor is installed, the others
+ * are closed again.
+ */
 static void
 file_open(stdlog_channel_t ch)
 {
-	if (ch->d.file.fd == -1) {
-		if((ch->d.file.fd = open(ch->d.file.name, O_WRONLY|O_CREAT|O_APPEND, 0660)) < 0)
-			return;
+	struct stat st;
+	int expected = -1;
+	int fd;
+
+	if (__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) != -1)
+		return;
+	if((fd = open(ch->d.file.name, O_WRONLY|O_CREAT|O_APPEND, 0660)) < 0)
+		return;
+	if(!__atomic_compare_exchange_n(&ch->d.file.fd, &expected, fd, 0,
+	                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		close(fd);
+		return;
 	}
+	if(ch->d.file.maxsize > 0 && fstat(fd, &st) == 0)
+		__atomic_store_n(&ch->d.file.written, st.st_size, __ATOMIC_RELAXED);
 }
 
 static void
 file_close(stdlog_channel_t ch)
 {
+	file_free_rotation(ch);
+	if (ch->d.file.buf != NULL) {
+		__stdlog_ticker_unregister(ch, file_flush);
+		file_flush(ch);
+		pthread_mutex_destroy(&ch->d.file.mut);
+		file_free_buf(ch);
+	}
 	if (ch->d.file.fd >= 0) {
 		close(ch->d.file.fd);
 		ch->d.file.fd = -1;
@@ -96,30 +493,65 @@ file_close(stdlog_channel_t ch)
 
 
 static int
-file_log(stdlog_channel_t ch, int __attribute__((unused)) severity,
+file_log(stdlog_channel_t ch, int severity,
 	const char *fmt, va_list ap,
 	char *__restrict__ const wrkbuf, const size_t buflen)
 {
-	ssize_t lenWritten;
+	struct iovec iov[2];
 	size_t lenline;
 	int r;
 
-	if(ch->d.file.fd < 0)
+	if(__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) < 0) {
 		file_open(ch);
-	if(ch->d.file.fd < 0) {
-		r = -1;
-		goto done;
+		if(__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) < 0) {
+			r = -1;
+			goto done;
+		}
 	}
-	lenline = build_file_line(ch, wrkbuf, buflen, fmt, ap);
-	lenWritten = write(ch->d.file.fd, wrkbuf, lenline);
-	if(lenWritten == -1) {
-		r = -1;
-	} else if(lenWritten != (ssize_t) lenline) {
-		r = -1;
-		errno = EAGAIN;
-	} else {
-		r = 0;
+	lenline = __stdlog_build_file_line(ch, wrkbuf, buflen, fmt, ap);
+	iov[1].iov_base = wrkbuf;
+	iov[1].iov_len = lenline;
+	if(ch->d.file.buf != NULL)
+		r = file_buffered_write(ch, severity, iov, 2, lenline);
+	else
+		r = file_writev(ch, iov + 1, 1);
+done:	return r;
+}
+
+/* Structured data fields are appended to the line, as " key=value"
+ * pairs or, with "fields=json", as a JSON object. The line is written
+ * as iovecs of line, fields and the final newline.
+ */
+static int
+file_log_kv(stdlog_channel_t ch, int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_kv_out kv;
+	struct iovec *iov;
+	size_t lenline;
+	int r;
+
+	if(__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) < 0) {
+		file_open(ch);
+		if(__atomic_load_n(&ch->d.file.fd, __ATOMIC_ACQUIRE) < 0) {
+			r = -1;
+			goto done;
+		}
 	}
+	lenline = __stdlog_build_file_line(ch, wrkbuf, buflen, fmt, ap) - 1;
+	__stdlog_kv_render(&kv, ch->d.file.kvstyle, NULL, fields, nfields);
+	iov = kv.iov + __STDLOG_KV_IOVHEAD - 2;
+	iov[1].iov_base = wrkbuf;
+	iov[1].iov_len = lenline;
+	iov[kv.niov + 2].iov_base = (char *) "\n";
+	iov[kv.niov + 2].iov_len = 1;
+	lenline += kv.len + 1;
+	if(ch->d.file.buf != NULL)
+		r = file_buffered_write(ch, severity, iov, kv.niov + 3, lenline);
+	else
+		r = file_writev(ch, iov + 1, kv.niov + 2);
 done:	return r;
 }
 
@@ -130,4 +562,7 @@ __stdlog_set_file_drvr(stdlog_channel_t ch)
 	ch->drvr.open = file_open;
 	ch->drvr.close = file_close;
 	ch->drvr.log = file_log;
+	ch->drvr.log_kv = file_log_kv;
+	ch->drvr.flush = file_flush;
+	ch->drvr.reopen = file_reopen;
 }
@@ -0,0 +1,274 @@
+/* fmtcheck: compares the output of the library's own formatter with
+ * vsnprintf() over a corpus of formats and edge values. Each entry is
+ * rendered via __stdlog_sigsafe_printf(), via __stdlog_fmt_argtypes()
+ * and __stdlog_fmt_render_args() (as the "deferred:" driver does) and,
+ * to check truncation, into buffers of every size up to its length.
+ * The corpus only uses what RESTRICTIONS IN SIGNAL-SAFE MODE in
+ * stdlog(3) promises. Run by "make check".
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include "stdlog-intern.h"
+
+#define CHECK_BUFSIZE 1024
+
+/* the formatter reports truncation here; normally part of stdlog.c */
+__thread int __stdlog_truncated __attribute__((tls_model("initial-exec"))) = 0;
+
+static int nchecks = 0;
+static int nfailed = 0;
+
+static void
+report(const int line, const char *const how, const char *const fmt,
+	const size_t lenbuf, const char *const expect, const char *const got)
+{
+	fprintf(stderr, "fmtcheck:%d: %s, format \"%s\", buffer %zu:\n"
+	        "\texpected \"%s\"\n\tgot      \"%s\"\n",
+	        line, how, fmt, lenbuf, expect, got);
+	++nfailed;
+}
+
+/* renders the arguments like the "deferred:" driver does, including
+ * copying the strings, which reads no more of them than the conversion
+ */
+static int
+render_deferred(char *const buf, const size_t lenbuf, const char *const fmt,
+	va_list ap)
+{
+	static char strs[32 * CHECK_BUFSIZE];
+	union __stdlog_fmt_arg args[32];
+	uint8_t types[32];
+	int precs[32];
+	size_t lenstr;
+	size_t off = 0;
+	int nargs;
+	int i;
+
+	if((nargs = __stdlog_fmt_argtypes(fmt, types, precs, 32)) < 0)
+		return -1;
+	for(i = 0 ; i < nargs ; ++i) {
+		__STDLOG_FMT_VA_ARG(ap, types[i], args[i]);
+		if(types[i] == __STDLOG_ARG_STR && args[i].s != NULL) {
+			lenstr = __stdlog_fmt_strarg_len(args, i, precs[i]);
+			if(lenstr >= CHECK_BUFSIZE)
+				lenstr = CHECK_BUFSIZE - 1;
+			memcpy(strs + off, args[i].s, lenstr);
+			strs[off + lenstr] = '\0';
+			args[i].s = strs + off;
+			off += CHECK_BUFSIZE;
+		}
+	}
+	return __stdlog_fmt_render_args(buf, lenbuf, fmt, args);
+}
+
+static void __attribute__((format(printf, 2, 3)))
+check_at(const int line, const char *const fmt, ...)
+{
+	char expect[CHECK_BUFSIZE];
+	char got[CHECK_BUFSIZE];
+	va_list ap;
+	va_list aq;
+	size_t len;
+	size_t lenbuf;
+
+	va_start(ap, fmt);
+	vsnprintf(expect, sizeof(expect), fmt, ap);
+	va_end(ap);
+	len = strlen(expect);
+
+	for(lenbuf = sizeof(expect) ; lenbuf > 0 ; lenbuf = (lenbuf > len + 1) ? len + 1 : lenbuf - 1) {
+		++nchecks;
+		memset(got, 'Z', sizeof(got));
+		va_start(ap, fmt);
+		va_copy(aq, ap); /* __stdlog_sigsafe_printf() va_end()s it */
+		__stdlog_sigsafe_printf(got, lenbuf, fmt, aq);
+		va_end(ap);
+		expect[lenbuf - 1 < len ? lenbuf - 1 : len] = '\0';
+		if(strcmp(got, expect) != 0)
+			report(line, "sigsafe", fmt, lenbuf, expect, got);
+
+		memset(got, 'Z', sizeof(got));
+		va_start(ap, fmt);
+		if(render_deferred(got, lenbuf, fmt, ap) < 0)
+			report(line, "deferred (no arg types)", fmt, lenbuf, expect, "");
+		else if(strcmp(got, expect) != 0)
+			report(line, "deferred", fmt, lenbuf, expect, got);
+		va_end(ap);
+	}
+}
+#define check(...) check_at(__LINE__, __VA_ARGS__)
+
+/* __stdlog_fmt_print_int() and _str(), as used for headers */
+static void
+check_print(const int line, const int64_t nbr, const char *const str)
+{
+	char expect[CHECK_BUFSIZE];
+	char got[CHECK_BUFSIZE];
+	int idx = 0;
+
+	++nchecks;
+	snprintf(expect, sizeof(expect), "%lld%s", (long long) nbr, str ? str : "(null)");
+	__stdlog_fmt_print_int(got, sizeof(got), &idx, nbr);
+	__stdlog_fmt_print_str(got, sizeof(got), &idx, str);
+	got[idx] = '\0';
+	if(strcmp(got, expect) != 0)
+		report(line, "print_int/print_str", "", sizeof(got), expect, got);
+}
+
+static void
+check_integers(void)
+{
+	check("%d %d %d %d", INT_MIN, INT_MAX, 0, -1);
+	check("%i %i", INT_MIN, 42);
+	check("%ld %ld", LONG_MIN, LONG_MAX);
+	check("%lld %lld", LLONG_MIN, LLONG_MAX);
+	check("%jd %jd", INTMAX_MIN, INTMAX_MAX);
+	check("%zd %zd", (ssize_t) -1, (ssize_t) SSIZE_MAX);
+	check("%hd %hd %hhd %hhd", 70000, -32768, 300, -128);
+	check("%u %u", 0u, UINT_MAX);
+	check("%lu %llu %ju %zu", ULONG_MAX, ULLONG_MAX, UINTMAX_MAX, SIZE_MAX);
+	check("%hu %hhu", 70000, 300);
+	check("%x %X %x %X", 0u, 0u, 0xdeadbeefu, 0xdeadbeefu);
+	check("%lx %llX", ULONG_MAX, ULLONG_MAX);
+	check("%#x %#X %#x %#llx", 0u, 255u, 1u, 0x8000000000000000ull);
+	check("%hx %hhX", 0x12345u, 0x1ffu);
+}
+
+static void
+check_width_prec(void)
+{
+	/* valid, but the compiler warns about them if it sees them */
+	const char *volatile flags_ignored = "[%+u] [% u] [%08.3d]";
+
+	check("[%5d] [%-5d] [%05d] [%5d]", 42, 42, -42, INT_MIN);
+	check("[%+d] [% d] [%+d] [% d] [%+5d] [%-+5d]", 5, 5, -5, -5, 5, 5);
+	check(flags_ignored, 5u, 5u, 7);
+	check("[%08x] [%-8X] [%#08x] [%#-8x]", 0xbeefu, 0xbeefu, 0xbeefu, 0xbeefu);
+	check("[%*d] [%-*d] [%*d]", 7, 42, 7, 42, -7, 42);
+	check("[%.*d] [%.*d]", 4, 42, -1, 42);
+	check("[%.0d] [%.0u] [%.0x] [%#.0x] [%+.0d] [% .0d] [%5.0d]", 0, 0u, 0u, 0u, 0, 0, 0);
+	check("[%.0d] [%.0x]", 7, 7u);
+	check("[%.5d] [%.5d] [%8.3d] [%-8.3d]", 42, -42, 7, 7);
+	check("[%.20lld] [%25lld]", LLONG_MIN, LLONG_MIN);
+	check("[%.3s] [%.0s] [%10.3s] [%-10s] [%10s]", "abcdef", "abc", "abcdef", "ab", "ab");
+	check("[%.*s] [%.*s] [%*s]", 2, "abcdef", -1, "abc", -4, "ab");
+	check("[%300d]", 1);
+}
+
+static void
+check_strings(void)
+{
+	static char nonul[5] = { 'a', 'b', 'c', 'd', 'e' };
+	static char big[600];
+	/* volatile, so that the compiler cannot see it is NULL */
+	const char *volatile nullstr = NULL;
+	const long pgsize = sysconf(_SC_PAGESIZE);
+	char *guarded = NULL;
+	char *pages;
+
+	pages = mmap(NULL, 2 * pgsize, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(pages != MAP_FAILED && mprotect(pages + pgsize, pgsize, PROT_NONE) == 0) {
+		guarded = pages + pgsize - 4;
+		memcpy(guarded, "wxyz", 4);
+	}
+	memset(big, 'y', sizeof(big) - 1);
+	check("%s", "");
+	check("%s|%s|%s", "a", "literal % text", "x");
+	check("%s", big);
+	check("%.5s", nonul);
+	check("%.*s", 5, nonul);
+	/* nothing may be read beyond the precision: the next page faults */
+	if(guarded != NULL) {
+		check("val=%.4s", guarded);
+		check("val=%.*s", 4, guarded);
+		check("[%6.*s] [%-*.*s]", 3, guarded, 6, 4, guarded);
+	}
+	check("[%s] [%10s] [%-10s]", nullstr, nullstr, nullstr);
+	check("[%.6s] [%.10s] [%.3s] [%5.2s]", nullstr, nullstr, nullstr, nullstr);
+	check("[%c] [%5c] [%-3c] [%c]", 'A', 'b', 'c', '%');
+	check("100%% %%d %s%%", "done");
+	check("no conversions at all");
+	/* backslashes are not tested: we interpret them as escapes */
+	check("tab\there, newline\nthere");
+	check("%s=%d, %s=%x, %s=%c", "a", -1, "b", 255u, "c", 'z');
+	if(pages != MAP_FAILED)
+		munmap(pages, 2 * pgsize);
+}
+
+static void
+check_pointers(void)
+{
+	int x;
+
+	check("%p %p", (void *) &x, (void *) check_strings);
+	check("[%20p] [%-20p]", (void *) &x, (void *) &x);
+	check("%p", (void *) 1);
+}
+
+static void
+check_doubles(void)
+{
+	check("%f %f %f %f", 0.0, -0.0, 1.5, -1.5);
+	check("%.0f %.0f %.0f %.0f %.0f", 0.5, 1.5, 2.5, -0.5, 0.49999999999999994);
+	check("%.2f %.2f %.1f %.3f", 0.125, 0.375, 0.05, 2.0005);
+	check("%.10f %.20f %.60f", 123.456, 0.1, 1.0 / 3.0);
+	check("%f %f", 1e20, 123456789012345678901234567890.0);
+	check("%f", DBL_MAX);
+	check("%.3f %f %.17f", 1e-300, DBL_MIN, DBL_EPSILON);
+	check("[%10.3f] [%-10.2f] [%010.2f] [%+f] [% f] [%+.0f]", 3.14159, 3.14159, -3.14159, 2.0, 2.0, 0.0);
+	check("[%*.*f] [%.*f]", 12, 4, 2.71828, -1, 2.71828);
+	check("%F %F", 1.25, -0.0);
+	check("%f %f %F %F", INFINITY, -INFINITY, INFINITY, -INFINITY);
+	check("[%8f] [%-8f] [%+f]", INFINITY, -INFINITY, INFINITY);
+}
+
+int
+main(void)
+{
+	check_integers();
+	check_width_prec();
+	check_strings();
+	check_pointers();
+	check_doubles();
+	check_print(__LINE__, INT64_MIN, "abc");
+	check_print(__LINE__, INT64_MAX, "");
+	check_print(__LINE__, 0, NULL);
+	check_print(__LINE__, -1, "x");
+	printf("fmtcheck: %d checks, %d failed\n", nchecks, nfailed);
+	return nfailed != 0;
+}
@@ -32,6 +32,9 @@
 #include <stdint.h>
 #include <syslog.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "stdlog-intern.h"
 
 /* do not return ptr to dest as an optimization -- should barely be needed! */
@@ -59,137 +62,773 @@ __stdlog_isdigit(const char c)
 {
 	return (c >= '0' && c <='9') ? 1 : 0;
 }
-/* hexbase must be 'a' for lower case hex string or 'A' for
- * upper case. Anything else is invalid.
+
+/* Bulk scanning of literal text.
+ *
+ * fmt_scan() returns a pointer to the first NUL in s, or, if fmtchars
+ * is set, the first NUL, '%' or '\\' -- but at most s + max. Bytes are
+ * examined 16 at a time with SSE2 where the compiler targets it, else
+ * a machine word at a time. Blocks are only loaded if they are aligned
+ * and lie entirely before s + max; the bytes up to the first aligned
+ * block and after the last one are examined one by one. So nothing
+ * beyond s + max is ever read, which matters for "%.*s" arguments that
+ * are not NUL-terminated. Within that range, a block may extend past
+ * the terminating NUL; being aligned, it never touches a page the
+ * string does not also touch, but sanitizers report such reads, so
+ * builds with AddressSanitizer or ThreadSanitizer scan byte by byte.
+ * This is plain computation, so it is fine in signal handlers.
  */
-void
-__stdlog_fmt_print_uint_hex (char *__restrict__ const buf, const size_t lenbuf,
-	int *idx, uint64_t nbr, const char hexbase)
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#	define FMT_SCAN_BYTEWISE
+#elif defined(__has_feature)
+#	if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#		define FMT_SCAN_BYTEWISE
+#	endif
+#endif
+
+#define FMT_IS_STOP(c, fmtchars) \
+	((c) == '\0' || ((fmtchars) && ((c) == '%' || (c) == '\\')))
+
+/* returns s + max, or the highest address if that would overflow */
+static inline const char *
+fmt_scan_end(const char *const s, const size_t max)
 {
-	size_t i;
-	int j;
-	int hexdigit;
-	char numbuf[17];
+	return (max < (size_t) -1 - (uintptr_t) s) ? s + max
+	       : (const char *) (uintptr_t) -1;
+}
+
+#if defined(__SSE2__) && !defined(FMT_SCAN_BYTEWISE)
+static inline const char *
+fmt_scan(const char *const s, const size_t max, const int fmtchars)
+{
+	const char *p = s;
+	const char *const end = fmt_scan_end(s, max);
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i pct = _mm_set1_epi8('%');
+	const __m128i bsl = _mm_set1_epi8('\\');
+	__m128i v;
+	__m128i hit;
+	unsigned mask;
 
-	if (nbr == 0) {
-		buf[(*idx)++] = '0';
-		goto done;
+	/* bytewise up to the first block boundary */
+	for( ; ((uintptr_t) p & 15) != 0 ; ++p)
+		if(p == end || FMT_IS_STOP(*p, fmtchars))
+			return p;
+	for( ; (size_t) (end - p) >= 16 ; p += 16) {
+		v = _mm_load_si128((const __m128i *) p);
+		hit = _mm_cmpeq_epi8(v, nul);
+		if(fmtchars)
+			hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(v, pct),
+			                                     _mm_cmpeq_epi8(v, bsl)));
+		if((mask = _mm_movemask_epi8(hit)) != 0)
+			return p + __builtin_ctz(mask);
 	}
-	j = 0;
-	while(nbr != 0) {
-		hexdigit = nbr % 16;
-		numbuf[j++] = (hexdigit < 10) ? hexdigit + '0'
-					      : hexdigit - 10 + hexbase;
-		nbr /= 16;
+	for( ; p != end ; ++p)
+		if(FMT_IS_STOP(*p, fmtchars))
+			break;
+	return p;
+}
+#elif !defined(FMT_SCAN_BYTEWISE)
+typedef uintptr_t __attribute__((__may_alias__)) fmt_word_t;
+#define FMT_ONES	((uintptr_t) -1 / 0xff)	/* 0x01 in each byte */
+#define FMT_HASZERO(w)	(((w) - FMT_ONES) & ~(w) & (FMT_ONES << 7))
+
+static inline const char *
+fmt_scan(const char *const s, const size_t max, const int fmtchars)
+{
+	const char *p = s;
+	const char *const end = fmt_scan_end(s, max);
+	uintptr_t w;
+
+	/* bytewise up to the first word boundary */
+	for( ; ((uintptr_t) p & (sizeof(w) - 1)) != 0 ; ++p)
+		if(p == end || FMT_IS_STOP(*p, fmtchars))
+			return p;
+	/* whole words while they contain nothing of interest */
+	for( ; (size_t) (end - p) >= sizeof(w) ; p += sizeof(w)) {
+		w = *(const fmt_word_t *) p;
+		if(FMT_HASZERO(w))
+			break;
+		if(fmtchars && (FMT_HASZERO(w ^ (FMT_ONES * '%'))
+		                || FMT_HASZERO(w ^ (FMT_ONES * '\\'))))
+			break;
 	}
-	for(i = *idx, --j; i < lenbuf && j >= 0 ; ++i, --j)
-		buf[i] = numbuf[j];
+	for( ; p != end ; ++p)
+		if(FMT_IS_STOP(*p, fmtchars))
+			break;
+	return p;
+}
+#else
+static inline const char *
+fmt_scan(const char *const s, const size_t max, const int fmtchars)
+{
+	const char *p = s;
+	const char *const end = fmt_scan_end(s, max);
 
-	*idx = i;
+	for( ; p != end ; ++p)
+		if(FMT_IS_STOP(*p, fmtchars))
+			break;
+	return p;
+}
+#endif
 
-done:	return;
+/* Appends the len bytes at str, as far as they fit. */
+static inline void
+fmt_put_mem(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const char *const str, size_t len)
+{
+	if(len > lenbuf - *idx)
+		len = lenbuf - *idx;
+	memcpy(buf + *idx, str, len);
+	*idx += len;
 }
 
-void
-__stdlog_fmt_print_uint (char *__restrict__ const buf, const size_t lenbuf,
-	int *idx, uint64_t nbr)
+/* Digit pair tables: numbers are converted two digits at a time. */
+static const char fmt_dec2[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+static const char fmt_hex2l[512] =
+	"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static const char fmt_hex2u[512] =
+	"000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+static const uint64_t fmt_pow10[20] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+	10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+	100000000000ull, 1000000000000ull, 10000000000000ull,
+	100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+	100000000000000000ull, 1000000000000000000ull,
+	10000000000000000000ull };
+
+/* number of decimal digits of n, at least 1 */
+static int
+fmt_ndigits10(const uint64_t n)
 {
-	size_t i;
-	int j;
-	char numbuf[21];
+	int nd;
+
+	if(n < 10)
+		return 1;
+	nd = ((64 - __builtin_clzll(n)) * 1233) >> 12;	/* ~ bits * log10(2) */
+	return nd + (n >= fmt_pow10[nd]);
+}
+
+/* number of hex digits of n, at least 1 */
+static int
+fmt_ndigits16(const uint64_t n)
+{
+	return (67 - __builtin_clzll(n | 1)) >> 2;
+}
 
-	if (nbr == 0) {
-		buf[(*idx)++] = '0';
-		goto done;
+/* writes the decimal digits of n backwards, ending just before end */
+static void
+fmt_utoa10(char *end, uint64_t n)
+{
+	unsigned r;
+
+	while(n >= 100) {
+		r = (n % 100) * 2;
+		n /= 100;
+		*--end = fmt_dec2[r + 1];
+		*--end = fmt_dec2[r];
+	}
+	if(n >= 10) {
+		*--end = fmt_dec2[n * 2 + 1];
+		*--end = fmt_dec2[n * 2];
+	} else {
+		*--end = '0' + n;
+	}
+}
+
+/* writes the hex digits of n backwards, ending just before end */
+static void
+fmt_utoa16(char *end, uint64_t n, const char *const hex2)
+{
+	unsigned r;
+
+	while(n >= 0x100) {
+		r = (n & 0xff) * 2;
+		n >>= 8;
+		*--end = hex2[r + 1];
+		*--end = hex2[r];
+	}
+	if(n >= 0x10) {
+		*--end = hex2[n * 2 + 1];
+		*--end = hex2[n * 2];
+	} else {
+		*--end = hex2[n * 2 + 1];
 	}
-	j = 0;
-	while(nbr != 0) {
-		numbuf[j++] = nbr % 10 + '0';
-		nbr /= 10;
+}
+
+/* Appends the nd digits of n, in decimal if hex2 is NULL, else in hex
+ * using the hex2 digit pair table. Digits are written directly into
+ * buf, except when they need to be truncated.
+ */
+static void
+fmt_put_digits(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const uint64_t n, const int nd,
+	const char *const hex2)
+{
+	char tmp[20];
+	char *const dst = (*idx + nd <= (int) lenbuf) ? buf + *idx : tmp;
+	int i;
+
+	if(hex2 == NULL)
+		fmt_utoa10(dst + nd, n);
+	else
+		fmt_utoa16(dst + nd, n, hex2);
+	if(dst == tmp) {
+		for(i = 0 ; i < nd && *idx < (int) lenbuf ; ++i)
+			buf[(*idx)++] = tmp[i];
+	} else {
+		*idx += nd;
 	}
-	for(i = *idx, --j; i < lenbuf && j >= 0 ; ++i, --j)
-		buf[i] = numbuf[j];
+}
+
+/* appends n copies of c */
+static void
+fmt_pad(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const char c, int n)
+{
+	int i = *idx;
 
+	while(n-- > 0 && i < (int) lenbuf)
+		buf[i++] = c;
 	*idx = i;
+}
+
+/* hexbase must be 'a' for lower case hex string or 'A' for
+ * upper case. Anything else is invalid.
+ */
+void
+__stdlog_fmt_print_uint_hex (char *__restrict__ const buf, const size_t lenbuf,
+	int *idx, uint64_t nbr, const char hexbase)
+{
+	fmt_put_digits(buf, lenbuf, idx, nbr, fmt_ndigits16(nbr),
+		(hexbase == 'a') ? fmt_hex2l : fmt_hex2u);
+}
 
-done:	return;
+void
+__stdlog_fmt_print_uint (char *__restrict__ const buf, const size_t lenbuf,
+	int *idx, uint64_t nbr)
+{
+	fmt_put_digits(buf, lenbuf, idx, nbr, fmt_ndigits10(nbr), NULL);
 }
 
 void
 __stdlog_fmt_print_int (char *__restrict__ const buf, const size_t lenbuf,
 	int *idx, int64_t nbr)
 {
-	if (nbr == 0) {
-		buf[(*idx)++] = '0';
-		goto done;
-	}
+	uint64_t u = (uint64_t) nbr;
+
 	if (nbr < 0) {
-		buf[(*idx)++] = '-';
-		nbr *= -1;
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, '-');
+		u = 0 - u;
 	}
-	__stdlog_fmt_print_uint(buf, lenbuf, idx, (uint64_t)nbr);
-done:	return;
+	fmt_put_digits(buf, lenbuf, idx, u, fmt_ndigits10(u), NULL);
 }
 
-/**
- * Format a double number as %.2f.
- * Base idea taken from x.org source ./os/utils.c
- */
 void
-__stdlog_fmt_print_double (char *__restrict__ const buf, const size_t lenbuf,
-	int *idx, double dbl)
+__stdlog_fmt_print_str (char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const char *const str)
+{
+	const char *const strornull = str ? str : "(null)";
+	const size_t room = lenbuf - *idx;
+
+	fmt_put_mem(buf, lenbuf, idx, strornull,
+		fmt_scan(strornull, room, 0) - strornull);
+}
+
+/* conversion flags */
+#define FMT_LEFT	0x01	/* '-': left-justify */
+#define FMT_PLUS	0x02	/* '+': always print sign */
+#define FMT_SPACE	0x04	/* ' ': space instead of '+' */
+#define FMT_ZERO	0x08	/* '0': pad with zeros */
+#define FMT_ALT		0x10	/* '#': "0x" prefix, always print '.' */
+
+#define FMT_FROM_ARG	(-2)	/* width/precision is given by argument */
+#define FMT_MAX_WIDTH	100000	/* larger widths/precisions are capped */
+
+struct fmt_spec {
+	int flags;
+	int width;	/* -1 if not given */
+	int prec;	/* -1 if not given */
+};
+
+static const struct fmt_spec fmt_nospec = { 0, -1, -1 };
+
+/* Appends an integer conversion: sign, prefix, precision zeros and the
+ * digits of mag, padded to the field width.
+ */
+static void
+fmt_put_integer(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const uint64_t mag, const char sign,
+	const char *const prefix, const char *const hex2,
+	const struct fmt_spec *const spec)
+{
+	int nd;
+	int nzeros;
+	int pad;
+
+	if(spec->width < 0 && spec->prec < 0 && prefix == NULL) {
+		/* plain "%d" and friends, by far the most common case */
+		if(sign != '\0')
+			__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, sign);
+		fmt_put_digits(buf, lenbuf, idx, mag, (hex2 == NULL)
+			? fmt_ndigits10(mag) : fmt_ndigits16(mag), hex2);
+		return;
+	}
+
+	if(mag == 0 && spec->prec == 0)
+		nd = 0;
+	else
+		nd = (hex2 == NULL) ? fmt_ndigits10(mag) : fmt_ndigits16(mag);
+	nzeros = (spec->prec > nd) ? spec->prec - nd : 0;
+	pad = spec->width - ((sign != '\0') + (prefix != NULL ? 2 : 0) + nzeros + nd);
+	if((spec->flags & (FMT_ZERO | FMT_LEFT)) == FMT_ZERO && spec->prec < 0 && pad > 0) {
+		nzeros += pad;
+		pad = 0;
+	}
+
+	if(!(spec->flags & FMT_LEFT))
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+	if(sign != '\0')
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, sign);
+	if(prefix != NULL)
+		__stdlog_fmt_print_str(buf, lenbuf, idx, prefix);
+	fmt_pad(buf, lenbuf, idx, '0', nzeros);
+	if(nd > 0)
+		fmt_put_digits(buf, lenbuf, idx, mag, nd, hex2);
+	if(spec->flags & FMT_LEFT)
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+}
+
+/* Appends str (of length len) padded to the field width. */
+static void
+fmt_put_field(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const char sign, const char *const str,
+	const int len, const struct fmt_spec *const spec)
+{
+	const int pad = spec->width - len - (sign != '\0');
+
+	if(!(spec->flags & FMT_LEFT))
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+	if(sign != '\0')
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, sign);
+	fmt_put_mem(buf, lenbuf, idx, str, len);
+	if(spec->flags & FMT_LEFT)
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+}
+
+static void
+fmt_put_str(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const char *str,
+	const struct fmt_spec *const spec)
+{
+	int len;
+
+	if(str == NULL)	/* glibc prints nothing if "(null)" does not fit */
+		str = (spec->prec < 0 || spec->prec >= 6) ? "(null)" : "";
+	if(spec->width <= 0 && spec->prec < 0) {
+		__stdlog_fmt_print_str(buf, lenbuf, idx, str);
+		return;
+	}
+	len = fmt_scan(str, (spec->prec < 0) ? (size_t) -1 : (size_t) spec->prec, 0) - str;
+	fmt_put_field(buf, lenbuf, idx, '\0', str, len, spec);
+}
+
+/* Fixed notation double conversion.
+ *
+ * The conversion is exact: a double is m * 2^e with integer m, so its
+ * integer part and fraction can be converted without any floating
+ * point arithmetic. Fractions of up to 60 bits are expanded in a
+ * uint64_t, up to 124 bits in an unsigned __int128 where the compiler
+ * has one, longer ones (and integer parts beyond 64 bits) with
+ * multi-word arithmetic on the stack. Rounding is to nearest, ties to
+ * even, like glibc does in the default rounding mode. Only the first
+ * FMT_DBL_MAXPREC fractional digits are computed; if a higher
+ * precision is requested, the remaining digits are zeros.
+ */
+#define FMT_DBL_MAXPREC	 128
+#define FMT_DBL_MAXINT	 320	/* DBL_MAX has 309 integer digits */
+#define FMT_DBL_MAXDIGS	 (1 + FMT_DBL_MAXINT + FMT_DBL_MAXPREC)
+#define FMT_BIGWORDS	 36	/* 32-bit words, enough for 2^1075 */
+
+/* Converts an integer of up to 1024 bits, given as nw little-endian
+ * 32-bit words in w (which are destroyed), to decimal. The digits are
+ * written backwards, ending just before end. Returns their count.
+ */
+static int
+fmt_bigtoa10(char *end, uint32_t *const w, int nw)
 {
-	uint64_t frac;
+	uint64_t cur;
+	uint32_t rem;
+	int nd = 0;
+	int i;
 
-	frac = (dbl > 0 ? dbl : -dbl) * 100.0 + 0.5;
-	frac %= 100;
+	while(nw > 0 && w[nw - 1] == 0)
+		--nw;
+	while(nw > 0) {
+		rem = 0;
+		for(i = nw - 1 ; i >= 0 ; --i) {
+			cur = ((uint64_t) rem << 32) | w[i];
+			w[i] = cur / 1000000000u;
+			rem = cur % 1000000000u;
+		}
+		while(nw > 0 && w[nw - 1] == 0)
+			--nw;
+		for(i = 0 ; i < 9 && (nw > 0 || rem != 0) ; ++i) {
+			*--end = '0' + rem % 10;
+			rem /= 10;
+			++nd;
+		}
+	}
+	return nd;
+}
+
+/* Converts the finite, non-negative double to fixed notation with prec
+ * (at most FMT_DBL_MAXPREC) fractional digits. Digits, without decimal
+ * point, go to digs, which must have room for FMT_DBL_MAXDIGS. Returns
+ * the total number of digits; *nint is set to the integer digit count.
+ */
+static int
+fmt_dtoa_fixed(const double d, const int prec, char *const digs, int *const nint)
+{
+	union { double d; uint64_t u; } v;
+	uint32_t w[FMT_BIGWORDS];
+	uint64_t m;
+	uint64_t f = 0;
+	uint64_t t;
+	uint32_t carry;
+	int e;
+	int k = 0;	/* fraction bits */
+	int sh;
+	int nw;
+	int lo;
+	int cmp;	/* remainder vs 1/2: <0, 0, >0 */
+	int n;
+	int i;
+	int j;
+
+	v.d = d;
+	e = (v.u >> 52) & 0x7ff;
+	m = v.u & ((1ull << 52) - 1);
+	if(e == 0) {
+		e = -1074;
+	} else {
+		m |= 1ull << 52;
+		e -= 1075;
+	}
+
+	/* integer part; digs[0] is reserved for a rounding carry */
+	if(e >= 0 && e <= 11) {
+		n = fmt_ndigits10(m << e);
+		fmt_utoa10(digs + 1 + n, m << e);
+	} else if(e > 11) {
+		for(i = 0 ; i < FMT_BIGWORDS ; ++i)
+			w[i] = 0;
+		t = m << (e % 32);
+		w[e / 32] = (uint32_t) t;
+		w[e / 32 + 1] = (uint32_t) (t >> 32);
+		w[e / 32 + 2] = (e % 32) ? (uint32_t) (m >> (64 - e % 32)) : 0;
+		n = fmt_bigtoa10(digs + 1 + FMT_DBL_MAXINT, w, e / 32 + 3);
+		for(i = 0 ; i < n ; ++i)
+			digs[1 + i] = digs[1 + FMT_DBL_MAXINT - n + i];
+	} else {
+		k = -e;
+		t = (k < 64) ? m >> k : 0;
+		n = fmt_ndigits10(t);
+		fmt_utoa10(digs + 1 + n, t);
+		f = (k < 64) ? m & ((1ull << k) - 1) : m;
+	}
+	*nint = n;
+	++n;
+
+	/* fraction */
+	if(k == 0) {
+		for(i = 0 ; i < prec ; ++i)
+			digs[n++] = '0';
+		cmp = -1;
+	} else if(k <= 60) {
+		for(i = 0 ; i < prec ; ++i) {
+			f *= 10;
+			digs[n++] = '0' + (f >> k);
+			f &= (1ull << k) - 1;
+		}
+		cmp = (f > (1ull << (k - 1))) - (f < (1ull << (k - 1)));
+#ifdef __SIZEOF_INT128__
+	} else if(k <= 124) {
+		unsigned __int128 g = f;
+		const unsigned __int128 one = (unsigned __int128) 1 << k;
 
-	/* write decimal part to string */
-	__stdlog_fmt_print_int(buf, lenbuf, idx, (int64_t)dbl);
+		for(i = 0 ; i < prec ; ++i) {
+			g *= 10;
+			digs[n++] = '0' + (int) (g >> k);
+			g &= one - 1;
+		}
+		cmp = (g > one / 2) - (g < one / 2);
+#endif
+	} else {
+		/* scale so that the binary point is at a word boundary */
+		nw = (k + 31) / 32;
+		for(i = 0 ; i < nw ; ++i)
+			w[i] = 0;
+		sh = 32 * nw - k;
+		t = f << sh;
+		w[0] = (uint32_t) t;
+		w[1] = (uint32_t) (t >> 32);
+		if(nw > 2 && sh > 0)
+			w[2] = (uint32_t) (f >> (64 - sh));
+		lo = 0;
+		for(i = 0 ; i < prec ; ++i) {
+			while(lo < nw && w[lo] == 0)
+				++lo;
+			carry = 0;
+			for(j = lo ; j < nw ; ++j) {
+				t = (uint64_t) w[j] * 10 + carry;
+				w[j] = (uint32_t) t;
+				carry = t >> 32;
+			}
+			digs[n++] = '0' + carry;
+		}
+		cmp = (w[nw - 1] > 0x80000000u) - (w[nw - 1] < 0x80000000u);
+		if(cmp == 0)
+			for(i = 0 ; i < nw - 1 ; ++i)
+				if(w[i] != 0)
+					cmp = 1;
+	}
 
-	/* append fractional part, but only if there is space */
-	if (*idx < (int)lenbuf) {
-		buf[(*idx)++] = '.';
-		/* TODO: change _print_int to support min size! */
-		if (frac < 10) { /* work.around for missing _print_int feature! */
-			if(*idx < (int)lenbuf)
-				buf[(*idx)++] = '0';
+	/* round to nearest, ties to even */
+	if(cmp > 0 || (cmp == 0 && (digs[n - 1] - '0') % 2 == 1)) {
+		for(i = n - 1 ; i >= 1 && digs[i] == '9' ; --i)
+			digs[i] = '0';
+		if(i >= 1) {
+			++digs[i];
+		} else {
+			digs[0] = '1';
+			++*nint;
+			return n;	/* digits now start at digs[0] */
 		}
-	__stdlog_fmt_print_int(buf, lenbuf, idx, frac);
 	}
+	for(i = 0 ; i < n - 1 ; ++i)
+		digs[i] = digs[i + 1];
+	return n - 1;
 }
 
+static void
+fmt_put_double(char *__restrict__ const buf, const size_t lenbuf,
+	int *__restrict__ const idx, const double d, const int upper,
+	const struct fmt_spec *const spec)
+{
+	union { double d; uint64_t u; } v;
+	char digs[FMT_DBL_MAXDIGS];
+	const int prec = (spec->prec < 0) ? 6 : spec->prec;
+	const int dprec = (prec > FMT_DBL_MAXPREC) ? FMT_DBL_MAXPREC : prec;
+	int nint;
+	int point;
+	int pad;
+	char sign;
+
+	v.d = d;
+	sign = (v.u >> 63) ? '-' : (spec->flags & FMT_PLUS) ? '+'
+	     : (spec->flags & FMT_SPACE) ? ' ' : '\0';
+	if(((v.u >> 52) & 0x7ff) == 0x7ff) {
+		fmt_put_field(buf, lenbuf, idx, sign,
+			(v.u & ((1ull << 52) - 1)) ? (upper ? "NAN" : "nan")
+			                           : (upper ? "INF" : "inf"),
+			3, spec);
+		return;
+	}
 
-void
-__stdlog_fmt_print_str (char *__restrict__ const buf, const size_t lenbuf,
-	int *__restrict__ const idx, const char *const str)
+	v.u &= ~(1ull << 63);
+	fmt_dtoa_fixed(v.d, dprec, digs, &nint);
+	point = (prec > 0 || (spec->flags & FMT_ALT));
+	pad = spec->width - ((sign != '\0') + nint + point + prec);
+
+	if(!(spec->flags & (FMT_LEFT | FMT_ZERO)))
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+	if(sign != '\0')
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, sign);
+	if((spec->flags & (FMT_LEFT | FMT_ZERO)) == FMT_ZERO)
+		fmt_pad(buf, lenbuf, idx, '0', pad);
+	fmt_put_field(buf, lenbuf, idx, '\0', digs, nint, &fmt_nospec);
+	if(point)
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, '.');
+	fmt_put_field(buf, lenbuf, idx, '\0', digs + nint, dprec, &fmt_nospec);
+	fmt_pad(buf, lenbuf, idx, '0', prec - dprec);
+	if(spec->flags & FMT_LEFT)
+		fmt_pad(buf, lenbuf, idx, ' ', pad);
+}
+
+enum fmt_lmod {LMOD_NONE, LMOD_LONG, LMOD_LONG_LONG,
+	LMOD_SIZE_T, LMOD_SHORT, LMOD_CHAR, LMOD_INTMAX_T};
+
+/* parses a decimal number, capped at FMT_MAX_WIDTH */
+static const char *
+fmt_parse_num(const char *fmt, int *const n)
 {
-	const char *const strornull = str ? str : "(null)";
-	int i = *idx;
-	int j = 0;
+	for(*n = 0 ; __stdlog_isdigit(*fmt) ; ++fmt)
+		if(*n < FMT_MAX_WIDTH)
+			*n = *n * 10 + *fmt - '0';
+	if(*n > FMT_MAX_WIDTH)
+		*n = FMT_MAX_WIDTH;
+	return fmt;
+}
 
-	while(i < (int) lenbuf && strornull[j])
-		buf[i++] = strornull[j++];
-	*idx = i;
+/* Parses a conversion specification. fmt must point to the char
+ * immediately following the '%'. Returns a pointer to the conversion
+ * character (which may be '\0' for an incomplete specification).
+ * Width and precision given as '*' are set to FMT_FROM_ARG.
+ */
+static const char *
+fmt_parse_conv(const char *fmt, struct fmt_spec *const spec,
+	enum fmt_lmod *const lmod)
+{
+	/* flags */
+	spec->flags = 0;
+	for( ; ; ++fmt) {
+		switch(*fmt) {
+		case '-': spec->flags |= FMT_LEFT; continue;
+		case '+': spec->flags |= FMT_PLUS; continue;
+		case ' ': spec->flags |= FMT_SPACE; continue;
+		case '0': spec->flags |= FMT_ZERO; continue;
+		case '#': spec->flags |= FMT_ALT; continue;
+		default: break;
+		}
+		break;
+	}
+
+	/* width */
+	spec->width = -1;
+	if(*fmt == '*') {
+		spec->width = FMT_FROM_ARG;
+		++fmt;
+	} else if(__stdlog_isdigit(*fmt)) {
+		fmt = fmt_parse_num(fmt, &spec->width);
+	}
+
+	/* precision */
+	spec->prec = -1;
+	if(*fmt == '.') {
+		if(*++fmt == '*') {
+			spec->prec = FMT_FROM_ARG;
+			++fmt;
+		} else {
+			fmt = fmt_parse_num(fmt, &spec->prec);
+		}
+	}
+
+	/* length modifiers */
+	*lmod = LMOD_NONE;
+	switch(*fmt) {
+	case 'l':
+		++fmt;
+		if (*fmt == 'l') {
+			++fmt;
+			*lmod = LMOD_LONG_LONG;
+		} else {
+			*lmod = LMOD_LONG;
+		}
+		break;
+	case 'h':
+		++fmt;
+		if (*fmt == 'h') {
+			++fmt;
+			*lmod = LMOD_CHAR;
+		} else {
+			*lmod = LMOD_SHORT;
+		}
+		break;
+	case 'j':
+		++fmt;
+		*lmod = LMOD_INTMAX_T;
+		break;
+	case 'z':
+		++fmt;
+		*lmod = LMOD_SIZE_T;
+		break;
+	default:break; /* no modifier, nothing to do */
+	}
+	return fmt;
+}
+
+/* returns the __STDLOG_ARG_* type of the argument a conversion consumes */
+static int
+fmt_argtype(const char conv, const enum fmt_lmod lmod)
+{
+	switch(conv) {
+	case 's':
+		return __STDLOG_ARG_STR;
+	case 'i':
+	case 'd':
+		switch(lmod) {
+		case LMOD_LONG_LONG:	return __STDLOG_ARG_LLONG;
+		case LMOD_LONG:		return __STDLOG_ARG_LONG;
+		case LMOD_SIZE_T:	return __STDLOG_ARG_SSIZE;
+		case LMOD_INTMAX_T:	return __STDLOG_ARG_INTMAX;
+		default:		return __STDLOG_ARG_INT;
+		}
+	case 'u':
+	case 'x':
+	case 'X':
+		switch(lmod) {
+		case LMOD_LONG_LONG:	return __STDLOG_ARG_ULLONG;
+		case LMOD_LONG:		return __STDLOG_ARG_ULONG;
+		case LMOD_SIZE_T:	return __STDLOG_ARG_SIZE;
+		case LMOD_INTMAX_T:	return __STDLOG_ARG_UINTMAX;
+		default:		return __STDLOG_ARG_UINT;
+		}
+	case 'p':
+		return __STDLOG_ARG_PTR;
+	case 'f':
+	case 'F':
+		return __STDLOG_ARG_DOUBLE;
+	case 'c':
+		return __STDLOG_ARG_INT;
+	default:
+		return __STDLOG_ARG_NONE;
+	}
 }
 
+/* fetches the next argument, from args if it is non-NULL, else from ap */
+#define FMT_NEXT_ARG(type, arg) \
+	if(args != NULL) { \
+		arg = *args++; \
+	} else { \
+		__STDLOG_FMT_VA_ARG(*ap, type, arg); \
+	}
+
 /* This is a big monolythic function to save us hassle with the
  * va_list macros (and do not loose performance solving that
- * hassle...).
+ * hassle...). Arguments are taken from args if it is non-NULL,
+ * otherwise from ap.
  */
-int
-__stdlog_sigsafe_printf(char *buf, size_t lenbuf, const char *fmt, va_list ap)
+static int
+fmt_render(char *buf, size_t lenbuf, const char *fmt, va_list *ap,
+	const union __stdlog_fmt_arg *args)
 {
-	char *s;
-	int64_t d;
-	uint64_t u;
-	int fwidth;
-	int precision;
+	union __stdlog_fmt_arg arg;
+	struct fmt_spec spec;
+	const char *lit;
+	int type;
 	int i = 0;
-	double dbl;
-	enum {LMOD_NONE, LMOD_LONG, LMOD_LONG_LONG,
-	      LMOD_SIZE_T, LMOD_SHORT, LMOD_CHAR,
-	      LMOD_INTMAX_T} length_modifier;
+	char sign;
+	enum fmt_lmod length_modifier;
 
 	--lenbuf; /* reserve for terminal \0 */
 	while(*fmt && i < (int) lenbuf) {
@@ -219,113 +858,79 @@ __stdlog_sigsafe_printf(char *buf, size_t lenbuf, const char *fmt, va_list ap)
 			break;
 		case '%':
 			if(*++fmt == '\0') goto done;
+			fmt = fmt_parse_conv(fmt, &spec, &length_modifier);
+			if(*fmt == '\0') goto done;
 
-			/* width */
-			/* currently only read, but not processed.
-			 * TODO: actually use fwidth and precision?
-			 */
-			fwidth = precision = -1;
-			if(__stdlog_isdigit(*fmt)) {
-				fwidth = 0;
-				for(; __stdlog_isdigit(*fmt) ; ++fmt)
-					fwidth = fwidth * 10 + *fmt - '0';
-				if(*fmt == '.') {
-					precision = 0;
-					for(++fmt ; __stdlog_isdigit(*fmt) ; ++fmt)
-						precision = precision * 10 + *fmt - '0';
+			if(spec.width == FMT_FROM_ARG) {
+				FMT_NEXT_ARG(__STDLOG_ARG_INT, arg);
+				if(arg.d < 0) {
+					spec.flags |= FMT_LEFT;
+					arg.d = -arg.d;
 				}
+				spec.width = (arg.d > FMT_MAX_WIDTH) ? FMT_MAX_WIDTH : (int) arg.d;
 			}
-		
-			/* length modifiers */
-			length_modifier = LMOD_NONE;
-			switch(*fmt) {
-			case '\0':
-				goto done;
-			case 'l':
-				++fmt;
-				if (*fmt == 'l') {
-					++fmt;
-					length_modifier = LMOD_LONG_LONG;
-				} else {
-					length_modifier = LMOD_LONG;
-				}
-				break;
-			case 'h':
-				++fmt;
-				if (*fmt == 'h') {
-					++fmt;
-					length_modifier = LMOD_CHAR;
-				} else {
-					length_modifier = LMOD_SHORT;
-				}
-				break;
-			case 'j':
-				++fmt;
-				length_modifier = LMOD_INTMAX_T;
-				break;
-			case 'z':
-				++fmt;
-				length_modifier = LMOD_SIZE_T;
-				break;
-			default:break; /* no modifier, nothing to do */
+			if(spec.prec == FMT_FROM_ARG) {
+				FMT_NEXT_ARG(__STDLOG_ARG_INT, arg);
+				spec.prec = (arg.d < 0) ? -1
+				          : (arg.d > FMT_MAX_WIDTH) ? FMT_MAX_WIDTH : (int) arg.d;
+			}
+			type = fmt_argtype(*fmt, length_modifier);
+			arg.u = 0;
+			if(type != __STDLOG_ARG_NONE) {
+				FMT_NEXT_ARG(type, arg);
 			}
 
 			/* conversions */
 			switch(*fmt) {
-			case '\0':
-				goto done;
 			case 's':
-				s = va_arg(ap, char *);
-				__stdlog_fmt_print_str(buf, lenbuf, &i, s);
+				fmt_put_str(buf, lenbuf, &i, arg.s, &spec);
 				break;
 			case 'i':
 			case 'd':
-				if (length_modifier == LMOD_LONG_LONG)
-					d = va_arg(ap, long long);
-				else if (length_modifier == LMOD_LONG)
-					d = va_arg(ap, long);
-				else if (length_modifier == LMOD_SIZE_T)
-					d = va_arg(ap, ssize_t);
-				else if (length_modifier == LMOD_INTMAX_T)
-					d = va_arg(ap, intmax_t);
-				else
-					d = va_arg(ap, int);
-				__stdlog_fmt_print_int(buf, lenbuf, &i, d); 
+				if(length_modifier == LMOD_SHORT)
+					arg.d = (short) arg.d;
+				else if(length_modifier == LMOD_CHAR)
+					arg.d = (signed char) arg.d;
+				sign = (arg.d < 0) ? '-' : (spec.flags & FMT_PLUS) ? '+'
+				     : (spec.flags & FMT_SPACE) ? ' ' : '\0';
+				fmt_put_integer(buf, lenbuf, &i,
+					(arg.d < 0) ? 0 - arg.u : arg.u, sign,
+					NULL, NULL, &spec);
 				break;
 			case 'u':
 			case 'x':
 			case 'X':
-				if (length_modifier == LMOD_LONG_LONG)
-					u = va_arg(ap, unsigned long long);
-				else if (length_modifier == LMOD_LONG)
-					u = va_arg(ap, unsigned long);
-				else if (length_modifier == LMOD_SIZE_T)
-					u = va_arg(ap, size_t);
-				else if (length_modifier == LMOD_INTMAX_T)
-					u = va_arg(ap, uintmax_t);
-				else
-					u = va_arg(ap, unsigned);
+				if(length_modifier == LMOD_SHORT)
+					arg.u = (unsigned short) arg.u;
+				else if(length_modifier == LMOD_CHAR)
+					arg.u = (unsigned char) arg.u;
 				if(*fmt == 'u')
-					__stdlog_fmt_print_uint(buf, lenbuf, &i, u); 
+					fmt_put_integer(buf, lenbuf, &i, arg.u, '\0',
+						NULL, NULL, &spec);
 				else
-					__stdlog_fmt_print_uint_hex(buf, lenbuf, &i,
-						u, *fmt == 'x'? 'a' : 'A'); 
+					fmt_put_integer(buf, lenbuf, &i, arg.u, '\0',
+						((spec.flags & FMT_ALT) && arg.u != 0)
+						  ? ((*fmt == 'x') ? "0x" : "0X") : NULL,
+						(*fmt == 'x') ? fmt_hex2l : fmt_hex2u,
+						&spec);
 				break;
 			case 'p':
-				u = (uintptr_t) va_arg(ap, void *);
-				if (u == 0) {
-					__stdlog_fmt_print_str(buf, lenbuf, &i, "(null)");
+				if (arg.u == 0) {
+					spec.prec = -1;
+					fmt_put_str(buf, lenbuf, &i, "(null)", &spec);
 				} else {
-					__stdlog_fmt_print_str(buf, lenbuf, &i, "0x");
-					__stdlog_fmt_print_uint_hex(buf, lenbuf, &i, u, 'a'); 
+					fmt_put_integer(buf, lenbuf, &i, arg.u, '\0',
+						"0x", fmt_hex2l, &spec);
 				}
 				break;
 			case 'f':
-				dbl = va_arg(ap, double);
-				__stdlog_fmt_print_double(buf, lenbuf, &i, dbl); 
+			case 'F':
+				fmt_put_double(buf, lenbuf, &i, arg.dbl, *fmt == 'F', &spec);
 				break;
 			case 'c':
-				buf[i++] = (char) va_arg(ap, int);
+				spec.prec = -1;
+				fmt_put_field(buf, lenbuf, &i, '\0', (char[1]){(char) arg.d},
+					1, &spec);
 				break;
 			case '%':
 				buf[i++] = '%';
@@ -336,17 +941,113 @@ __stdlog_sigsafe_printf(char *buf, size_t lenbuf, const char *fmt, va_list ap)
 			}
 			break;
 		default:
-			buf[i++] = *fmt;
+			/* copy the whole run of literal text at once */
+			lit = fmt_scan(fmt, lenbuf - i, 1);
+			fmt_put_mem(buf, lenbuf, &i, fmt, lit - fmt);
+			fmt = lit - 1;
 			break;
 		}
 		++fmt;
 	}
 done:
 	buf[i] = '\0'; /* we reserved space for this! */
+	if(i >= (int) lenbuf)
+		__stdlog_truncated = 1; /* or an exact fit, we cannot tell */
+	return i;
+}
+
+int
+__stdlog_sigsafe_printf(char *buf, size_t lenbuf, const char *fmt, va_list ap)
+{
+	va_list aq;
+	int i;
+
+	va_copy(aq, ap);
+	i = fmt_render(buf, lenbuf, fmt, &aq, NULL);
+	va_end(aq);
 	va_end(ap);
 	return i;
 }
 
+/* Same as __stdlog_sigsafe_printf(), but takes the arguments from an
+ * array, as filled by __stdlog_fmt_argtypes() users. String arguments
+ * must stay valid during the call.
+ */
+int
+__stdlog_fmt_render_args(char *buf, size_t lenbuf, const char *fmt,
+	const union __stdlog_fmt_arg *args)
+{
+	return fmt_render(buf, lenbuf, fmt, NULL, args);
+}
+
+/* Stores the types of the arguments fmt consumes, in order, in types.
+ * For each argument, precs receives the precision of its conversion if
+ * it is a string, __STDLOG_PREC_NONE otherwise, so that the string can
+ * be copied without reading beyond what the conversion reads.
+ * Returns the number of arguments or -1 if there are more than
+ * maxtypes of them.
+ */
+int
+__stdlog_fmt_argtypes(const char *fmt, uint8_t *const types, int *const precs,
+	const int maxtypes)
+{
+	struct fmt_spec spec;
+	enum fmt_lmod lmod;
+	int type;
+	int n = 0;
+
+	while(*fmt) {
+		if(*fmt == '\\') {
+			if(*++fmt == '\0')
+				break;
+		} else if(*fmt == '%') {
+			if(*++fmt == '\0')
+				break;
+			fmt = fmt_parse_conv(fmt, &spec, &lmod);
+			if(*fmt == '\0')
+				break;
+			type = fmt_argtype(*fmt, lmod);
+			if(  n + (spec.width == FMT_FROM_ARG) + (spec.prec == FMT_FROM_ARG)
+			   + (type != __STDLOG_ARG_NONE) > maxtypes)
+				return -1;
+			if(spec.width == FMT_FROM_ARG) {
+				precs[n] = __STDLOG_PREC_NONE;
+				types[n++] = __STDLOG_ARG_INT;
+			}
+			if(spec.prec == FMT_FROM_ARG) {
+				precs[n] = __STDLOG_PREC_NONE;
+				types[n++] = __STDLOG_ARG_INT;
+			}
+			if(type != __STDLOG_ARG_NONE) {
+				if(type != __STDLOG_ARG_STR || spec.prec == -1)
+					precs[n] = __STDLOG_PREC_NONE;
+				else if(spec.prec == FMT_FROM_ARG)
+					precs[n] = __STDLOG_PREC_FROM_ARG;
+				else
+					precs[n] = spec.prec;
+				types[n++] = type;
+			}
+		}
+		++fmt;
+	}
+	return n;
+}
+
+/* Returns the length of string argument i, but at most the precision
+ * prec stored for it by __stdlog_fmt_argtypes(). Like the conversion,
+ * it reads no more than that, so the string need not be NUL-terminated.
+ */
+size_t
+__stdlog_fmt_strarg_len(const union __stdlog_fmt_arg *const args, const int i,
+	const int prec)
+{
+	int p = prec;
+
+	if(prec == __STDLOG_PREC_FROM_ARG) /* a negative value counts as none */
+		p = (args[i - 1].d < 0) ? __STDLOG_PREC_NONE : (int) args[i - 1].d;
+	return fmt_scan(args[i].s, (p < 0) ? (size_t) -1 : (size_t) p, 0) - args[i].s;
+}
+
 /* wrapper for standard vsnprintf() as we need to return it the number of
  * bytes actually written (minus the NUL char) - even in overlow case!
  */
@@ -356,7 +1057,9 @@ __stdlog_wrapper_vsnprintf(char *buf, size_t lenbuf, const char *fmt, va_list ap
 	int len;
 
 	len = vsnprintf(buf, lenbuf, fmt, ap);
-	if (len >= (int)lenbuf)
-		len = (int) lenbuf;
+	if (len >= (int)lenbuf) {
+		len = (lenbuf == 0) ? 0 : (int) lenbuf - 1;
+		__stdlog_truncated = 1;
+	}
 	return len;
 }
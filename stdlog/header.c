@@ -0,0 +1,228 @@
+/* Pre-rendered message header pieces for the syslog-style drivers.
+ *
+ * The "<PRI>" part for each severity and the tag (ident, optional
+ * "[pid]" and ": ") do not change during a channel's lifetime, so
+ * they are rendered once at stdlog_open() and just copied when a
+ * message is built. The only exception is the PID, which changes in
+ * a forked child. So we track our PID via a pthread_atfork() child
+ * handler and re-render the tag if it does not match.
+ *
+ * The tag is double-buffered: the refresh renders into the buffer not
+ * currently published and then swaps the pointer, so concurrent
+ * readers always see a consistent tag. A reader which finds a stale
+ * tag and cannot refresh it right now (someone else is doing so)
+ * renders the tag directly into its message, as before.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+
+struct __stdlog_tag {
+	pid_t pid;	/* PID the tag was rendered for */
+	int len;
+	char txt[];
+};
+
+static pid_t cur_pid;
+static pthread_once_t pid_once = PTHREAD_ONCE_INIT;
+
+static void
+hdr_atfork_child(void)
+{
+	cur_pid = getpid();
+}
+
+static void
+hdr_pid_init(void)
+{
+	cur_pid = getpid();
+	pthread_atfork(NULL, NULL, hdr_atfork_child);
+}
+
+/* renders the tag into buffer tag, which must be large enough */
+static void
+hdr_render_tag(stdlog_channel_t ch, struct __stdlog_tag *const tag,
+	const pid_t pid)
+{
+	const int lenbuf = ch->hdr.lentagbuf;
+	int i = 0;
+
+	__stdlog_fmt_print_str(tag->txt, lenbuf, &i, ch->ident);
+	if (ch->options & STDLOG_PID) {
+		__STDLOG_STRBUILD_ADD_CHAR(tag->txt, lenbuf, i, '[');
+		__stdlog_fmt_print_int(tag->txt, lenbuf, &i, pid);
+		__STDLOG_STRBUILD_ADD_CHAR(tag->txt, lenbuf, i, ']');
+	}
+	__STDLOG_STRBUILD_ADD_CHAR(tag->txt, lenbuf, i, ':');
+	__STDLOG_STRBUILD_ADD_CHAR(tag->txt, lenbuf, i, ' ');
+	tag->len = i;
+	tag->pid = pid;
+}
+
+/* pre-renders the header pieces, called by stdlog_open() */
+int
+__stdlog_hdr_init(stdlog_channel_t ch)
+{
+	int sev;
+	int i;
+
+	pthread_once(&pid_once, hdr_pid_init);
+
+	for(sev = 0 ; sev < 8 ; ++sev) {
+		i = 0;
+		ch->hdr.pri[sev][i++] = '<';
+		__stdlog_fmt_print_int(ch->hdr.pri[sev], sizeof(ch->hdr.pri[sev]),
+			&i, (ch->facility << 3) | sev);
+		ch->hdr.pri[sev][i++] = '>';
+		ch->hdr.lenpri[sev] = i;
+	}
+
+	/* ident + "[" + up to 20 digits + "]: " */
+	ch->hdr.lentagbuf = strlen(ch->ident) + 24;
+	for(i = 0 ; i < 2 ; ++i) {
+		ch->hdr.tags[i] = malloc(sizeof(struct __stdlog_tag) + ch->hdr.lentagbuf);
+		if(ch->hdr.tags[i] == NULL) {
+			__stdlog_hdr_free(ch);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	hdr_render_tag(ch, ch->hdr.tags[0], cur_pid);
+	ch->hdr.tag = ch->hdr.tags[0];
+	return 0;
+}
+
+void
+__stdlog_hdr_free(stdlog_channel_t ch)
+{
+	free(ch->hdr.tags[0]);
+	free(ch->hdr.tags[1]);
+	ch->hdr.tags[0] = ch->hdr.tags[1] = NULL;
+}
+
+/* Sets up the hostname for drivers that send to other machines. Local
+ * receivers know our name, so the other drivers do not send it. As of
+ * RFC 3164, the domain part is not included. Called by the driver's
+ * init function.
+ */
+void
+__stdlog_hdr_init_host(stdlog_channel_t ch)
+{
+	char name[256];
+	int i;
+
+	if(gethostname(name, sizeof(name)) != 0)
+		strcpy(name, "-");
+	name[sizeof(name) - 1] = '\0';
+	for(i = 0 ; i < __STDLOG_MAXHOST && name[i] != '\0' && name[i] != '.'
+	          && name[i] != ' ' ; ++i)
+		ch->hdr.host[i] = name[i];
+	if(i == 0)
+		ch->hdr.host[i++] = '-';
+	ch->hdr.host[i++] = ' ';
+	ch->hdr.lenhost = i;
+}
+
+/* appends "hostname " if the driver sends it */
+void
+__stdlog_hdr_add_host(stdlog_channel_t ch,
+	char *__restrict__ const buf, const size_t lenbuf, int *__restrict__ const idx)
+{
+	int n = ch->hdr.lenhost;
+
+	if(n > (int) lenbuf - *idx)
+		n = (int) lenbuf - *idx;
+	memcpy(buf + *idx, ch->hdr.host, n);
+	*idx += n;
+}
+
+/* appends "<PRI>" for the given severity */
+void
+__stdlog_hdr_add_pri(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const buf, const size_t lenbuf, int *__restrict__ const idx)
+{
+	const int sev = severity & 0x07;
+	int n = ch->hdr.lenpri[sev];
+
+	if(n > (int) lenbuf - *idx)
+		n = (int) lenbuf - *idx;
+	memcpy(buf + *idx, ch->hdr.pri[sev], n);
+	*idx += n;
+}
+
+/* returns our PID, which is tracked across fork() */
+pid_t
+__stdlog_hdr_pid(void)
+{
+	return cur_pid;
+}
+
+/* appends the tag ("ident[pid]: "), refreshing it after a fork */
+void
+__stdlog_hdr_add_tag(stdlog_channel_t ch,
+	char *__restrict__ const buf, const size_t lenbuf, int *__restrict__ const idx)
+{
+	struct __stdlog_tag *tag = __atomic_load_n(&ch->hdr.tag, __ATOMIC_ACQUIRE);
+	struct __stdlog_tag *newtag;
+	const pid_t pid = cur_pid;
+	int n;
+
+	if((ch->options & STDLOG_PID) && tag->pid != pid) {
+		if(__atomic_test_and_set(&ch->hdr.refreshing, __ATOMIC_ACQUIRE)) {
+			/* someone else refreshes, do it the slow way */
+			__stdlog_fmt_print_str(buf, lenbuf, idx, ch->ident);
+			__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, '[');
+			__stdlog_fmt_print_int(buf, lenbuf, idx, pid);
+			__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, ']');
+			__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, ':');
+			__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, *idx, ' ');
+			return;
+		}
+		tag = __atomic_load_n(&ch->hdr.tag, __ATOMIC_ACQUIRE);
+		if(tag->pid != pid) {
+			newtag = (tag == ch->hdr.tags[0]) ? ch->hdr.tags[1]
+			                                    : ch->hdr.tags[0];
+			hdr_render_tag(ch, newtag, pid);
+			__atomic_store_n(&ch->hdr.tag, newtag, __ATOMIC_RELEASE);
+			tag = newtag;
+		}
+		__atomic_clear(&ch->hdr.refreshing, __ATOMIC_RELEASE);
+	}
+
+	n = tag->len;
+	if(n > (int) lenbuf - *idx)
+		n = (int) lenbuf - *idx;
+	memcpy(buf + *idx, tag->txt, n);
+	*idx += n;
+}
@@ -0,0 +1,152 @@
+/* hppcheck: checks that stdlog::log<"fmt">() behaves like stdlog_log()
+ * where the channel is concerned: it is rate limited per format,
+ * returns 1 for truncated messages, counts them and is not limited to
+ * the work buffer in large message mode. Run by "make check".
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "stdlog.hpp"
+
+static int nfailed = 0;
+
+static void
+check(const bool ok, const char *const what)
+{
+	if(!ok) {
+		std::fprintf(stderr, "hppcheck: FAILED: %s\n", what);
+		++nfailed;
+	}
+}
+
+/* counts the lines of fname that contain str */
+static int
+count_lines(const char *const fname, const char *const str)
+{
+	char line[16384];
+	std::FILE *fp;
+	int n = 0;
+
+	if((fp = std::fopen(fname, "r")) == nullptr)
+		return -1;
+	while(std::fgets(line, sizeof(line), fp) != nullptr)
+		if(std::strstr(line, str) != nullptr)
+			++n;
+	std::fclose(fp);
+	return n;
+}
+
+/* Ten messages each from two formats, with a burst of three: each
+ * format is a call site of its own and gets its summary on close.
+ */
+static void
+check_ratelimit(const char *const dir)
+{
+	char fname[256];
+	char spec[300];
+	stdlog_channel_t ch;
+	int r = 0;
+
+	std::snprintf(fname, sizeof(fname), "%s/ratelimit.log", dir);
+	std::snprintf(spec, sizeof(spec), "file,ratelimit=1,burst=3:%s", fname);
+	if((ch = stdlog_open("hppcheck", 0, STDLOG_LOCAL0, spec)) == nullptr) {
+		check(false, "open rate limited channel");
+		return;
+	}
+	for(int i = 0 ; i < 10 ; ++i) {
+		r |= stdlog::log<"site a %d">(ch, STDLOG_INFO, i);
+		r |= stdlog::log<"site b %d">(ch, STDLOG_INFO, i);
+	}
+	stdlog_close(ch);
+	check(r == 0, "rate limited calls return 0");
+	check(count_lines(fname, ": site a ") == 3, "site a logged burst only");
+	check(count_lines(fname, ": site b ") == 3, "site b logged burst only");
+	check(count_lines(fname, "suppressed 7 messages like \"site a %d\"") == 1,
+		"site a summary");
+	check(count_lines(fname, "suppressed 7 messages like \"site b %d\"") == 1,
+		"site b summary");
+	unlink(fname);
+}
+
+/* A message too large for the work buffer is truncated by a channel
+ * without large message mode, which counts it, and logged in full by
+ * one with it: the C++ formatter must not cut it short.
+ */
+static void
+check_truncation(const char *const dir)
+{
+	static char big[8192];
+	const char *const specfmt[] = { "file:%s", "file,maxmsg=65536:%s" };
+	struct stdlog_stats stats;
+	char fname[256];
+	char spec[300];
+	stdlog_channel_t ch;
+	int large;
+
+	std::memset(big, 'x', sizeof(big) - 1);
+	std::snprintf(fname, sizeof(fname), "%s/truncation.log", dir);
+	for(const char *const sf : specfmt) {
+		large = std::strstr(sf, "maxmsg") != nullptr;
+		std::snprintf(spec, sizeof(spec), sf, fname);
+		if((ch = stdlog_open("hppcheck", 0, STDLOG_LOCAL0, spec)) == nullptr) {
+			check(false, "open channel");
+			continue;
+		}
+		check(stdlog::log<"short %s">(ch, STDLOG_INFO, "msg") == 0,
+			"short message returns 0");
+		if(large) {
+			check(stdlog::log<"long %s">(ch, STDLOG_INFO, big) == 0,
+				"large message mode: long message returns 0");
+		} else {
+			check(stdlog::log<"long %s">(ch, STDLOG_INFO, big) == 1,
+				"truncated message returns 1");
+		}
+		check(stdlog_get_stats(ch, &stats) == 0
+		      && stats.truncated == (large ? 0u : 1u),
+			"truncation counted in statistics");
+		stdlog_close(ch);
+		check(count_lines(fname, big) == large,
+			"large message mode: long message logged in full");
+		unlink(fname);
+	}
+}
+
+int
+main()
+{
+	char dir[] = "/tmp/stdlog-hppcheck.XXXXXX";
+
+	if(mkdtemp(dir) == nullptr) {
+		std::perror(dir);
+		return 1;
+	}
+	check_ratelimit(dir);
+	check_truncation(dir);
+	rmdir(dir);
+	return nfailed != 0;
+}
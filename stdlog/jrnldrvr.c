@@ -1,4 +1,16 @@
-/* The stdlog systemd journal driver
+/* The stdlog systemd journal driver. It speaks journald's native
+ * protocol itself instead of going through libsystemd: an entry is a
+ * datagram of "FIELD=value\n" lines, sent to the journal socket. Values
+ * that may contain newlines use the binary form "FIELD\n", a 64-bit
+ * little endian length, the value and "\n"; we always use it for the
+ * message, so we never need to scan it.
+ *
+ * The fields that do not change (identifier, facility and PID) are
+ * rendered at stdlog_open() and passed as iovecs together with the
+ * message in wrkbuf, so the message is formatted exactly once and
+ * never copied; so are the values of structured data fields. Entries too large for a datagram are written into a
+ * sealed memfd, whose descriptor is then passed to journald instead.
+ * All of this is signal-safe.
  *
  * Copyright (C) 2014 Adiscon GmbH
  * All rights reserved.
@@ -27,30 +39,274 @@
 #include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
-#include <systemd/sd-journal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef HAVE_MEMFD_CREATE
+#	include <sys/mman.h>
+#endif
 #include "stdlog-intern.h"
 #include "stdlog.h"
 
-/* dummies just needed for driver interface */
-static void jrnl_init(stdlog_channel_t __attribute__((unused)) ch) { }
-static void jrnl_open(stdlog_channel_t __attribute__((unused)) ch) { }
-static void jrnl_close(stdlog_channel_t __attribute__((unused)) ch) { }
+#define JRNL_SOCKET "/run/systemd/journal/socket"
+#define JRNL_SNDBUF (8 * 1024 * 1024) /* as libsystemd, the kernel may cap it */
+
+/* "PRIORITY=<sev>\n" for each severity, JRNL_LENPRIO bytes each */
+static const char jrnl_prio[] = "PRIORITY=0\nPRIORITY=1\nPRIORITY=2\nPRIORITY=3\n"
+	"PRIORITY=4\nPRIORITY=5\nPRIORITY=6\nPRIORITY=7\n";
+#define JRNL_LENPRIO 11
+
+/* Appends a field to buf, which must be large enough, in binary form if
+ * the value contains a newline.
+ */
+static void
+jrnl_add_field(char *const buf, size_t *const idx, const char *const name,
+	const char *const value, const size_t lenvalue)
+{
+	const size_t lenname = strlen(name);
+	uint64_t len = lenvalue;
+	int i;
+
+	memcpy(buf + *idx, name, lenname);
+	*idx += lenname;
+	if(memchr(value, '\n', lenvalue) == NULL) {
+		buf[(*idx)++] = '=';
+	} else {
+		buf[(*idx)++] = '\n';
+		for(i = 0 ; i < 8 ; ++i, len >>= 8)
+			buf[(*idx)++] = (char) (len & 0xff);
+	}
+	memcpy(buf + *idx, value, lenvalue);
+	*idx += lenvalue;
+	buf[(*idx)++] = '\n';
+}
+
+/* renders "SYSLOG_PID=<pid>\n" into buf, returns its length */
+static int
+jrnl_render_pid(char *const buf, const size_t lenbuf, const pid_t pid)
+{
+	int i = 0;
+
+	__stdlog_fmt_print_str(buf, lenbuf, &i, "SYSLOG_PID=");
+	__stdlog_fmt_print_int(buf, lenbuf, &i, pid);
+	__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i, '\n');
+	return i;
+}
+
+static int
+jrnl_init(stdlog_channel_t ch)
+{
+	const char *sockname = __stdlog_chanspec_arg(ch->spec);
+	char facility[4];
+	int i = 0;
+	size_t idx = 0;
+
+	if(*sockname == '\0')
+		sockname = JRNL_SOCKET;
+	memset(&ch->d.jrnl.addr, 0, sizeof(ch->d.jrnl.addr));
+	ch->d.jrnl.addr.sun_family = AF_UNIX;
+	strncpy(ch->d.jrnl.addr.sun_path, sockname, sizeof(ch->d.jrnl.addr.sun_path));
+	ch->d.jrnl.sock = -1;
+
+	__stdlog_fmt_print_int(facility, sizeof(facility), &i, ch->facility);
+	/* both fields in binary form, which needs two more bytes each */
+	if((ch->d.jrnl.fields = malloc(sizeof("SYSLOG_IDENTIFIER") + sizeof("SYSLOG_FACILITY")
+	                               + 2 * (8 + 1) + strlen(ch->ident) + i)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	jrnl_add_field(ch->d.jrnl.fields, &idx, "SYSLOG_IDENTIFIER", ch->ident, strlen(ch->ident));
+	jrnl_add_field(ch->d.jrnl.fields, &idx, "SYSLOG_FACILITY", facility, i);
+	ch->d.jrnl.lenfields = idx;
+	ch->d.jrnl.pid = __stdlog_hdr_pid();
+	ch->d.jrnl.lenpid = jrnl_render_pid(ch->d.jrnl.pidfield,
+		sizeof(ch->d.jrnl.pidfield), ch->d.jrnl.pid);
+	return 0;
+}
+
+/* Creates the socket, see uxs_open() for why it may be called
+ * concurrently.
+ */
+static void
+jrnl_open(stdlog_channel_t ch)
+{
+	const int sndbuf = JRNL_SNDBUF;
+	int expected = -1;
+	int sock;
+
+	if(__atomic_load_n(&ch->d.jrnl.sock, __ATOMIC_ACQUIRE) != -1)
+		return;
+	if((sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return;
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+	setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	if(!__atomic_compare_exchange_n(&ch->d.jrnl.sock, &expected, sock, 0,
+	                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		close(sock);
+}
+
+static void
+jrnl_close(stdlog_channel_t ch)
+{
+	if(ch->d.jrnl.sock >= 0) {
+		close(ch->d.jrnl.sock);
+		ch->d.jrnl.sock = -1;
+	}
+	free(ch->d.jrnl.fields);
+}
+
+/* Sends an entry that does not fit into a datagram: it is written to a
+ * memfd, which is sealed (journald insists on that) and passed over
+ * the socket. Without memfds, such entries cannot be logged.
+ */
+static int
+jrnl_send_memfd(stdlog_channel_t ch, const struct iovec *const iov,
+	const int iovcnt, const size_t len)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr mh;
+	ssize_t lenWritten;
+	int errnosv;
+	int fd;
+	int r = -1;
+
+	if((fd = memfd_create("stdlog-journal", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+		return -1;
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	if((lenWritten = writev(fd, iov, iovcnt)) != (ssize_t) len) {
+		if(lenWritten >= 0)
+			errno = EAGAIN;
+		goto done;
+	}
+	if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+		goto done;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &ch->d.jrnl.addr;
+	mh.msg_namelen = sizeof(ch->d.jrnl.addr);
+	mh.msg_control = ctl.buf;
+	mh.msg_controllen = sizeof(ctl.buf);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	if(sendmsg(ch->d.jrnl.sock, &mh, MSG_NOSIGNAL) >= 0) {
+		__STDLOG_STATS_ADD(ch, bytes, len);
+		r = 0;
+	}
+done:
+	errnosv = errno;
+	close(fd);
+	errno = errnosv;
+	return r;
+#else
+	(void) ch; (void) iov; (void) iovcnt; (void) len;
+	errno = EMSGSIZE;
+	return -1;
+#endif
+}
+
+/* Sends an entry. iov has room for 3 + nkv + 3 entries, of which
+ * iov[3] to iov[3+nkv-1] already hold the caller's structured data
+ * fields; the others are filled in here.
+ */
+static int
+jrnl_send(stdlog_channel_t ch, const int severity,
+	struct iovec *const iov, const int nkv,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	const pid_t pid = __stdlog_hdr_pid();
+	const int iovcnt = 3 + nkv + 3;
+	char pidfield[32];
+	char msghdr[8 + 8] = "MESSAGE\n";
+	struct msghdr mh;
+	uint64_t lenmsg;
+	size_t len;
+	int i;
+
+	if(__atomic_load_n(&ch->d.jrnl.sock, __ATOMIC_ACQUIRE) < 0) {
+		jrnl_open(ch);
+		if(__atomic_load_n(&ch->d.jrnl.sock, __ATOMIC_ACQUIRE) < 0)
+			return -1;
+	}
+	lenmsg = ch->f_vsnprintf(wrkbuf, buflen, fmt, ap);
+
+	iov[0].iov_base = ch->d.jrnl.fields;
+	iov[0].iov_len = ch->d.jrnl.lenfields;
+	if(pid == ch->d.jrnl.pid) {
+		iov[1].iov_base = ch->d.jrnl.pidfield;
+		iov[1].iov_len = ch->d.jrnl.lenpid;
+	} else { /* forked child */
+		iov[1].iov_base = pidfield;
+		iov[1].iov_len = jrnl_render_pid(pidfield, sizeof(pidfield), pid);
+	}
+	iov[2].iov_base = (char *) jrnl_prio + (severity & 0x07) * JRNL_LENPRIO;
+	iov[2].iov_len = JRNL_LENPRIO;
+	for(i = 0 ; i < 8 ; ++i)
+		msghdr[8 + i] = (char) ((lenmsg >> (8 * i)) & 0xff);
+	iov[iovcnt - 3].iov_base = msghdr;
+	iov[iovcnt - 3].iov_len = sizeof(msghdr);
+	iov[iovcnt - 2].iov_base = wrkbuf;
+	iov[iovcnt - 2].iov_len = lenmsg;
+	iov[iovcnt - 1].iov_base = (char *) "\n";
+	iov[iovcnt - 1].iov_len = 1;
+	for(len = 0, i = 0 ; i < iovcnt ; ++i)
+		len += iov[i].iov_len;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &ch->d.jrnl.addr;
+	mh.msg_namelen = sizeof(ch->d.jrnl.addr);
+	mh.msg_iov = iov;
+	mh.msg_iovlen = iovcnt;
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	if(sendmsg(ch->d.jrnl.sock, &mh, MSG_NOSIGNAL) >= 0) {
+		__STDLOG_STATS_ADD(ch, bytes, len);
+		return 0;
+	}
+	if(errno == EMSGSIZE || errno == ENOBUFS)
+		return jrnl_send_memfd(ch, iov, iovcnt, len);
+	return -1;
+}
 
 static int
 jrnl_log(stdlog_channel_t ch, const int severity,
 	const char *fmt, va_list ap,
 	char *__restrict__ const wrkbuf, const size_t buflen)
 {
-	int r;
-	ch->f_vsnprintf(wrkbuf, buflen, fmt, ap);
-	r = sd_journal_send("MESSAGE=%s", wrkbuf,
-                "PRIORITY=%d", severity,
-                NULL);
-	if(r) errno = -r;
-	return r;
+	struct iovec iov[6];
+
+	return jrnl_send(ch, severity, iov, 0, fmt, ap, wrkbuf, buflen);
+}
+
+/* Structured data fields become journal fields of their own, named
+ * after the key in upper case. Their values are passed as iovecs.
+ */
+static int
+jrnl_log_kv(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_kv_out kv;
+
+	__stdlog_kv_render(&kv, __STDLOG_KV_JOURNAL, NULL, fields, nfields);
+	return jrnl_send(ch, severity, kv.iov + __STDLOG_KV_IOVHEAD - 3, kv.niov,
+		fmt, ap, wrkbuf, buflen);
 }
 
 void
@@ -60,4 +316,5 @@ __stdlog_set_jrnl_drvr(stdlog_channel_t ch)
 	ch->drvr.open = jrnl_open;
 	ch->drvr.close = jrnl_close;
 	ch->drvr.log = jrnl_log;
+	ch->drvr.log_kv = jrnl_log_kv;
 }
@@ -0,0 +1,350 @@
+/* Rendering of the structured data fields passed to stdlog_log_kv().
+ *
+ * Fields are not copied into a message buffer. Instead, they are
+ * rendered into a list of iovecs, which the drivers pass on together
+ * with the rest of the message. Keys and values that can be used
+ * as-is are referenced directly; only separators, quotes and text
+ * that needs escaping or mapping are written into a small scratch
+ * buffer. Consecutive pieces in the scratch buffer share one iovec.
+ *
+ * A field that does not fit into the scratch buffer or the iovec list
+ * is dropped together with all fields after it, and the message is
+ * flagged as truncated. All of this is signal-safe.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define KV_MAXSDNAME 32	/* RFC 5424 limit for SD-NAME */
+#define KV_MAXJRNLNAME 64	/* journald limit for field names */
+#define KV_IOV(out, i) ((out)->iov[__STDLOG_KV_IOVHEAD + (i)])
+
+static const char kv_hex[] = "0123456789abcdef";
+
+/* Adds a reference to the caller's memory. */
+static int
+kv_ref(struct __stdlog_kv_out *const out, const char *const p, const size_t len)
+{
+	if(len == 0)
+		return 0;
+	if(out->niov == __STDLOG_KV_MAXIOV)
+		return -1;
+	KV_IOV(out, out->niov).iov_base = (char *) p;
+	KV_IOV(out, out->niov).iov_len = len;
+	++out->niov;
+	out->len += len;
+	return 0;
+}
+
+/* Appends a character to the scratch buffer. If the last iovec ends
+ * right there, it is extended, otherwise a new one is started.
+ */
+static int
+kv_putc(struct __stdlog_kv_out *const out, const char c)
+{
+	struct iovec *last = (out->niov > 0) ? &KV_IOV(out, out->niov - 1) : NULL;
+
+	if(out->used >= out->lim)
+		return -1;
+	if(last == NULL || (char *) last->iov_base + last->iov_len != out->scratch + out->used) {
+		if(out->niov == __STDLOG_KV_MAXIOV)
+			return -1;
+		last = &KV_IOV(out, out->niov++);
+		last->iov_base = out->scratch + out->used;
+		last->iov_len = 0;
+	}
+	out->scratch[out->used++] = c;
+	++last->iov_len;
+	++out->len;
+	return 0;
+}
+
+static int
+kv_puts(struct __stdlog_kv_out *const out, const char *s)
+{
+	for( ; *s != '\0' ; ++s)
+		if(kv_putc(out, *s) != 0)
+			return -1;
+	return 0;
+}
+
+/* returns 1 if c must be escaped inside a (quoted) value */
+static inline int
+kv_must_escape(const int style, const unsigned char c)
+{
+	switch(style) {
+	case __STDLOG_KV_SD:
+		return c == '"' || c == '\\' || c == ']';
+	case __STDLOG_KV_JOURNAL:
+		return 0;
+	default:
+		return c < 0x20 || c == '"' || c == '\\' || c == 0x7f;
+	}
+}
+
+static int
+kv_put_escaped(struct __stdlog_kv_out *const out, const int style, const unsigned char c)
+{
+	if(style == __STDLOG_KV_SD || c == '"' || c == '\\')
+		return (kv_putc(out, '\\') || kv_putc(out, c)) ? -1 : 0;
+	if(kv_putc(out, '\\') != 0)
+		return -1;
+	switch(c) {
+	case '\n':
+		return kv_putc(out, 'n');
+	case '\r':
+		return kv_putc(out, 'r');
+	case '\t':
+		return kv_putc(out, 't');
+	}
+	if(style == __STDLOG_KV_JSON) {
+		if(kv_puts(out, "u00") != 0)
+			return -1;
+	} else if(kv_putc(out, 'x') != 0) {
+		return -1;
+	}
+	return (kv_putc(out, kv_hex[c >> 4]) || kv_putc(out, kv_hex[c & 0x0f])) ? -1 : 0;
+}
+
+/* Adds text, escaped as needed. The part up to the first character
+ * that needs escaping is referenced, the rest is copied.
+ */
+static int
+kv_text(struct __stdlog_kv_out *const out, const int style,
+	const char *const p, const size_t len)
+{
+	size_t i;
+
+	for(i = 0 ; i < len && !kv_must_escape(style, p[i]) ; ++i)
+		;
+	if(kv_ref(out, p, i) != 0)
+		return -1;
+	for( ; i < len ; ++i) {
+		if(kv_must_escape(style, p[i])) {
+			if(kv_put_escaped(out, style, p[i]) != 0)
+				return -1;
+		} else if(kv_putc(out, p[i]) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Maps a key character for styles with restricted key syntax. Returns
+ * 0 if the character is to be dropped.
+ */
+static inline char
+kv_key_char(const int style, const unsigned char c, const size_t pos)
+{
+	switch(style) {
+	case __STDLOG_KV_SD:
+		return (c <= ' ' || c >= 0x7f || c == '=' || c == ']' || c == '"') ? '_' : c;
+	case __STDLOG_KV_JOURNAL:
+		/* names must start with a letter, "_" is for trusted fields */
+		if(c >= 'a' && c <= 'z')
+			return c - 'a' + 'A';
+		if(c >= 'A' && c <= 'Z')
+			return c;
+		if(pos == 0)
+			return 0;
+		return (c >= '0' && c <= '9') ? c : '_';
+	default:
+		return (c <= ' ' || c == 0x7f || c == '=' || c == '"') ? '_' : c;
+	}
+}
+
+/* Adds the key of a field, mapped to the style's key syntax. The key
+ * is referenced if it needs no mapping. lenkey is the key length after
+ * mapping, as computed by kv_key_len().
+ */
+static int
+kv_key(struct __stdlog_kv_out *const out, const int style,
+	const struct stdlog_kv *const f, const size_t lenkey)
+{
+	const unsigned char *const key = (const unsigned char *) f->key;
+	size_t i;
+	size_t n;
+	char c;
+
+	if(style == __STDLOG_KV_JSON)
+		return kv_text(out, style, f->key, f->lenkey);
+	for(i = 0 ; i < f->lenkey && (unsigned char) kv_key_char(style, key[i], i) == key[i] ; ++i)
+		;
+	if(i == f->lenkey && lenkey == f->lenkey)
+		return kv_ref(out, f->key, f->lenkey);
+	for(i = 0, n = 0 ; i < f->lenkey && n < lenkey ; ++i) {
+		if((c = kv_key_char(style, key[i], n)) == 0)
+			continue;
+		if(kv_putc(out, c) != 0)
+			return -1;
+		++n;
+	}
+	return 0;
+}
+
+/* returns the key length after mapping; fields with 0 are skipped */
+static size_t
+kv_key_len(const int style, const struct stdlog_kv *const f)
+{
+	const size_t max = (style == __STDLOG_KV_SD) ? KV_MAXSDNAME
+		: (style == __STDLOG_KV_JOURNAL) ? KV_MAXJRNLNAME : f->lenkey;
+	size_t i;
+	size_t n = 0;
+
+	if(f->key == NULL)
+		return 0;
+	if(style != __STDLOG_KV_JOURNAL)
+		return (f->lenkey < max) ? f->lenkey : max;
+	for(i = 0 ; i < f->lenkey && n < max ; ++i)
+		if(kv_key_char(style, (unsigned char) f->key[i], n) != 0)
+			++n;
+	return n;
+}
+
+static int
+kv_field(struct __stdlog_kv_out *const out, const int style,
+	const char *const sdid, const struct stdlog_kv *const f,
+	const size_t lenkey, const int first)
+{
+	const char *const val = (f->val == NULL) ? "" : f->val;
+	const size_t lenval = (f->val == NULL) ? 0 : f->lenval;
+	uint64_t len = lenval;
+	size_t i;
+	int quote;
+
+	switch(style) {
+	case __STDLOG_KV_LOGFMT:
+		if(kv_putc(out, ' ') || kv_key(out, style, f, lenkey) || kv_putc(out, '='))
+			return -1;
+		quote = (lenval == 0);
+		for(i = 0 ; i < lenval && !quote ; ++i)
+			quote = ((unsigned char) val[i] <= ' ' || val[i] == '=' || val[i] == '"'
+			         || val[i] == '\\' || val[i] == 0x7f);
+		if(!quote)
+			return kv_ref(out, val, lenval);
+		return (kv_putc(out, '"') || kv_text(out, style, val, lenval)
+		        || kv_putc(out, '"')) ? -1 : 0;
+	case __STDLOG_KV_JSON:
+		if(kv_puts(out, first ? " {\"" : ",\"") || kv_key(out, style, f, lenkey)
+		   || kv_puts(out, "\":\"") || kv_text(out, style, val, lenval)
+		   || kv_putc(out, '"'))
+			return -1;
+		return 0;
+	case __STDLOG_KV_SD:
+		if(first && (kv_putc(out, '[') || kv_puts(out, sdid)))
+			return -1;
+		if(kv_putc(out, ' ') || kv_key(out, style, f, lenkey) || kv_puts(out, "=\"")
+		   || kv_text(out, style, val, lenval) || kv_putc(out, '"'))
+			return -1;
+		return 0;
+	default: /* journal, always in binary form */
+		if(kv_key(out, style, f, lenkey) || kv_putc(out, '\n'))
+			return -1;
+		for(i = 0 ; i < 8 ; ++i, len >>= 8)
+			if(kv_putc(out, (char) (len & 0xff)) != 0)
+				return -1;
+		return (kv_ref(out, val, lenval) || kv_putc(out, '\n')) ? -1 : 0;
+	}
+}
+
+/* Renders the fields in the given style into out. sdid is the SD-ID
+ * for __STDLOG_KV_SD and ignored otherwise. Fields with an empty key
+ * (after mapping it to the style's key syntax) are skipped.
+ */
+void
+__stdlog_kv_render(struct __stdlog_kv_out *const out, const int style,
+	const char *const sdid, const struct stdlog_kv *const fields, int nfields)
+{
+	struct iovec lastiov = { NULL, 0 };
+	int niov;
+	size_t len;
+	size_t used;
+	size_t lenkey;
+	int n = 0;
+	int i;
+
+	out->niov = 0;
+	out->len = 0;
+	out->used = 0;
+	out->lim = sizeof(out->scratch) - 1; /* keep room for closing "]" or "}" */
+	if(nfields > __STDLOG_KV_MAXFIELDS) {
+		nfields = __STDLOG_KV_MAXFIELDS;
+		__stdlog_truncated = 1;
+	}
+	for(i = 0 ; i < nfields ; ++i) {
+		if((lenkey = kv_key_len(style, &fields[i])) == 0)
+			continue;
+		niov = out->niov;
+		len = out->len;
+		used = out->used;
+		if(niov > 0)
+			lastiov = KV_IOV(out, niov - 1);
+		if(kv_field(out, style, sdid, &fields[i], lenkey, n == 0) != 0) {
+			out->niov = niov;
+			out->len = len;
+			out->used = used;
+			if(niov > 0)
+				KV_IOV(out, niov - 1) = lastiov;
+			__stdlog_truncated = 1;
+			break;
+		}
+		++n;
+	}
+	out->lim = sizeof(out->scratch);
+	if(style == __STDLOG_KV_SD)
+		kv_putc(out, (n == 0) ? '-' : ']');
+	else if(style == __STDLOG_KV_JSON && n > 0)
+		kv_putc(out, '}');
+}
+
+/* Copies the rendered fields into buf, as far as they fit. Returns
+ * the number of bytes copied.
+ */
+size_t
+__stdlog_kv_copy(const struct __stdlog_kv_out *const out, char *const buf,
+	const size_t lenbuf)
+{
+	size_t len = 0;
+	size_t n;
+	int i;
+
+	for(i = 0 ; i < out->niov ; ++i) {
+		n = KV_IOV(out, i).iov_len;
+		if(n > lenbuf - len) {
+			n = lenbuf - len;
+			__stdlog_truncated = 1;
+		}
+		memcpy(buf + len, KV_IOV(out, i).iov_base, n);
+		len += n;
+	}
+	return len;
+}
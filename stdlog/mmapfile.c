@@ -0,0 +1,315 @@
+/* The stdlog memory-mapped file driver.
+ *
+ * Writes the same lines as the "file:" driver, but without a system
+ * call per message. The file is grown in large extents, which are
+ * mapped into a fixed address window reserved at open time. A logger
+ * reserves space for its line with an atomic fetch-add on the write
+ * offset and copies the line straight into the mapping, so concurrent
+ * loggers never wait for each other. The ticker thread keeps two
+ * extents mapped ahead of the write offset and releases the pages of
+ * those far behind it. Should a logger ever overtake the mapping, or
+ * the window be exhausted, it falls back to pwrite() at its reserved
+ * offset. Both paths are async-signal-safe.
+ *
+ * While open, the file consists of the lines written so far followed
+ * by NUL bytes up to the end of the preallocated extents. On close it
+ * is truncated to its real length. After a crash, the NUL tail remains
+ * and space reserved by loggers that had not finished copying reads as
+ * NUL bytes. When the file is opened again, the NUL tail is detected
+ * and writing continues right after the last line. There is no header,
+ * so that the file remains readable by all the usual tools.
+ *
+ * The file cannot be rotated: loggers copy into the mapping without
+ * any synchronization, so there is no point at which a new file could
+ * be swapped in signal-safely. stdlog_reopen() thus fails with ENOTSUP,
+ * and the rotation parameters of "file:" are rejected.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define MMF_DFLT_EXTENT (16*1024*1024)	/* default extent size */
+#define MMF_MIN_EXTENT (64*1024)
+#define MMF_MAX_EXTENT (1024*1024*1024)
+#define MMF_AHEAD 2		/* extents kept mapped ahead of the write offset */
+#define MMF_TICKMS 10		/* map-ahead check interval */
+#define MMF_SCANBUF 65536	/* chunk size when looking for the end of data */
+#if UINTPTR_MAX > 0xffffffffu
+#	define MMF_WINDOW (1ull << 40)	/* address space reserved for the file */
+#else
+#	define MMF_WINDOW (512ull * 1024 * 1024)
+#endif
+#ifndef MAP_NORESERVE
+#	define MAP_NORESERVE 0
+#endif
+
+/* Returns the length of the file's data, that is its size without a
+ * trailing run of NUL bytes left over by a crash.
+ */
+static int
+mmf_data_end(const int fd, uint64_t *const end)
+{
+	struct stat st;
+	char buf[MMF_SCANBUF];
+	uint64_t pos;
+	ssize_t n;
+	ssize_t i;
+
+	if(fstat(fd, &st) != 0)
+		return -1;
+	pos = st.st_size;
+	while(pos > 0) {
+		n = (pos > MMF_SCANBUF) ? MMF_SCANBUF : (ssize_t) pos;
+		if(pread(fd, buf, n, pos - n) != n)
+			return -1;
+		for(i = n - 1 ; i >= 0 && buf[i] == '\0' ; --i)
+			/* just skip */;
+		if(i >= 0) {
+			pos -= n - i - 1;
+			break;
+		}
+		pos -= n;
+	}
+	*end = pos;
+	return 0;
+}
+
+/* Makes sure the file is at least end bytes long. fallocate() is
+ * preferred, as it allocates the blocks without touching existing
+ * data. If it is not available, the file is extended via ftruncate();
+ * this may race with a logger that pwrite()s beyond the mapping at the
+ * same time, which is why the mapping is kept well ahead of loggers.
+ */
+static int
+mmf_grow(stdlog_channel_t ch, const uint64_t start, const uint64_t end)
+{
+	struct stat st;
+
+#	ifdef HAVE_FALLOCATE
+	if(fallocate(ch->d.mmf.fd, 0, start, end - start) == 0)
+		return 0;
+#	else
+	(void) start;
+#	endif
+	if(fstat(ch->d.mmf.fd, &st) != 0)
+		return -1;
+	if((uint64_t) st.st_size >= end)
+		return 0;
+	return ftruncate(ch->d.mmf.fd, end);
+}
+
+/* Maps extents until MMF_AHEAD of them lie beyond the write offset,
+ * then releases the pages of extents behind it. Pages are released
+ * with MADV_DONTNEED, which keeps them in the page cache (dirty ones
+ * are still written back), so a late logger touching them merely
+ * causes a page fault.
+ */
+static int
+mmf_tick(stdlog_channel_t ch)
+{
+	const uint64_t off = __atomic_load_n(&ch->d.mmf.off, __ATOMIC_RELAXED);
+	const uint64_t extent = ch->d.mmf.extent;
+	uint64_t mapped = ch->d.mmf.mapped;
+	uint64_t upto;
+	void *p;
+
+	while(mapped < off + MMF_AHEAD * extent && mapped + extent <= MMF_WINDOW) {
+		if(mmf_grow(ch, mapped, mapped + extent) != 0)
+			return -1;
+		p = mmap(ch->d.mmf.base + mapped, extent, PROT_READ|PROT_WRITE,
+		         MAP_SHARED|MAP_FIXED, ch->d.mmf.fd, mapped);
+		if(p == MAP_FAILED)
+			return -1;
+		mapped += extent;
+		__atomic_store_n(&ch->d.mmf.mapped, mapped, __ATOMIC_RELEASE);
+	}
+
+	if(off > ch->d.mmf.released + 2 * extent) {
+		upto = (off - extent) & ~(uint64_t) (ch->d.mmf.pagesize - 1);
+		if(upto > mapped)
+			upto = mapped;
+		if(upto > ch->d.mmf.released) {
+			madvise(ch->d.mmf.base + ch->d.mmf.released,
+			        upto - ch->d.mmf.released, MADV_DONTNEED);
+			ch->d.mmf.released = upto;
+		}
+	}
+	return 0;
+}
+
+static int
+mmf_init(stdlog_channel_t ch)
+{
+	int64_t extent;
+	uint64_t end;
+	void *base;
+
+	ch->d.mmf.fd = -1;
+	ch->d.mmf.base = NULL;
+	if(   __stdlog_chanspec_has_param(ch->spec, "maxsize")
+	   || __stdlog_chanspec_has_param(ch->spec, "period")
+	   || __stdlog_chanspec_has_param(ch->spec, "keep")) {
+		errno = EINVAL;
+		return -1;
+	}
+	if((ch->d.mmf.name = strdup(__stdlog_chanspec_arg(ch->spec))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ch->d.mmf.pagesize = sysconf(_SC_PAGESIZE);
+	ch->d.mmf.pid = __stdlog_hdr_pid();
+	extent = __stdlog_chanspec_param_int(ch->spec, "extent", MMF_DFLT_EXTENT);
+	if(extent < MMF_MIN_EXTENT)
+		extent = MMF_MIN_EXTENT;
+	if(extent > MMF_MAX_EXTENT)
+		extent = MMF_MAX_EXTENT;
+	ch->d.mmf.extent = (extent + ch->d.mmf.pagesize - 1) & ~(int64_t) (ch->d.mmf.pagesize - 1);
+
+	if((ch->d.mmf.fd = open(ch->d.mmf.name, O_RDWR|O_CREAT, 0660)) < 0)
+		goto fail;
+	/* the NUL tail and the final ftruncate() leave no room for a
+	 * second writer, be it another channel or another process
+	 */
+	if(flock(ch->d.mmf.fd, LOCK_EX|LOCK_NB) != 0) {
+		if(errno == EWOULDBLOCK)
+			errno = EBUSY;
+		goto fail;
+	}
+	if(mmf_data_end(ch->d.mmf.fd, &end) != 0)
+		goto fail;
+	base = mmap(NULL, MMF_WINDOW, PROT_NONE,
+	            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if(base == MAP_FAILED)
+		goto fail;
+	ch->d.mmf.base = base;
+	ch->d.mmf.off = end;
+	ch->d.mmf.mapped = end & ~(uint64_t) (ch->d.mmf.pagesize - 1);
+	ch->d.mmf.released = ch->d.mmf.mapped;
+	if(mmf_tick(ch) != 0)
+		goto fail;
+	if(__stdlog_ticker_register(ch, MMF_TICKMS, mmf_tick) != 0)
+		goto fail;
+	return 0;
+
+fail:
+	if(ch->d.mmf.base != NULL) {
+		munmap(ch->d.mmf.base, MMF_WINDOW);
+		if(ftruncate(ch->d.mmf.fd, ch->d.mmf.off) != 0) {
+			/* we are already failing, nothing else to do */
+		}
+	}
+	if(ch->d.mmf.fd >= 0)
+		close(ch->d.mmf.fd);
+	free(ch->d.mmf.name);
+	return -1;
+}
+
+static void
+mmf_open(stdlog_channel_t __attribute__((unused)) ch)
+{
+	/* everything is done in mmf_init(), so loggers never need to */
+}
+
+static void
+mmf_close(stdlog_channel_t ch)
+{
+	__stdlog_ticker_unregister(ch, mmf_tick);
+	munmap(ch->d.mmf.base, MMF_WINDOW);
+	/* a forked child must not cut off what its parent writes */
+	if(   ch->d.mmf.pid == __stdlog_hdr_pid()
+	   && ftruncate(ch->d.mmf.fd, ch->d.mmf.off) != 0) {
+		/* nothing we can do; a restart trims the NUL tail */
+	}
+	close(ch->d.mmf.fd);
+	free(ch->d.mmf.name);
+}
+
+static int
+mmf_reopen(stdlog_channel_t __attribute__((unused)) ch)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+static int
+mmf_log(stdlog_channel_t ch, int __attribute__((unused)) severity,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	size_t lenline;
+	uint64_t o;
+	ssize_t lenWritten;
+
+	/* After fork(), parent and child would both append at the same
+	 * offset of the shared mapping, and the child has no ticker.
+	 */
+	if(ch->d.mmf.pid != __stdlog_hdr_pid()) {
+		errno = EBUSY;
+		return -1;
+	}
+	lenline = __stdlog_build_file_line(ch, wrkbuf, buflen, fmt, ap);
+	o = __atomic_fetch_add(&ch->d.mmf.off, lenline, __ATOMIC_RELAXED);
+	if(o + lenline <= __atomic_load_n(&ch->d.mmf.mapped, __ATOMIC_ACQUIRE)) {
+		memcpy(ch->d.mmf.base + o, wrkbuf, lenline);
+		__STDLOG_STATS_ADD(ch, bytes, lenline);
+		return 0;
+	}
+	/* the mapping has not caught up (yet) */
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	lenWritten = pwrite(ch->d.mmf.fd, wrkbuf, lenline, o);
+	if(lenWritten == -1)
+		return -1;
+	__STDLOG_STATS_ADD(ch, bytes, lenWritten);
+	if(lenWritten != (ssize_t) lenline) {
+		__STDLOG_STATS_ADD(ch, eagain, 1);
+		errno = EAGAIN;
+		return -1;
+	}
+	return 0;
+}
+
+void
+__stdlog_set_mmf_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = mmf_init;
+	ch->drvr.open = mmf_open;
+	ch->drvr.close = mmf_close;
+	ch->drvr.log = mmf_log;
+	ch->drvr.reopen = mmf_reopen;
+}
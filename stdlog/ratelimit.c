@@ -0,0 +1,325 @@
+/* Per call-site rate limiting.
+ *
+ * A call site is identified by the format string pointer plus the
+ * severity. Each one gets a token bucket, which holds up to "burst"
+ * tokens and is refilled with "ratelimit" tokens per second. A message
+ * is passed on only if it can take a token from its site's bucket,
+ * otherwise it is dropped and counted. The count is reported by a
+ * summary message ("suppressed N messages like "fmt"") as soon as the
+ * bucket has a token again: either before the site's next message or,
+ * if the site has gone silent, before the channel's next message from
+ * any site. The ticker thread only finds such sites; it must not log
+ * the summaries itself, as the channel's driver may block and stall the
+ * other channels' ticks. Pending summaries are also emitted on
+ * stdlog_flush() and stdlog_close().
+ *
+ * The sites live in a fixed-size open addressing hash table. Slots are
+ * claimed with a CAS on the key and never released, and each bucket's
+ * state is a single 64-bit word updated by CAS, so the fast path takes
+ * no locks and is signal-safe. If the table is full, messages from
+ * sites not in it are not limited.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+
+#define RL_DFLT_SITES	256
+#define RL_MAX_SITES	(1 << 20)
+#define RL_MAX_BURST	((1 << 20) - 1)
+#define RL_PROBES	8	/* slots tried before giving up */
+#define RL_TICK_MS	1000	/* check for silent sites this often */
+#define RL_FMTLEN	128	/* format text kept for the summary */
+
+/* bucket state: last refill time in ms << 20 | tokens */
+#define RL_TOKBITS	20
+#define RL_TOKENS(st)	((st) & RL_MAX_BURST)
+#define RL_TIME(st)	((st) >> RL_TOKBITS)
+
+struct rl_site {
+	uint64_t key;		/* fmt pointer * 8 + severity, 0 if unused */
+	uint64_t state;		/* the token bucket */
+	uint32_t suppressed;	/* messages dropped, not yet reported */
+	int hasfmt;		/* fmt is set, after the key */
+	char fmt[RL_FMTLEN];	/* start of the format, for the summary */
+};
+
+struct __stdlog_rl {
+	int64_t rate;		/* tokens per second */
+	int64_t burst;		/* bucket size */
+	uint32_t mask;		/* number of sites - 1 */
+	int due;		/* silent sites may log their summaries */
+	struct rl_site sites[];
+};
+
+static int64_t
+rl_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Refills the bucket for the time passed and tries to take a token
+ * if take is set. Returns 1 if a token was (or, if take is not set,
+ * could be) taken, 0 otherwise.
+ */
+static int
+rl_take(const struct __stdlog_rl *const rl, struct rl_site *const site,
+	const int take)
+{
+	const int64_t now = rl_now();
+	uint64_t st = __atomic_load_n(&site->state, __ATOMIC_RELAXED);
+	uint64_t newst;
+	int64_t last;
+	int64_t tokens;
+	int64_t add;
+
+	do {
+		last = RL_TIME(st);
+		tokens = RL_TOKENS(st);
+		add = (now - last) * rl->rate / 1000;
+		if(st == 0 || tokens + add >= rl->burst) {
+			tokens = rl->burst;
+			last = now;
+		} else if(add > 0) {
+			/* only account for the time the whole tokens took */
+			tokens += add;
+			last += add * 1000 / rl->rate;
+		}
+		if(tokens == 0)
+			return 0;
+		if(!take)
+			return 1;
+		newst = ((uint64_t) last << RL_TOKBITS) | (tokens - 1);
+	} while(!__atomic_compare_exchange_n(&site->state, &st, newst, 1,
+	                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return 1;
+}
+
+/* Keeps the start of the format text in a newly claimed site. The
+ * summary may be logged long after the log call has returned, when a
+ * format built at run time is gone, so the site must not point to it.
+ */
+static void
+rl_copy_fmt(struct rl_site *const site, const char *fmt)
+{
+	int i;
+
+	for(i = 0 ; i < RL_FMTLEN - 1 && fmt[i] != '\0' ; ++i)
+		site->fmt[i] = fmt[i];
+	site->fmt[i] = '\0';
+	__atomic_store_n(&site->hasfmt, 1, __ATOMIC_RELEASE);
+}
+
+/* finds or creates the site for key, returns NULL if the table is full */
+static struct rl_site *
+rl_site(struct __stdlog_rl *const rl, const uint64_t key, const char *fmt)
+{
+	struct rl_site *site;
+	uint64_t h = key * 0x9e3779b97f4a7c15ull;
+	uint64_t k;
+	int i;
+
+	for(i = 0 ; i < RL_PROBES ; ++i) {
+		site = &rl->sites[((h >> 32) + i) & rl->mask];
+		k = __atomic_load_n(&site->key, __ATOMIC_ACQUIRE);
+		if(k == key)
+			return site;
+		if(k == 0) {
+			if(__atomic_compare_exchange_n(&site->key, &k, key, 0,
+			                               __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				rl_copy_fmt(site, fmt);
+				return site;
+			}
+			if(k == key)
+				return site;
+		}
+	}
+	return NULL;
+}
+
+/* emits the summary for a site if messages were suppressed */
+static int
+rl_report(stdlog_channel_t ch, struct rl_site *const site,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	char msg[64 + RL_FMTLEN];
+	uint32_t n;
+	int i = 0;
+
+	if(__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) == 0)
+		return 0;
+	n = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+	if(n == 0)
+		return 0;
+	__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, "suppressed ");
+	__stdlog_fmt_print_int(msg, sizeof(msg) - 2, &i, n);
+	__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, " messages like \"");
+	if(__atomic_load_n(&site->hasfmt, __ATOMIC_ACQUIRE))
+		__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, site->fmt);
+	msg[i++] = '"';
+	msg[i] = '\0';
+	return __stdlog_drvr_log_msg(ch, site->key & 0x07, wrkbuf, buflen, msg);
+}
+
+/* Emits the summaries of all sites with suppressed messages. If
+ * all is not set, only those of sites that could log again are.
+ */
+static int
+rl_report_all(stdlog_channel_t ch, const int all,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_rl *const rl = ch->rl;
+	struct rl_site *site;
+	uint32_t i;
+	int r = 0;
+
+	for(i = 0 ; i <= rl->mask ; ++i) {
+		site = &rl->sites[i];
+		if(__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) == 0)
+			continue;
+		if(all || rl_take(rl, site, 0))
+			if(rl_report(ch, site, wrkbuf, buflen) != 0)
+				r = -1;
+	}
+	return r;
+}
+
+/* Returns 1 if the message may be logged, 0 if it is to be suppressed.
+ * If messages from this call site were suppressed before, the summary
+ * is emitted first.
+ */
+int
+__stdlog_rl_pass(stdlog_channel_t ch, const int severity, const char *fmt,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_rl *const rl = ch->rl;
+	struct rl_site *site;
+
+	if(__atomic_load_n(&rl->due, __ATOMIC_RELAXED)
+	   && __atomic_exchange_n(&rl->due, 0, __ATOMIC_RELAXED))
+		rl_report_all(ch, 0, wrkbuf, buflen);
+	if(fmt == NULL)
+		return 1;
+	if((site = rl_site(rl, (uint64_t) (uintptr_t) fmt * 8 + severity, fmt)) == NULL)
+		return 1;
+	if(!rl_take(rl, site, 1)) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	rl_report(ch, site, wrkbuf, buflen);
+	return 1;
+}
+
+
+/* Ticker callback: marks the summaries of silent sites that could log
+ * again as due, for the channel's next log call to emit.
+ */
+static int
+rl_tick(stdlog_channel_t ch)
+{
+	struct __stdlog_rl *const rl = ch->rl;
+	struct rl_site *site;
+	uint32_t i;
+
+	for(i = 0 ; i <= rl->mask ; ++i) {
+		site = &rl->sites[i];
+		if(__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) != 0
+		   && rl_take(rl, site, 0)) {
+			__atomic_store_n(&rl->due, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	return 0;
+}
+
+/* emits all pending summaries, called from stdlog_flush() */
+int
+__stdlog_rl_flush(stdlog_channel_t ch)
+{
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+
+	return rl_report_all(ch, 1, wrkbuf, sizeof(wrkbuf));
+}
+
+/* Sets up the rate limiter if the channel spec asks for it, called
+ * by stdlog_open() after the driver has been initialized.
+ */
+int
+__stdlog_rl_init(stdlog_channel_t ch)
+{
+	struct __stdlog_rl *rl;
+	const int64_t rate = __stdlog_chanspec_param_int(ch->spec, "ratelimit", 0);
+	int64_t burst = __stdlog_chanspec_param_int(ch->spec, "burst", rate);
+	int64_t nsites = __stdlog_chanspec_param_int(ch->spec, "ratesites", RL_DFLT_SITES);
+	uint32_t n;
+
+	if(rate <= 0)
+		return 0;
+	if(burst < 1)
+		burst = 1;
+	if(burst > RL_MAX_BURST)
+		burst = RL_MAX_BURST;
+	if(nsites > RL_MAX_SITES)
+		nsites = RL_MAX_SITES;
+	for(n = RL_PROBES ; n < nsites ; n *= 2)
+		/* round up to power of two */;
+
+	if((rl = calloc(1, sizeof(struct __stdlog_rl) + n * sizeof(struct rl_site))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	rl->rate = (rate > 1000000) ? 1000000 : rate;
+	rl->burst = burst;
+	rl->mask = n - 1;
+	ch->rl = rl;
+	if(__stdlog_ticker_register(ch, RL_TICK_MS, rl_tick) != 0) {
+		ch->rl = NULL;
+		free(rl);
+		return -1;
+	}
+	return 0;
+}
+
+/* emits pending summaries and frees the rate limiter, called by
+ * stdlog_close() before the driver is closed
+ */
+void
+__stdlog_rl_free(stdlog_channel_t ch)
+{
+	if(ch->rl == NULL)
+		return;
+	__stdlog_ticker_unregister(ch, rl_tick);
+	__stdlog_rl_flush(ch);
+	free(ch->rl);
+	ch->rl = NULL;
+}
@@ -0,0 +1,232 @@
+/* The stdlog shared-memory driver. It writes syslog frames into a ring
+ * in POSIX shared memory, which a collector on the same machine
+ * ("stdlogctl shm") drains to a file or to the syslog socket. A log
+ * call claims a slot, formats the frame right into it and publishes
+ * it; it issues a system call only if the collector sleeps. The ring
+ * layout is described in shmring.h.
+ *
+ * The ring is created by the collector. Until it exists, log calls
+ * fail, and attaching is retried at most once per SHM_ATTACH_MS. If
+ * the ring is full, the message is dropped and counted in the ring, so
+ * that a slow or dead collector never stalls the logging process.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+#include "shmring.h"
+
+#define SHM_ATTACH_MS 1000	/* min time between attach attempts */
+#define SHM_ATTACHING ((struct __stdlog_shm_hdr *) 1) /* ring being set up */
+
+static int64_t
+shm_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Maps the ring, if the collector has created it. Threads logging
+ * their first message at the same time may all get here; only one
+ * mapping is installed, the others are unmapped again. The winner
+ * first swaps in SHM_ATTACHING, so that it alone stores the geometry.
+ */
+static void
+shm_open_ring(stdlog_channel_t ch)
+{
+	struct __stdlog_shm_hdr *expected = NULL;
+	struct __stdlog_shm_hdr *hdr = MAP_FAILED;
+	struct stat st;
+	size_t len = 0;
+	uint32_t capacity;
+	uint32_t msgsize;
+	uint64_t stride;
+	int fd;
+
+	if(__atomic_load_n(&ch->d.shm.ring, __ATOMIC_ACQUIRE) != NULL)
+		return;
+	if(shm_now() < __atomic_load_n(&ch->d.shm.nextattach, __ATOMIC_RELAXED))
+		return;
+	if((fd = shm_open(ch->d.shm.name, O_RDWR, 0)) < 0)
+		goto fail;
+	if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(struct __stdlog_shm_hdr)) {
+		len = st.st_size;
+		hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(hdr == MAP_FAILED)
+		goto fail;
+	if(__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != __STDLOG_SHM_MAGIC
+	   || hdr->version != __STDLOG_SHM_VERSION) {
+		munmap(hdr, len);
+		goto fail;
+	}
+	capacity = __atomic_load_n(&hdr->capacity, __ATOMIC_RELAXED);
+	msgsize = __atomic_load_n(&hdr->msgsize, __ATOMIC_RELAXED);
+	stride = __atomic_load_n(&hdr->stride, __ATOMIC_RELAXED);
+	if(!__stdlog_shm_valid(capacity, msgsize, stride, len)) {
+		munmap(hdr, len);
+		goto fail;
+	}
+	if(!__atomic_compare_exchange_n(&ch->d.shm.ring, &expected, SHM_ATTACHING, 0,
+	                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		munmap(hdr, len);
+		return;
+	}
+	ch->d.shm.lenmap = len;
+	ch->d.shm.capacity = capacity;
+	ch->d.shm.msgsize = msgsize;
+	ch->d.shm.stride = stride;
+	__atomic_store_n(&ch->d.shm.ring, hdr, __ATOMIC_RELEASE);
+	return;
+
+fail:
+	__atomic_store_n(&ch->d.shm.nextattach, shm_now() + SHM_ATTACH_MS,
+		__ATOMIC_RELAXED);
+}
+
+static int
+shm_init(stdlog_channel_t ch)
+{
+	const char *const name = __stdlog_chanspec_arg(ch->spec);
+	const size_t lenprefix = strlen(__STDLOG_SHM_PREFIX);
+
+	if(*name == '\0' || strchr(name, '/') != NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if((ch->d.shm.name = malloc(lenprefix + strlen(name) + 1)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(ch->d.shm.name, __STDLOG_SHM_PREFIX, lenprefix);
+	strcpy(ch->d.shm.name + lenprefix, name);
+	ch->d.shm.ring = NULL;
+	ch->d.shm.lenmap = 0;
+	ch->d.shm.nextattach = 0;
+	return 0;
+}
+
+static void
+shm_close(stdlog_channel_t ch)
+{
+	if(ch->d.shm.ring != NULL && ch->d.shm.ring != SHM_ATTACHING) {
+		munmap(ch->d.shm.ring, ch->d.shm.lenmap);
+		ch->d.shm.ring = NULL;
+	}
+	free(ch->d.shm.name);
+}
+
+static int
+shm_log(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char __attribute__((unused)) *__restrict__ const wrkbuf,
+	const size_t __attribute__((unused)) buflen)
+{
+	struct __stdlog_shm_hdr *hdr = __atomic_load_n(&ch->d.shm.ring, __ATOMIC_ACQUIRE);
+	struct __stdlog_shm_slot *slot;
+	uint64_t pos;
+	uint64_t seq;
+	uint64_t expected;
+	int64_t diff;
+	uint32_t len;
+
+	if(hdr == NULL || hdr == SHM_ATTACHING) {
+		shm_open_ring(ch);
+		hdr = __atomic_load_n(&ch->d.shm.ring, __ATOMIC_ACQUIRE);
+		if(hdr == NULL || hdr == SHM_ATTACHING) {
+			errno = ENOENT;
+			return -1;
+		}
+	}
+
+	pos = __atomic_load_n(&hdr->enq_pos, __ATOMIC_RELAXED);
+	while(1) {
+		slot = __STDLOG_SHM_SLOT(hdr, pos, ch->d.shm.capacity, ch->d.shm.stride);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int64_t) ((seq & ~__STDLOG_SHM_ABANDONED) - pos);
+		if(diff == 0) {
+			/* pass over an abandoned slot, but do not write to it */
+			if(__atomic_compare_exchange_n(&hdr->enq_pos, &pos, pos + 1,
+			       1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				if(!(seq & __STDLOG_SHM_ABANDONED))
+					break;
+				++pos;
+			}
+		} else if(diff < 0) {
+			/* ring is full */
+			__atomic_add_fetch(&hdr->ndropped, 1, __ATOMIC_RELAXED);
+			__STDLOG_STATS_ADD(ch, eagain, 1);
+			__stdlog_shm_wake(hdr);
+			errno = EAGAIN;
+			return -1;
+		} else {
+			pos = __atomic_load_n(&hdr->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	len = __stdlog_build_syslog_frame(ch, severity, slot->data,
+		ch->d.shm.msgsize, fmt, ap);
+	slot->len = len;
+	expected = pos;
+	if(!__atomic_compare_exchange_n(&slot->seq, &expected, pos + 1, 0,
+	                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		/* We were too slow, the reader skipped us and marked the
+		 * slot abandoned. Now that we no longer write to it, it
+		 * may be handed out again, at whatever lap it is.
+		 */
+		while(!__atomic_compare_exchange_n(&slot->seq, &expected,
+		          expected & ~__STDLOG_SHM_ABANDONED, 0,
+		          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			/* the reader moved it on to the next lap */;
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	__STDLOG_STATS_ADD(ch, bytes, len);
+	__stdlog_shm_wake(hdr);
+	return 0;
+}
+
+void
+__stdlog_set_shm_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = shm_init;
+	ch->drvr.open = shm_open_ring;
+	ch->drvr.close = shm_close;
+	ch->drvr.log = shm_log;
+}
@@ -0,0 +1,172 @@
+/* The layout of the shared-memory ring used by the "shm:" driver and
+ * read by "stdlogctl shm", and of the statistics page a channel with
+ * "statsshm=" publishes for "stdlogctl stats". Both are shared between
+ * processes, possibly linked against different library versions, so
+ * they consist of fixed-size fields only and carry a version number.
+ *
+ * The ring works like the one of the async driver (see async.c): each
+ * slot carries a sequence number which tells producers and the reader
+ * whether the slot is free or ready, and producers claim slots with a
+ * compare and swap on enq_pos. A slot is published by a compare and
+ * swap of its sequence number as well, because the reader skips slots
+ * whose producer does not publish them in time (it may have crashed).
+ * The reader marks a skipped slot abandoned (__STDLOG_SHM_ABANDONED)
+ * instead of handing it back to producers, as a producer that was
+ * merely slow may still be writing into it. Abandoned slots are passed
+ * over by producers and the reader alike, lap after lap, until their
+ * original producer fails to publish, learns that its message is lost
+ * and clears the mark. A producer that died thus retires one slot
+ * until the ring is created anew.
+ *
+ * The geometry fields of the header (capacity, msgsize, stride) are
+ * read and checked with __stdlog_shm_valid() once when mapping the
+ * ring, and only the checked copies are used afterwards: the ring is
+ * writable by every logging process.
+ *
+ * The reader announces that it is about to sleep in the "sleeping"
+ * futex word; only then do producers issue the wakeup system call.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef STDLOG_SHMRING_H_INCLUDED
+#define STDLOG_SHMRING_H_INCLUDED
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "stdlog.h"
+#ifdef HAVE_LINUX_FUTEX_H
+#	include <linux/futex.h>
+#	include <sys/syscall.h>
+#endif
+
+#define __STDLOG_SHM_MAGIC	0x73746c67	/* "stlg" */
+#define __STDLOG_SHM_VERSION	1
+#define __STDLOG_SHM_PREFIX	"/stdlog."	/* shm object is prefix + name */
+#define __STDLOG_SHM_DFLT_SLOTS	4096
+#define __STDLOG_SHM_DFLT_MSGSIZE 1024	/* max frame size */
+
+#define __STDLOG_SHM_ABANDONED	(1ULL << 63)	/* flag in slot seq */
+
+struct __stdlog_shm_slot {
+	uint64_t seq;	/* pos: free; pos+1: ready; pos+capacity: free again;
+			 * with __STDLOG_SHM_ABANDONED: skipped, pass over */
+	uint32_t len;	/* frame length */
+	uint32_t pad;
+	char data[];	/* msgsize bytes */
+};
+
+struct __stdlog_shm_hdr {
+	uint32_t magic;	/* set last by the creator, once the ring is usable */
+	uint32_t version;
+	uint32_t capacity; /* number of slots, a power of 2 */
+	uint32_t msgsize;
+	uint64_t stride; /* size of a slot including data */
+	char pad0[40];
+	uint64_t enq_pos; /* next slot to claim (producers) */
+	char pad1[56];	/* keep producers off the reader's line */
+	uint64_t deq_pos; /* next slot to read (reader only) */
+	uint32_t sleeping; /* futex word: reader waits for wakeup */
+	uint32_t pad2;
+	uint64_t ndropped; /* messages dropped because the ring was full */
+	uint64_t nskipped; /* slots skipped because not published in time */
+	char pad3[32];
+	char slots[];
+};
+
+/* capacity and stride must be the checked copies, not the header's */
+#define __STDLOG_SHM_SLOT(hdr, pos, capacity, stride) \
+	((struct __stdlog_shm_slot *) \
+	 ((hdr)->slots + ((pos) & ((capacity) - 1)) * (stride)))
+
+#define __STDLOG_SHM_SIZE(capacity, stride) \
+	(sizeof(struct __stdlog_shm_hdr) + (uint64_t) (capacity) * (stride))
+
+/* Checks the ring geometry against the size of the mapping len. */
+static inline int
+__stdlog_shm_valid(const uint32_t capacity, const uint32_t msgsize,
+	const uint64_t stride, const size_t len)
+{
+	return    capacity >= 2 && (capacity & (capacity - 1)) == 0
+	       && msgsize > 0
+	       && stride >= sizeof(struct __stdlog_shm_slot) + (uint64_t) msgsize
+	       && stride % sizeof(uint64_t) == 0
+	       && len >= sizeof(struct __stdlog_shm_hdr)
+	       && stride <= (len - sizeof(struct __stdlog_shm_hdr)) / capacity;
+}
+
+/* Wakes the reader, if it sleeps. This is signal-safe. Without futexes,
+ * the reader polls and there is nothing to do.
+ */
+static inline void
+__stdlog_shm_wake(struct __stdlog_shm_hdr *const hdr)
+{
+	if(__atomic_load_n(&hdr->sleeping, __ATOMIC_SEQ_CST)
+	   && __atomic_exchange_n(&hdr->sleeping, 0, __ATOMIC_SEQ_CST)) {
+#		ifdef HAVE_LINUX_FUTEX_H
+		syscall(SYS_futex, &hdr->sleeping, FUTEX_WAKE, 1, NULL, NULL, 0);
+#		endif
+	}
+}
+
+/* Lets the reader sleep until woken or ms milliseconds passed. The
+ * caller must have set "sleeping" before checking for work once more.
+ */
+static inline void
+__stdlog_shm_sleep(struct __stdlog_shm_hdr *const hdr, const int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+#	ifdef HAVE_LINUX_FUTEX_H
+	syscall(SYS_futex, &hdr->sleeping, FUTEX_WAIT, 1, &ts, NULL, 0);
+#	else
+	if(ts.tv_sec > 0 || ts.tv_nsec > 10000000L) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 10000000L;
+	}
+	nanosleep(&ts, NULL);
+#	endif
+	__atomic_store_n(&hdr->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+#define __STDLOG_STATS_MAGIC	0x73747374	/* "stst" */
+#define __STDLOG_STATS_VERSION	1
+#define __STDLOG_STATS_PREFIX	"/stdlog-stats."	/* shm object is prefix + name */
+
+/* The statistics page. The counters are updated in place by the
+ * logging process, see stats.c. Readers must only access the first
+ * lenstats bytes of stats, as struct stdlog_stats may grow.
+ */
+struct __stdlog_stats_page {
+	uint32_t magic;	/* set last, once the page is initialized */
+	uint32_t version;
+	int32_t pid;	/* process that opened the channel */
+	uint32_t lenstats; /* sizeof(struct stdlog_stats) of that process */
+	char spec[240];	/* channel spec, possibly truncated */
+	struct stdlog_stats stats;
+};
+
+#endif /* STDLOG_SHMRING_H_INCLUDED */
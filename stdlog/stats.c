@@ -0,0 +1,144 @@
+/* Per-channel statistics. The counters live in struct stdlog_stats and
+ * are updated with atomic adds, so log calls never lock for them. A
+ * channel normally keeps them in its own struct; with "statsshm=name",
+ * they live in a shared memory page instead, where "stdlogctl stats"
+ * can watch them while the process runs (and after it has ended). The
+ * page layout is described in shmring.h.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+#include "shmring.h"
+
+#define STATS_MAXNAME 200
+
+/* Maps the statistics page given by "statsshm=", creating it if needed.
+ * The counters start at zero, also if the page is left over from an
+ * earlier run. Logging must not fail just because statistics cannot be
+ * published, so on error the counters stay private to the channel.
+ */
+static struct __stdlog_stats_page *
+stats_map_page(stdlog_channel_t ch, const char *name, const size_t lenname)
+{
+	const size_t lenprefix = strlen(__STDLOG_STATS_PREFIX);
+	char path[sizeof(__STDLOG_STATS_PREFIX) + STATS_MAXNAME];
+	struct __stdlog_stats_page *page;
+	int fd;
+
+	if(lenname == 0 || lenname > STATS_MAXNAME || memchr(name, '/', lenname) != NULL)
+		return NULL;
+	memcpy(path, __STDLOG_STATS_PREFIX, lenprefix);
+	memcpy(path + lenprefix, name, lenname);
+	path[lenprefix + lenname] = '\0';
+	if((fd = shm_open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return NULL;
+	if(ftruncate(fd, sizeof(struct __stdlog_stats_page)) != 0) {
+		close(fd);
+		return NULL;
+	}
+	page = mmap(NULL, sizeof(struct __stdlog_stats_page), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if(page == MAP_FAILED)
+		return NULL;
+
+	__atomic_store_n(&page->magic, 0, __ATOMIC_RELEASE);
+	memset(&page->stats, 0, sizeof(page->stats));
+	page->version = __STDLOG_STATS_VERSION;
+	page->pid = getpid();
+	page->lenstats = sizeof(struct stdlog_stats);
+	strncpy(page->spec, ch->spec, sizeof(page->spec) - 1);
+	page->spec[sizeof(page->spec) - 1] = '\0';
+	__atomic_store_n(&page->magic, __STDLOG_STATS_MAGIC, __ATOMIC_RELEASE);
+	return page;
+}
+
+/* Sets up the channel's counters, called by stdlog_open() before the
+ * driver is initialized.
+ */
+void
+__stdlog_stats_init(stdlog_channel_t ch)
+{
+	size_t lenname;
+	const char *const name = __stdlog_chanspec_param(ch->spec, "statsshm", &lenname);
+
+	ch->stats = &ch->statsbuf;
+	ch->statspage = NULL;
+	if(name != NULL && (ch->statspage = stats_map_page(ch, name, lenname)) != NULL)
+		ch->stats = &ch->statspage->stats;
+}
+
+/* Unmaps the statistics page, if any. The page itself remains, so that
+ * the final counters can still be inspected.
+ */
+void
+__stdlog_stats_free(stdlog_channel_t ch)
+{
+	if(ch->statspage != NULL) {
+		munmap(ch->statspage, sizeof(struct __stdlog_stats_page));
+		ch->statspage = NULL;
+		ch->stats = &ch->statsbuf;
+	}
+}
+
+/* counts a message the driver failed to log */
+void
+__stdlog_stats_error(stdlog_channel_t ch, const int err)
+{
+	const int idx = (err > 0 && err < STDLOG_STATS_NERRNO) ? err : STDLOG_STATS_NERRNO - 1;
+
+	__STDLOG_STATS_ADD(ch, errors, 1);
+	__STDLOG_STATS_ADD(ch, errnos[idx], 1);
+}
+
+/* Counts the duration of a driver call that began at start in the
+ * latency histogram: bucket i counts calls that took less than
+ * STDLOG_STATS_LATENCY_NS(i), but not less than the bucket before.
+ */
+void
+__stdlog_stats_latency(stdlog_channel_t ch, const struct timespec *const start)
+{
+	struct timespec now;
+	uint64_t ns;
+	int idx;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000
+	     + now.tv_nsec - start->tv_nsec;
+	idx = (ns < STDLOG_STATS_LATENCY_NS(0)) ? 0 : 63 - __builtin_clzll(ns) - 7;
+	if(idx >= STDLOG_STATS_NLATENCY)
+		idx = STDLOG_STATS_NLATENCY - 1;
+	__STDLOG_STATS_ADD(ch, latency[idx], 1);
+}
@@ -24,36 +24,163 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#include <sys/types.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include "stdlog.h"
 
 #define __STDLOG_MSGBUF_SIZE 4096
+#define __STDLOG_MAXHOST 64	/* longer hostnames are cut off in the header */
 #ifndef STDLOG_INTERN_H_INCLUDED
 #define STDLOG_INTERN_H_INCLUDED
+struct __stdlog_async_ring;
+struct __stdlog_defer;
+struct __stdlog_shm_hdr;
+struct __stdlog_stats_page;
+struct __stdlog_tag;
+struct __stdlog_uring;
+
 struct stdlog_channel {
+	struct stdlog_channel_pub pub; /* must be first, see STDLOG_ENABLED() */
 	const char *spec;
 	const char *ident;
 	int32_t options;
 	int facility;
+	struct stdlog_stats *stats; /* updated atomically, see stats.c */
+	struct stdlog_stats statsbuf;
+	struct __stdlog_stats_page *statspage; /* if published, else NULL */
+	struct {	/* pre-rendered header pieces, see header.c */
+		char pri[8][8];	/* "<PRI>" per severity */
+		int lenpri[8];
+		struct __stdlog_tag *tag; /* current "ident[pid]: " */
+		struct __stdlog_tag *tags[2];
+		int lentagbuf;
+		unsigned char refreshing;
+		char host[__STDLOG_MAXHOST + 1]; /* "hostname ", network drivers only */
+		int lenhost;	/* 0 if no hostname is sent */
+	} hdr;
 	char *fmtbuf;
+	struct __stdlog_rl *rl;	/* rate limiter, NULL if not enabled */
+	size_t maxmsg;	/* large message mode if non-zero, see stdlog.c */
 	int (*f_vsnprintf)(char *str, size_t size, const char *fmt, va_list ap);
 	struct {
-		void (*init)(stdlog_channel_t ch); /* initialize driver */
+		int (*init)(stdlog_channel_t ch); /* initialize driver */
 		void (*open)(stdlog_channel_t ch);
 		void (*close)(stdlog_channel_t ch);
 		int (*log)(stdlog_channel_t ch, const int severity, const char *fmt, va_list ap, char *wrkbuf, const size_t buflen);
+		/* optional, if NULL fields are appended to the text, see stdlog.c */
+		int (*log_kv)(stdlog_channel_t ch, const int severity, const struct stdlog_kv *fields, const int nfields, const char *fmt, va_list ap, char *wrkbuf, const size_t buflen);
+		int (*flush)(stdlog_channel_t ch); /* optional, may be NULL */
+		int (*reopen)(stdlog_channel_t ch); /* optional, must be signal-safe */
 	} drvr;
 	union {
 		struct {
-			char *sockname;
 			int sock;
-			struct sockaddr_un addr;
-		} uxs;	/* unix socket (including syslog) */
+			struct sockaddr_storage addr; /* unix or, for "udp:", inet */
+			socklen_t lenaddr;
+			/* batching, only if frames != NULL */
+			char *frames;	/* storage for batched frames */
+			size_t lenframes;
+			size_t used;
+			struct iovec *iov; /* one per batched frame */
+			void *msgs;	/* struct mmsghdr[], if sendmmsg() exists */
+			int nbatch;
+			int maxbatch;
+			int flushsev;	/* flush on this or higher severity */
+			pthread_mutex_t mut; /* protects batch */
+			/* non-blocking mode, see uxs_send() */
+			int full;	/* what to do if the socket is full */
+			int retryms;	/* full=retry: max time to keep trying */
+			uint32_t nlost;	/* messages lost, not yet reported */
+			uint32_t lost[8]; /* the same per severity */
+			int64_t lastnotice; /* ms, when loss was last reported */
+			char *spool;	/* full=spool: frames waiting to be sent */
+			size_t lenspool;
+			size_t spoolhead;
+			size_t spooltail; /* 0 if spool empty */
+			pthread_mutex_t spoolmut; /* protects spool */
+			char sdid[33];	/* SD-ID for stdlog_log_kv() fields */
+		} uxs;	/* unix socket (including syslog) and udp */
+		struct {
+			int sock;	/* -1 if not connected */
+			int connecting;	/* non-blocking connect in progress */
+			int nonblock;	/* "tcp:", never wait for the receiver */
+			struct sockaddr_storage addr; /* unix or, for "tcp:", inet */
+			socklen_t lenaddr;
+			char *buf;	/* octet-counted frames not yet sent */
+			size_t lenbuf;
+			size_t used;
+			size_t sent;	/* bytes of buf already sent on this connection */
+			size_t maxmsg;	/* max frame size */
+			int flushsev;	/* flush on this or higher severity */
+			int reconnectms; /* first pause between connect attempts */
+			int backoffms;	/* current pause, doubles on each failure */
+			int64_t nextconnect; /* ms, no connect attempt before */
+			pthread_mutex_t mut; /* protects all of the above but addr */
+		} strm;	/* unix stream socket and tcp */
 		struct {
 			int fd;
 			char *name;
+			char *buf;	/* NULL if unbuffered */
+			size_t lenbuf;
+			size_t used;
+			int flushsev;	/* flush on this or higher severity */
+			pthread_mutex_t mut; /* protects buf */
+			/* rotation, see file_rotate() */
+			int64_t maxsize; /* rotate at this size, 0 = never */
+			uint64_t written; /* size of current file, updated atomically */
+			int period;	/* rotate every period seconds, 0 = never */
+			time_t nextrot;	/* time of next periodic rotation */
+			int keep;	/* number of rotated files to keep */
+			char *oldname;	/* scratch space for renaming */
+			char *newname;
+			struct __stdlog_uring *uring; /* NULL if not using io_uring */
+			int kvstyle;	/* how stdlog_log_kv() fields are written */
 		} file;
+		struct {
+			int fd;
+			char *name;
+			char *base;	/* address window the file is mapped into */
+			uint64_t off;	/* end of data, loggers reserve space here */
+			uint64_t mapped; /* file is mapped up to here, published atomically */
+			uint64_t released; /* pages below here have been released */
+			int64_t extent;	/* file grows by this many bytes */
+			long pagesize;
+			pid_t pid;	/* process that opened the channel */
+		} mmf;	/* memory-mapped file */
+		struct {
+			stdlog_channel_t child;	/* channel we write to */
+			struct __stdlog_async_ring *ring;
+		} async;
+		struct {
+			stdlog_channel_t child;	/* channel we write to */
+			struct __stdlog_defer *dfr;
+		} defer;
+		struct {
+			stdlog_channel_t *children; /* channels we write to */
+			int nchildren;
+		} tee;
+		struct {
+			char *name;	/* of the shm object */
+			struct __stdlog_shm_hdr *ring; /* NULL until attached */
+			size_t lenmap;
+			uint32_t capacity; /* checked ring geometry */
+			uint32_t msgsize;
+			uint64_t stride;
+			int64_t nextattach; /* ms, no attach attempt before */
+		} shm;	/* shared-memory ring */
+		struct {
+			int sock;
+			struct sockaddr_un addr;
+			char *fields;	/* pre-rendered identifier and facility */
+			size_t lenfields;
+			pid_t pid;	/* PID pidfield was rendered for */
+			char pidfield[32]; /* "SYSLOG_PID=<pid>\n" */
+			int lenpid;
+		} jrnl;	/* native journal protocol */
 	} d;	/* driver-specific data */
 };
 
@@ -68,18 +195,179 @@ struct stdlog_channel {
 		buf[(idx)++] = c; \
 	}
 
+/* The message time. Usually this is the current time, but threads that
+ * emit messages on behalf of others (like the async flusher) pin the
+ * time the message was originally logged. Note: the TLS model must be
+ * initial-exec, as otherwise first access may allocate memory, which
+ * is not signal-safe.
+ */
+extern __thread time_t __stdlog_pinned_time __attribute__((tls_model("initial-exec")));
+/* Set by the formatters if the message did not fit into the buffer.
+ * The flag is never cleared by them, see drvr_log() in stdlog.c.
+ */
+extern __thread int __stdlog_truncated __attribute__((tls_model("initial-exec")));
+
+#define __STDLOG_MSGTIME() (__stdlog_pinned_time ? __stdlog_pinned_time : time(NULL))
+
 int __stdlog_formatTimestamp3164(const struct tm *const tm, char *const  buf);
+int __stdlog_formatTimestamp3164_cached(const time_t t, char *const buf);
+int __stdlog_formatTimestamp3339(const struct tm *const tm, char *const buf);
 struct tm * __stdlog_timesub(const time_t * timep, const long offset, struct tm *tmp);
 
 void __stdlog_set_uxs_drvr(stdlog_channel_t ch);
+void __stdlog_set_strm_drvr(stdlog_channel_t ch);
 void __stdlog_set_jrnl_drvr(stdlog_channel_t ch);
 void __stdlog_set_file_drvr(stdlog_channel_t ch);
+void __stdlog_set_mmf_drvr(stdlog_channel_t ch);
+void __stdlog_set_async_drvr(stdlog_channel_t ch);
+void __stdlog_set_defer_drvr(stdlog_channel_t ch);
+void __stdlog_set_tee_drvr(stdlog_channel_t ch);
+void __stdlog_set_shm_drvr(stdlog_channel_t ch);
+
+/* file line format, shared by the "file:" and "mmapfile:" drivers */
+size_t __stdlog_build_file_line(stdlog_channel_t ch, char *linebuf, const size_t lenline, const char *fmt, va_list ap);
+
+/* syslog frame format, shared by the socket drivers */
+size_t __stdlog_build_syslog_frame(stdlog_channel_t ch, const int severity, char *frame, const size_t lenframe, const char *fmt, va_list ap);
+
+/* Rendering of stdlog_log_kv() fields. The result is a list of iovecs
+ * which refer to the caller's keys and values wherever these can be
+ * used as-is; only separators and text that needs escaping go into
+ * the scratch buffer. Drivers put their own pieces of the message
+ * into the free slots around the fields, so that all of it can be
+ * written with a single system call. See kv.c.
+ */
+#define __STDLOG_KV_LOGFMT	0	/* " key=value ..." */
+#define __STDLOG_KV_JSON	1	/* " {"key":"value",...}" */
+#define __STDLOG_KV_SD		2	/* RFC 5424 "[sdid key="value" ...]" or "-" */
+#define __STDLOG_KV_JOURNAL	3	/* journal fields "KEY\n<le64 length>value\n" */
+#define __STDLOG_KV_MAXFIELDS	32	/* further fields are dropped */
+#define __STDLOG_KV_MAXIOV	(4 * __STDLOG_KV_MAXFIELDS + 2)
+#define __STDLOG_KV_IOVHEAD	3	/* free slots for the driver's iovecs */
+#define __STDLOG_KV_IOVTAIL	3
+#define __STDLOG_KV_SCRATCH	2048
+struct __stdlog_kv_out {
+	struct iovec iov[__STDLOG_KV_IOVHEAD + __STDLOG_KV_MAXIOV + __STDLOG_KV_IOVTAIL];
+	int niov;	/* fields start at iov[__STDLOG_KV_IOVHEAD] */
+	size_t len;	/* sum of all iov_len */
+	size_t used;	/* bytes of scratch in use */
+	size_t lim;	/* scratch available to fields */
+	char scratch[__STDLOG_KV_SCRATCH];
+};
+void __stdlog_kv_render(struct __stdlog_kv_out *out, const int style, const char *sdid, const struct stdlog_kv *fields, int nfields);
+size_t __stdlog_kv_copy(const struct __stdlog_kv_out *out, char *buf, const size_t lenbuf);
+
+/* io_uring submission for the file driver, see uring.c */
+struct __stdlog_uring *__stdlog_uring_new(const int nbufs, const size_t lenbuf, struct stdlog_stats *stats);
+void __stdlog_uring_free(struct __stdlog_uring *u);
+char *__stdlog_uring_buf(struct __stdlog_uring *u);
+void __stdlog_uring_write(struct __stdlog_uring *u, const int fd, char *buf, const size_t len);
+int __stdlog_uring_wait(struct __stdlog_uring *u);
+
+/* pre-rendered message header pieces */
+int __stdlog_hdr_init(stdlog_channel_t ch);
+void __stdlog_hdr_free(stdlog_channel_t ch);
+void __stdlog_hdr_add_pri(stdlog_channel_t ch, const int severity, char *buf, const size_t lenbuf, int *idx);
+void __stdlog_hdr_add_tag(stdlog_channel_t ch, char *buf, const size_t lenbuf, int *idx);
+void __stdlog_hdr_init_host(stdlog_channel_t ch);
+void __stdlog_hdr_add_host(stdlog_channel_t ch, char *buf, const size_t lenbuf, int *idx);
+pid_t __stdlog_hdr_pid(void);
+
+/* count a statistics event */
+#define __STDLOG_STATS_ADD(ch, counter, n) \
+	__atomic_add_fetch(&(ch)->stats->counter, (n), __ATOMIC_RELAXED)
+
+/* the driver call of every __STDLOG_STATS_SAMPLE-th message is timed */
+#define __STDLOG_STATS_SAMPLE 16
+#define __STDLOG_STATS_TIMED(ch) \
+	((__atomic_load_n(&(ch)->stats->msgs, __ATOMIC_RELAXED) \
+	  & (__STDLOG_STATS_SAMPLE - 1)) == 0)
+void __stdlog_stats_init(stdlog_channel_t ch);
+void __stdlog_stats_free(stdlog_channel_t ch);
+void __stdlog_stats_error(stdlog_channel_t ch, const int err);
+void __stdlog_stats_latency(stdlog_channel_t ch, const struct timespec *start);
+
+/* periodic driver flushing and other per-channel housekeeping */
+int __stdlog_ticker_register(stdlog_channel_t ch, const int interval, int (*tick)(stdlog_channel_t ch));
+void __stdlog_ticker_unregister(stdlog_channel_t ch, int (*tick)(stdlog_channel_t ch));
+
+/* per call-site rate limiting */
+int __stdlog_rl_init(stdlog_channel_t ch);
+void __stdlog_rl_free(stdlog_channel_t ch);
+int __stdlog_rl_flush(stdlog_channel_t ch);
+int __stdlog_rl_pass(stdlog_channel_t ch, const int severity, const char *fmt, char *wrkbuf, const size_t buflen);
+
+/* hand an already formatted message to a channel's driver */
+int __stdlog_drvr_log_va(stdlog_channel_t ch, const int severity, char *wrkbuf, const size_t buflen, const char *fmt, va_list ap);
+int __stdlog_drvr_log_msg(stdlog_channel_t ch, const int severity, char *wrkbuf, const size_t buflen, const char *msg);
+int __stdlog_drvr_log_msg_kv(stdlog_channel_t ch, const int severity, char *wrkbuf, const size_t buflen, const char *msg, const struct stdlog_kv *fields, const int nfields);
+
+/* channel spec parsing helpers */
+int __stdlog_chanspec_is(const char *spec, const char *drvrname);
+const char *__stdlog_chanspec_arg(const char *spec);
+const char *__stdlog_chanspec_param(const char *spec, const char *name, size_t *lenval);
+int __stdlog_chanspec_has_param(const char *spec, const char *name);
+int __stdlog_chanspec_param_is(const char *spec, const char *name, const char *val);
+int64_t __stdlog_chanspec_param_int(const char *spec, const char *name, const int64_t dflt);
+int __stdlog_chanspec_param_sev(const char *spec, const char *name, const int dflt);
+int __stdlog_parse_sev(const char *val, size_t lenval, const int dflt);
+int __stdlog_chanspec_resolve(const char *spec, const int socktype, struct sockaddr_storage *addr, socklen_t *lenaddr);
+
+/* Types of format arguments, as needed to fetch them from a va_list */
+#define __STDLOG_ARG_NONE	0	/* conversion consumes no argument */
+#define __STDLOG_ARG_INT	1
+#define __STDLOG_ARG_LONG	2
+#define __STDLOG_ARG_LLONG	3
+#define __STDLOG_ARG_SSIZE	4
+#define __STDLOG_ARG_INTMAX	5
+#define __STDLOG_ARG_UINT	6
+#define __STDLOG_ARG_ULONG	7
+#define __STDLOG_ARG_ULLONG	8
+#define __STDLOG_ARG_SIZE	9
+#define __STDLOG_ARG_UINTMAX	10
+#define __STDLOG_ARG_DOUBLE	11
+#define __STDLOG_ARG_STR	12
+#define __STDLOG_ARG_PTR	13
+
+/* precision of a string argument, as stored by __stdlog_fmt_argtypes() */
+#define __STDLOG_PREC_NONE	(-1)	/* no precision given */
+#define __STDLOG_PREC_FROM_ARG	(-2)	/* given by the preceding int argument */
+
+/* a format argument, after it has been fetched */
+union __stdlog_fmt_arg {
+	int64_t d;	/* signed integers, chars */
+	uint64_t u;	/* unsigned integers, pointers */
+	double dbl;
+	const char *s;
+};
+
+/* fetches an argument of the given __STDLOG_ARG_* type from a va_list */
+#define __STDLOG_FMT_VA_ARG(ap, type, arg) \
+	switch(type) { \
+	case __STDLOG_ARG_INT:	  (arg).d = va_arg(ap, int); break; \
+	case __STDLOG_ARG_LONG:	  (arg).d = va_arg(ap, long); break; \
+	case __STDLOG_ARG_LLONG:  (arg).d = va_arg(ap, long long); break; \
+	case __STDLOG_ARG_SSIZE:  (arg).d = va_arg(ap, ssize_t); break; \
+	case __STDLOG_ARG_INTMAX: (arg).d = va_arg(ap, intmax_t); break; \
+	case __STDLOG_ARG_UINT:	  (arg).u = va_arg(ap, unsigned); break; \
+	case __STDLOG_ARG_ULONG:  (arg).u = va_arg(ap, unsigned long); break; \
+	case __STDLOG_ARG_ULLONG: (arg).u = va_arg(ap, unsigned long long); break; \
+	case __STDLOG_ARG_SIZE:	  (arg).u = va_arg(ap, size_t); break; \
+	case __STDLOG_ARG_UINTMAX: (arg).u = va_arg(ap, uintmax_t); break; \
+	case __STDLOG_ARG_DOUBLE: (arg).dbl = va_arg(ap, double); break; \
+	case __STDLOG_ARG_STR:	  (arg).s = va_arg(ap, const char *); break; \
+	case __STDLOG_ARG_PTR:	  (arg).u = (uintptr_t) va_arg(ap, void *); break; \
+	default: break; \
+	}
 
 /* formatter "library" routines */
 void __stdlog_fmt_print_int (char *__restrict__ const buf, const size_t lenbuf, int *idx, int64_t nbr);
 void __stdlog_fmt_print_str (char *__restrict__ const buf, const size_t lenbuf, int *__restrict__ const idx, const char *const str);
 int __stdlog_sigsafe_printf(char *buf, const size_t lenbuf, const char *fmt, va_list ap);
 void __stdlog_sigsafe_memcpy(void *dest, const void *src, size_t n);
+int __stdlog_fmt_argtypes(const char *fmt, uint8_t *types, int *precs, const int maxtypes);
+size_t __stdlog_fmt_strarg_len(const union __stdlog_fmt_arg *args, const int i, const int prec);
+int __stdlog_fmt_render_args(char *buf, size_t lenbuf, const char *fmt, const union __stdlog_fmt_arg *args);
 int __stdlog_wrapper_vsnprintf(char *buf, size_t lenbuf, const char *fmt, va_list ap);
 
 #endif /* STDLOG_INTERN_H_INCLUDED */
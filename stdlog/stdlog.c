@@ -30,14 +30,38 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
 #include <syslog.h>
 #include <errno.h>
 #include "stdlog-intern.h"
 
 
+/* The default channel is created by stdlog_init(), either called by
+ * the application or lazily on first use. dflt_state makes sure that
+ * only one thread initializes, dflt_channel is published atomically
+ * when done.
+ */
+#define DFLT_NONE	0
+#define DFLT_INITING	1
+#define DFLT_READY	2
+static int dflt_state = DFLT_NONE;
 static stdlog_channel_t dflt_channel = NULL;
 static char *dflt_chanspec = NULL;
 static int32_t dflt_options = 0;
+static int dflt_logmask = STDLOG_UPTO(STDLOG_DEBUG);
+
+__thread time_t __stdlog_pinned_time __attribute__((tls_model("initial-exec"))) = 0;
+__thread int __stdlog_truncated __attribute__((tls_model("initial-exec"))) = 0;
+
+#define MAXMSG_LIMIT (16*1024*1024)	/* sanity limit for "maxmsg=" */
+#define MAXMSG_HDRSIZE 128	/* room for header, in addition to tag */
+
+/* large message mode: per-thread buffer, see drvr_log_large() */
+static __thread char *lrgbuf = NULL;
+static __thread size_t lenlrgbuf = 0;
+static pthread_key_t lrgbuf_key;
+static pthread_once_t lrgbuf_once = PTHREAD_ONCE_INIT;
 
 
 /* can be called before any other library call. If so, initializes
@@ -49,13 +73,17 @@ int
 stdlog_init(uint32_t options)
 {
 	char *chanspec;
+	char *upto;
+	stdlog_channel_t ch;
+	int state = DFLT_NONE;
 
-	if (dflt_channel != NULL) {
+	if ((options & STDLOG_USE_DFLT_OPTS) != 0) {
 		errno = EINVAL;
 		return -1;
 	}
-	if ((options & STDLOG_USE_DFLT_OPTS) != 0) {
-		errno = EINVAL;
+	if (!__atomic_compare_exchange_n(&dflt_state, &state, DFLT_INITING, 0,
+	                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		errno = EINVAL; /* already initialized (or in progress) */
 		return -1;
 	}
 
@@ -64,13 +92,52 @@ stdlog_init(uint32_t options)
 	if (chanspec == NULL)
 		chanspec = "syslog:";
 	if ((dflt_chanspec = strdup(chanspec)) == NULL)
-		return -1;
-
-	if((dflt_channel = 
-	      stdlog_open("liblogging-stdlog", dflt_options, STDLOG_LOCAL7, NULL)) == NULL)
-		return -1;
+		goto fail;
+	upto = getenv("LIBLOGGING_STDLOG_LOG_UPTO");
+	if (upto != NULL)
+		dflt_logmask = STDLOG_UPTO(__stdlog_parse_sev(upto, strlen(upto),
+			STDLOG_DEBUG));
 
+	if((ch = stdlog_open("liblogging-stdlog", dflt_options, STDLOG_LOCAL7, NULL)) == NULL)
+		goto fail;
+	__atomic_store_n(&dflt_channel, ch, __ATOMIC_RELEASE);
+	__atomic_store_n(&dflt_state, DFLT_READY, __ATOMIC_RELEASE);
 	return 0;
+
+fail:
+	free(dflt_chanspec);
+	dflt_chanspec = NULL;
+	__atomic_store_n(&dflt_state, DFLT_NONE, __ATOMIC_RELEASE);
+	return -1;
+}
+
+/* Slow path of dflt_channel_get(). If another thread is initializing
+ * the library, we wait for it to finish. Note that this cannot work if
+ * we interrupted that thread, which is why lazy initialization is not
+ * signal-safe.
+ */
+static stdlog_channel_t __attribute__((noinline))
+dflt_channel_init(void)
+{
+	if(stdlog_init(0) == 0)
+		return dflt_channel;
+	while(__atomic_load_n(&dflt_state, __ATOMIC_ACQUIRE) == DFLT_INITING)
+		sched_yield();
+	return __atomic_load_n(&dflt_channel, __ATOMIC_ACQUIRE);
+}
+
+/* Returns the default channel, initializing the library with default
+ * options if needed. Once initialized, this is a single load.
+ * Returns NULL if initialization failed.
+ */
+static inline stdlog_channel_t
+dflt_channel_get(void)
+{
+	stdlog_channel_t ch = __atomic_load_n(&dflt_channel, __ATOMIC_ACQUIRE);
+
+	if(__builtin_expect(ch == NULL, 0))
+		ch = dflt_channel_init();
+	return ch;
 }
 
 /* may be called to free stdlog ressources
@@ -114,14 +181,30 @@ __stdlog_set_driver(stdlog_channel_t ch, const char *__restrict__ chanspec)
 		return -1;
 	}
 
-	if (!strncmp(chanspec, "file:", 5))
+	if (__stdlog_chanspec_is(chanspec, "async"))
+		__stdlog_set_async_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "deferred"))
+		__stdlog_set_defer_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "tee"))
+		__stdlog_set_tee_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "file"))
 		__stdlog_set_file_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "mmapfile"))
+		__stdlog_set_mmf_drvr(ch);
 #	ifdef ENABLE_JOURNAL
-	else if (!strcmp(chanspec, "journal:"))
+	else if (__stdlog_chanspec_is(chanspec, "journal"))
 		__stdlog_set_jrnl_drvr(ch);
 #	endif
-	else if (!strncmp(chanspec, "uxsock:", 7))
+	else if (__stdlog_chanspec_is(chanspec, "uxsock"))
+		__stdlog_set_uxs_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "uxstream"))
+		__stdlog_set_strm_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "udp"))
 		__stdlog_set_uxs_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "tcp"))
+		__stdlog_set_strm_drvr(ch);
+	else if (__stdlog_chanspec_is(chanspec, "shm"))
+		__stdlog_set_shm_drvr(ch);
 	else
 		__stdlog_set_uxs_drvr(ch);
 	return 0;
@@ -150,23 +233,47 @@ stdlog_open(const char *ident, const int option, const int facility, const char
 	}
 	ch->options = (option == STDLOG_USE_DFLT_OPTS) ? dflt_options : option;
 	ch->facility = facility;
+	ch->pub.logmask = dflt_logmask;
 
 	/* formatting driver selection */
 	ch->f_vsnprintf = (ch->options & STDLOG_SIGSAFE)
 	                    ? __stdlog_sigsafe_printf : __stdlog_wrapper_vsnprintf;
 
+	if(__stdlog_hdr_init(ch) != 0)
+		goto fail;
+
 	/* output driver selection */
-	if(__stdlog_set_driver(ch, chanspec) != 0) {
+	if(__stdlog_set_driver(ch, chanspec) != 0)
+		goto fail;
+	__stdlog_stats_init(ch);
+	if(__stdlog_chanspec_has_param(ch->spec, "upto"))
+		ch->pub.logmask = STDLOG_UPTO(__stdlog_chanspec_param_sev(ch->spec,
+			"upto", STDLOG_DEBUG));
+	ch->maxmsg = __stdlog_chanspec_param_int(ch->spec, "maxmsg", 0);
+	if(ch->maxmsg <= __STDLOG_MSGBUF_SIZE || (ch->options & STDLOG_SIGSAFE))
+		ch->maxmsg = 0; /* the work buffer is large enough or must do */
+	else if(ch->maxmsg > MAXMSG_LIMIT)
+		ch->maxmsg = MAXMSG_LIMIT;
+	if(ch->drvr.init(ch) != 0)
+		goto fail;
+	if(__stdlog_rl_init(ch) != 0) {
 		int errnosv = errno;
+		ch->drvr.close(ch);
+		errno = errnosv;
+		goto fail;
+	}
+	goto done;
+
+fail:	{
+		int errnosv = errno;
+		__stdlog_stats_free(ch);
+		__stdlog_hdr_free(ch);
 		free((char*)ch->ident);
 		free((char*)ch->spec);
 		free(ch);
 		ch = NULL;
 		errno = errnosv;
-		goto done;
 	}
-
-	ch->drvr.init(ch);
 done:
 	return ch;
 }
@@ -174,12 +281,195 @@ done:
 void
 stdlog_close(stdlog_channel_t ch)
 {
+	__stdlog_rl_free(ch);
 	free((void*)ch->spec);
 	free((void*)ch->ident);
 	ch->drvr.close(ch);
+	__stdlog_stats_free(ch);
+	__stdlog_hdr_free(ch);
 	free(ch);
 }
 
+/* Writes out any messages a channel's driver has buffered and not yet
+ * emitted. Drivers that do not buffer have nothing to do.
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int
+stdlog_flush(stdlog_channel_t ch)
+{
+	if(ch == NULL)
+		ch = __atomic_load_n(&dflt_channel, __ATOMIC_ACQUIRE);
+	if(ch == NULL)
+		return 0;
+	if(ch->rl != NULL)
+		__stdlog_rl_flush(ch);
+	if(ch->drvr.flush == NULL)
+		return 0;
+	return ch->drvr.flush(ch);
+}
+
+/* Makes the channel's driver reopen its output, so that logging goes
+ * to a file that was moved away by an external log rotator. This is
+ * async-signal-safe and so may be called from a SIGHUP handler. Drivers
+ * with nothing to reopen do nothing.
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int
+stdlog_reopen(stdlog_channel_t ch)
+{
+	if(ch == NULL)
+		ch = __atomic_load_n(&dflt_channel, __ATOMIC_ACQUIRE);
+	if(ch == NULL || ch->drvr.reopen == NULL)
+		return 0;
+	return ch->drvr.reopen(ch);
+}
+
+/* Obtains a snapshot of the channel's statistics counters. The
+ * counters are maintained without locking, so they may be slightly
+ * inconsistent with each other. struct stdlog_stats consists of
+ * uint64_t counters only, so it is copied as an array of them.
+ * Returns 0 on success, -1 with errno set otherwise.
+ */
+int
+stdlog_get_stats(stdlog_channel_t ch, struct stdlog_stats *const stats)
+{
+	const uint64_t *src;
+	uint64_t *dst;
+	size_t i;
+
+	if(ch == NULL)
+		ch = __atomic_load_n(&dflt_channel, __ATOMIC_ACQUIRE);
+	if(ch == NULL || stats == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	src = (const uint64_t *) ch->stats;
+	dst = (uint64_t *) stats;
+	for(i = 0 ; i < sizeof(struct stdlog_stats) / sizeof(uint64_t) ; ++i)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Sets the channel's log mask, like setlogmask(3) does for syslog(3):
+ * messages are only logged if the bit for their severity is set, see
+ * STDLOG_MASK() and STDLOG_UPTO(). A mask of zero leaves the mask
+ * unchanged. Use NULL to select the default channel.
+ * Returns the previous mask.
+ */
+int
+stdlog_set_logmask(stdlog_channel_t ch, const int mask)
+{
+	if(ch == NULL && (ch = dflt_channel_get()) == NULL)
+		return -1;
+	if(mask == 0)
+		return __atomic_load_n(&ch->pub.logmask, __ATOMIC_RELAXED);
+	return __atomic_exchange_n(&ch->pub.logmask, mask & 0xff, __ATOMIC_RELAXED);
+}
+
+/* Returns 1 if a message of the given severity would currently be
+ * logged to the channel, 0 otherwise. See also STDLOG_ENABLED().
+ */
+int
+stdlog_enabled(stdlog_channel_t ch, const int severity)
+{
+	if(severity < 0 || severity > 7)
+		return 0;
+	if(ch == NULL && (ch = dflt_channel_get()) == NULL)
+		return 0;
+	return (__atomic_load_n(&ch->pub.logmask, __ATOMIC_RELAXED) >> severity) & 1;
+}
+
+static int __stdlog_drvr_log_fmt(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *fields, const int nfields,
+	char *wrkbuf, const size_t buflen, const char *fmt, ...);
+
+/* Structured data fields for drivers which do not render them
+ * natively: they are appended to the message text as " key=value"
+ * pairs, and the result is handed to the driver as an ordinary
+ * message. This costs a copy of message and fields.
+ */
+static int
+drvr_log_kv_text(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	char msgbuf[__STDLOG_MSGBUF_SIZE];
+	struct __stdlog_kv_out kv;
+	size_t len;
+
+	len = ch->f_vsnprintf(msgbuf, sizeof(msgbuf), fmt, ap);
+	__stdlog_kv_render(&kv, __STDLOG_KV_LOGFMT, NULL, fields, nfields);
+	len += __stdlog_kv_copy(&kv, msgbuf + len, sizeof(msgbuf) - 1 - len);
+	msgbuf[len] = '\0';
+	return __stdlog_drvr_log_fmt(ch, severity, NULL, 0, wrkbuf, buflen, "%s", msgbuf);
+}
+
+/* Hands a message to the driver, with structured data fields if
+ * fields is not NULL.
+ */
+static int
+drvr_call(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	if(fields == NULL)
+		return ch->drvr.log(ch, severity, fmt, ap, wrkbuf, buflen);
+	if(ch->drvr.log_kv != NULL)
+		return ch->drvr.log_kv(ch, severity, fields, nfields, fmt, ap, wrkbuf, buflen);
+	return drvr_log_kv_text(ch, severity, fields, nfields, fmt, ap, wrkbuf, buflen);
+}
+
+/* helper for __stdlog_drvr_log_msg(), which needs a va_list */
+static int
+__stdlog_drvr_log_fmt(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	char *__restrict__ const wrkbuf, const size_t buflen,
+	const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+	va_start(ap, fmt);
+	r = drvr_call(ch, severity, fields, nfields, fmt, ap, wrkbuf, buflen);
+	va_end(ap);
+	return r;
+}
+
+/* Hands an already formatted message to the channel's driver. This is
+ * used by drivers that wrap other channels. Note that msg must not
+ * reside inside wrkbuf.
+ */
+int
+__stdlog_drvr_log_msg(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const wrkbuf, const size_t buflen,
+	const char *__restrict__ const msg)
+{
+	return __stdlog_drvr_log_msg_kv(ch, severity, wrkbuf, buflen, msg, NULL, 0);
+}
+
+/* Same as __stdlog_drvr_log_msg(), but with structured data fields. */
+int
+__stdlog_drvr_log_msg_kv(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const wrkbuf, const size_t buflen,
+	const char *__restrict__ const msg,
+	const struct stdlog_kv *const fields, const int nfields)
+{
+	struct timespec start;
+	int timed;
+	int r;
+
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	if((timed = __STDLOG_STATS_TIMED(ch)))
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	r = __stdlog_drvr_log_fmt(ch, severity, fields, nfields, wrkbuf, buflen, "%s", msg);
+	if(r < 0)
+		__stdlog_stats_error(ch, errno);
+	if(timed)
+		__stdlog_stats_latency(ch, &start);
+	return r;
+}
+
 /* the following macro is common code for the two stdlog_logXX()
  * functions.
  */
@@ -188,16 +478,157 @@ stdlog_close(stdlog_channel_t ch)
 		r = -1; \
 		goto done; \
 	} \
-	if(ch == NULL) { \
-		if (dflt_channel == NULL) \
-			if((r = stdlog_init(0)) != 0) \
-				goto done; \
-		ch = dflt_channel; \
+	if(ch == NULL && (ch = dflt_channel_get()) == NULL) { \
+		r = -1; \
+		goto done; \
+	} \
+	if(!(__atomic_load_n(&ch->pub.logmask, __ATOMIC_RELAXED) \
+	     & STDLOG_MASK(severity))) \
+		goto done; /* not wanted, nothing to do */
+
+static void
+lrgbuf_free(void *buf)
+{
+	free(buf);
+}
+
+static void
+lrgbuf_key_create(void)
+{
+	pthread_key_create(&lrgbuf_key, lrgbuf_free);
+}
+
+/* Returns the calling thread's large message buffer, grown to at least
+ * size bytes, or NULL if out of memory. The buffer is freed when the
+ * thread terminates.
+ */
+static char *
+lrgbuf_get(const size_t size)
+{
+	char *newbuf;
+
+	if(size <= lenlrgbuf)
+		return lrgbuf;
+	pthread_once(&lrgbuf_once, lrgbuf_key_create);
+	if((newbuf = realloc(lrgbuf, size)) == NULL)
+		return NULL;
+	lrgbuf = newbuf;
+	lenlrgbuf = size;
+	pthread_setspecific(lrgbuf_key, lrgbuf);
+	return lrgbuf;
+}
+
+/* Large message mode ("maxmsg="). The message text is formatted into
+ * a buffer on the stack first. Only if it does not fit, it is formatted
+ * again into the thread's large message buffer, doubling its size until
+ * the text fits or maxmsg is reached. The text is then handed to the
+ * driver, along with a work buffer large enough for text and header.
+ * So small messages need no heap, just an extra copy. Channels in
+ * signal-safe mode never get here, as malloc() is not signal-safe.
+ */
+static int
+drvr_log_large(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char *__restrict__ wrkbuf, size_t buflen)
+{
+	char msgbuf[__STDLOG_MSGBUF_SIZE];
+	char *msg = msgbuf;
+	size_t lenmsg = sizeof(msgbuf);
+	const size_t lenhdr = MAXMSG_HDRSIZE + ch->hdr.lentagbuf;
+	va_list aq;
+	char *buf;
+	int len;
+
+	va_copy(aq, ap);
+	len = ch->f_vsnprintf(msg, lenmsg, fmt, aq);
+	va_end(aq);
+	while(__stdlog_truncated && lenmsg <= ch->maxmsg) {
+		lenmsg = (2 * lenmsg > ch->maxmsg + 1) ? ch->maxmsg + 1 : 2 * lenmsg;
+		/* text and work buffer, as the driver formats text + header */
+		if((buf = lrgbuf_get(2 * lenmsg + lenhdr)) == NULL)
+			break; /* log what we have */
+		msg = buf;
+		__stdlog_truncated = 0;
+		va_copy(aq, ap);
+		len = ch->f_vsnprintf(msg, lenmsg, fmt, aq);
+		va_end(aq);
+	}
+	if(len + lenhdr > buflen) {
+		if(msg != msgbuf) {
+			wrkbuf = msg + lenmsg;
+			buflen = lenmsg + lenhdr;
+		} else if((buf = lrgbuf_get(len + lenhdr)) != NULL) {
+			wrkbuf = buf;
+			buflen = len + lenhdr;
+		}
+	}
+	return __stdlog_drvr_log_fmt(ch, severity, NULL, 0, wrkbuf, buflen, "%s", msg);
+}
+
+/* Hands the message to the driver. If it had to be truncated, this is
+ * counted and 1 is returned instead of 0. Failures are counted, and
+ * some calls are timed, see __STDLOG_STATS_TIMED(). Messages with
+ * structured data fields are not subject to large message mode.
+ */
+static int
+drvr_log(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct timespec start;
+	int timed;
+	int r;
+
+	__stdlog_truncated = 0;
+	if((timed = __STDLOG_STATS_TIMED(ch)))
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	if(ch->maxmsg != 0 && fields == NULL)
+		r = drvr_log_large(ch, severity, fmt, ap, wrkbuf, buflen);
+	else
+		r = drvr_call(ch, severity, fields, nfields, fmt, ap, wrkbuf, buflen);
+	if(r < 0)
+		__stdlog_stats_error(ch, errno);
+	if(timed)
+		__stdlog_stats_latency(ch, &start);
+	if(__stdlog_truncated) {
+		__STDLOG_STATS_ADD(ch, truncated, 1);
+		if(r == 0)
+			r = 1;
 	}
+	return r;
+}
+
+/* Hands a message to a wrapped channel's driver, counting it in that
+ * channel's statistics as a log call to it would.
+ */
+int
+__stdlog_drvr_log_va(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const wrkbuf, const size_t buflen,
+	const char *fmt, va_list ap)
+{
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	return drvr_log(ch, severity, NULL, 0, fmt, ap, wrkbuf, buflen);
+}
+
+/* helper for stdlog_log_msg(), which needs a va_list */
+static int
+drvr_log_fmt(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const wrkbuf, const size_t buflen,
+	const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+	va_start(ap, fmt);
+	r = drvr_log(ch, severity, NULL, 0, fmt, ap, wrkbuf, buflen);
+	va_end(ap);
+	return r;
+}
 
 /* Log a message to the specified channel. If channel is NULL,
  * use the default channel (which always exists).
- * Returns 0 on success or a standard (negative) error code.
+ * Returns 0 on success, 1 if the message was logged, but truncated,
+ * or a standard (negative) error code.
  * Otherwise the semantics are equivalent to syslog().
  */
 int
@@ -208,7 +639,10 @@ stdlog_vlog(stdlog_channel_t ch,
 	char wrkbuf[__STDLOG_MSGBUF_SIZE];
 
 	STDLOG_LOG_READY_CHANNEL
-	r = ch->drvr.log(ch, severity, fmt, ap, wrkbuf, sizeof(wrkbuf));
+	if(ch->rl != NULL && !__stdlog_rl_pass(ch, severity, fmt, wrkbuf, sizeof(wrkbuf)))
+		goto done;
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	r = drvr_log(ch, severity, NULL, 0, fmt, ap, wrkbuf, sizeof(wrkbuf));
 done:	return r;
 }
 
@@ -222,7 +656,10 @@ stdlog_vlog_b(stdlog_channel_t ch, const int severity,
 	int r = 0;
 
 	STDLOG_LOG_READY_CHANNEL
-	r = ch->drvr.log(ch, severity, fmt, ap, wrkbuf, buflen);
+	if(ch->rl != NULL && !__stdlog_rl_pass(ch, severity, fmt, wrkbuf, buflen))
+		goto done;
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	r = drvr_log(ch, severity, NULL, 0, fmt, ap, wrkbuf, buflen);
 done:	return r;
 }
 
@@ -249,3 +686,68 @@ stdlog_log_b(stdlog_channel_t ch, const int severity,
 	return stdlog_vlog_b(ch, severity, wrkbuf, buflen, fmt, ap);
 }
 
+/* Log an already formatted message. msg is passed to the driver as-is,
+ * it is not interpreted as a format. site identifies the call site for
+ * rate limiting, like the format string does for stdlog_log(); if it
+ * is NULL, the message is not rate limited.
+ */
+int
+stdlog_log_msg_at(stdlog_channel_t ch, const int severity,
+	const char *site, const char *msg)
+{
+	int r = 0;
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+
+	STDLOG_LOG_READY_CHANNEL
+	if(ch->rl != NULL && !__stdlog_rl_pass(ch, severity, site, wrkbuf, sizeof(wrkbuf)))
+		goto done;
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	r = drvr_log_fmt(ch, severity, wrkbuf, sizeof(wrkbuf), "%s", msg);
+done:	return r;
+}
+
+/* Same as stdlog_log_msg_at(), but without rate limiting, as msg
+ * usually does not identify a call site.
+ */
+int
+stdlog_log_msg(stdlog_channel_t ch, const int severity, const char *msg)
+{
+	return stdlog_log_msg_at(ch, severity, NULL, msg);
+}
+
+/* Same as stdlog_log(), but with structured data fields, which each
+ * driver renders in its native way. Keys and values are passed on
+ * without being copied where the driver permits. If fields is NULL,
+ * this is the same as stdlog_vlog().
+ */
+int
+stdlog_vlog_kv(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap)
+{
+	int r = 0;
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+
+	STDLOG_LOG_READY_CHANNEL
+	if(ch->rl != NULL && !__stdlog_rl_pass(ch, severity, fmt, wrkbuf, sizeof(wrkbuf)))
+		goto done;
+	__STDLOG_STATS_ADD(ch, msgs, 1);
+	r = drvr_log(ch, severity, fields, (nfields < 0) ? 0 : nfields,
+		fmt, ap, wrkbuf, sizeof(wrkbuf));
+done:	return r;
+}
+
+/* Same as stdlog_vlog_kv(), except that it takes multiple arguments.
+ */
+int
+stdlog_log_kv(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+	va_start(ap, fmt);
+	r = stdlog_vlog_kv(ch, severity, fields, nfields, fmt, ap);
+	va_end(ap);
+	return r;
+}
@@ -30,6 +30,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* options for stdlog_open() call */
 #define STDLOG_SIGSAFE 1	/* enforce signal-safe implementation */
@@ -69,8 +74,53 @@
 #define	STDLOG_INFO	6	/* informational */
 #define	STDLOG_DEBUG	7	/* debug-level messages */
 
+/* log masks, see stdlog_set_logmask() */
+#define STDLOG_MASK(sev)	(1 << (sev))		/* just sev */
+#define STDLOG_UPTO(sev)	((1 << ((sev) + 1)) - 1)	/* sev and more severe */
+
 typedef struct stdlog_channel *stdlog_channel_t;
 
+/* The leading part of each channel. It is public only so that
+ * STDLOG_ENABLED() can be evaluated inline; do not access it directly.
+ */
+struct stdlog_channel_pub {
+	int logmask;
+};
+
+/* Checks if a message with the given severity would be logged, so that
+ * the caller can skip computing the log arguments if not.
+ */
+#define STDLOG_ENABLED(ch, severity) \
+	((ch) != NULL \
+	  ? (((const volatile struct stdlog_channel_pub *) (ch))->logmask >> ((severity) & 7)) & 1 \
+	  : stdlog_enabled(NULL, (severity)))
+
+/* channel statistics, see stdlog_get_stats() */
+#define STDLOG_STATS_NERRNO 128	/* errno values counted individually */
+#define STDLOG_STATS_NLATENCY 16	/* latency histogram buckets */
+#define STDLOG_STATS_LATENCY_NS(i) (256ULL << (i)) /* upper bound of bucket i */
+struct stdlog_stats {
+	uint64_t msgs;		/* messages handed to the channel */
+	uint64_t syscalls;	/* output system calls issued by the driver */
+	uint64_t truncated;	/* messages truncated to fit the buffer */
+	uint64_t bytes;		/* output bytes written by the driver */
+	uint64_t errors;	/* messages the driver failed to log */
+	uint64_t eagain;	/* writes that found the output full */
+	uint64_t errnos[STDLOG_STATS_NERRNO]; /* errors by errno, the last
+					   * entry collects all larger values */
+	uint64_t latency[STDLOG_STATS_NLATENCY]; /* sampled driver call times,
+					   * see STDLOG_STATS_LATENCY_NS() */
+};
+
+/* a structured data field, see stdlog_log_kv() */
+struct stdlog_kv {
+	const char *key;
+	size_t lenkey;
+	const char *val;
+	size_t lenval;
+};
+#define STDLOG_KV(key, val) { (key), strlen(key), (val), strlen(val) }
+
 const char *stdlog_version(void);
 size_t stdlog_get_msgbuf_size(void);
 const char *stdlog_get_dflt_chanspec(void);
@@ -78,9 +128,21 @@ int stdlog_init(uint32_t options);
 void stdlog_deinit(void);
 stdlog_channel_t stdlog_open(const char *ident, const int option, const int facility, const char *channelspec);
 void stdlog_close(stdlog_channel_t channel);
+int stdlog_flush(stdlog_channel_t channel);
+int stdlog_reopen(stdlog_channel_t channel);
+int stdlog_get_stats(stdlog_channel_t channel, struct stdlog_stats *stats);
+int stdlog_set_logmask(stdlog_channel_t channel, const int mask);
+int stdlog_enabled(stdlog_channel_t channel, const int severity);
 int stdlog_log(stdlog_channel_t channel, const int severity, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
 int stdlog_log_b(stdlog_channel_t ch, const int severity, char *wrkbuf, const size_t buflen, const char *fmt, ...);
 int stdlog_vlog(stdlog_channel_t ch, const int severity, const char *fmt, va_list ap);
 int stdlog_vlog_b(stdlog_channel_t ch, const int severity, char *__restrict__ const wrkbuf, const size_t buflen, const char *fmt, va_list ap);
+int stdlog_log_msg(stdlog_channel_t ch, const int severity, const char *msg);
+int stdlog_log_msg_at(stdlog_channel_t ch, const int severity, const char *site, const char *msg);
+int stdlog_log_kv(stdlog_channel_t ch, const int severity, const struct stdlog_kv *fields, const int nfields, const char *fmt, ...) __attribute__((format(printf, 5, 6)));
+int stdlog_vlog_kv(stdlog_channel_t ch, const int severity, const struct stdlog_kv *fields, const int nfields, const char *fmt, va_list ap);
 
+#ifdef __cplusplus
+}
+#endif
 #endif /* multi-include protection */
@@ -0,0 +1,893 @@
+/* The stdlog C++ header file.
+ *
+ * stdlog::log<"fmt">(channel, severity, args...) is the equivalent of
+ * stdlog_log(channel, severity, "fmt", args...), except that the format
+ * is parsed and checked against the argument types at compile time.
+ * The compiler generates a formatting routine specialized for the
+ * format, which copies the literal text and converts the arguments
+ * directly, without va_list and without any runtime format parsing.
+ * The resulting message is handed to the channel via stdlog_log_msg_at(),
+ * with the format as call site for rate limiting.
+ *
+ * Formatting follows the library's own printf implementation, the one
+ * used for STDLOG_SIGSAFE channels (see "RESTRICTIONS IN SIGNAL-SAFE
+ * MODE" in stdlog(3)). The generated text is byte-identical to what it
+ * produces. This header requires C++20.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LIBLOGGING_STDLOG_HPP_INCLUDED
+#define LIBLOGGING_STDLOG_HPP_INCLUDED
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "stdlog.h"
+
+namespace stdlog {
+
+/* A format string, usable as template argument. */
+template<std::size_t N>
+struct fmt_string {
+	char str[N] = {};
+	consteval fmt_string(const char (&s)[N]) {
+		for(std::size_t i = 0 ; i < N ; ++i)
+			str[i] = s[i];
+	}
+};
+
+namespace detail {
+
+/* Size of the stack buffer log() formats into first. Longer messages
+ * are formatted again into a buffer from the heap, so this does not
+ * limit the message size; the channel does.
+ */
+constexpr std::size_t stackbuf_size = 4096;
+
+enum class conv { lit, skip, str, sint, uint, hex, HEX, ptr, dbl, DBL, chr, star };
+enum class lmod { none, l, ll, h, hh, z, j };
+
+/* conversion flags */
+constexpr int f_left = 0x01;	/* '-' */
+constexpr int f_plus = 0x02;	/* '+' */
+constexpr int f_space = 0x04;	/* ' ' */
+constexpr int f_zero = 0x08;	/* '0' */
+constexpr int f_alt = 0x10;	/* '#' */
+
+constexpr int from_arg = -2;	/* width/precision given as '*' */
+constexpr int max_width = 100000;
+
+struct spec {
+	int flags = 0;
+	int width = -1;	/* -1 if not given */
+	int prec = -1;	/* -1 if not given */
+};
+
+/* A piece of the format: literal text, a conversion, or (skip) the
+ * '*' arguments of a "%%" or unknown conversion, which are consumed
+ * but not printed.
+ */
+struct piece {
+	conv c = conv::lit;
+	lmod m = lmod::none;
+	std::size_t off = 0;	/* literal: offset into parsed::lit */
+	std::size_t len = 0;	/* literal: length */
+	std::size_t arg = 0;	/* conversion: argument index */
+	spec s = {};
+	std::size_t warg = 0;	/* argument index of a '*' width */
+	std::size_t parg = 0;	/* argument index of a '*' precision */
+};
+
+template<std::size_t N>
+struct parsed {
+	char lit[N] = {};	/* literal text, escapes already processed */
+	piece pieces[N] = {};
+	std::size_t npieces = 0;
+	std::size_t nargs = 0;
+};
+
+consteval bool
+is_digit(const char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* parses a decimal number at f[i], capped at max_width; returns the
+ * index of the first char after it
+ */
+consteval std::size_t
+parse_num(const char *const f, std::size_t i, int &n)
+{
+	for(n = 0 ; is_digit(f[i]) ; ++i)
+		if(n < max_width)
+			n = n * 10 + f[i] - '0';
+	if(n > max_width)
+		n = max_width;
+	return i;
+}
+
+/* Splits the format into pieces. This must follow the parsing done by
+ * fmt_parse_conv() and fmt_render() in formatter.c exactly.
+ */
+template<std::size_t N>
+consteval parsed<N>
+parse(const char *const f)
+{
+	parsed<N> p;
+	std::size_t nlit = 0;
+	std::size_t i = 0;
+	piece cv;
+
+	auto add_char = [&](const char ch) {
+		if(p.npieces == 0 || p.pieces[p.npieces - 1].c != conv::lit)
+			p.pieces[p.npieces++] = piece{conv::lit, lmod::none, nlit, 0};
+		p.lit[nlit++] = ch;
+		++p.pieces[p.npieces - 1].len;
+	};
+
+	for( ; f[i] != '\0' ; ++i) {
+		if(f[i] == '\\') {
+			if(f[++i] == '\0')
+				break;
+			switch(f[i]) {
+			case 'n': add_char('\n'); break;
+			case 'r': add_char('\r'); break;
+			case 't': add_char('\t'); break;
+			default:  add_char(f[i]); break;
+			}
+		} else if(f[i] == '%') {
+			if(f[++i] == '\0')
+				break;
+			cv = piece{};
+			for( ; ; ++i) {
+				if(f[i] == '-')      cv.s.flags |= f_left;
+				else if(f[i] == '+') cv.s.flags |= f_plus;
+				else if(f[i] == ' ') cv.s.flags |= f_space;
+				else if(f[i] == '0') cv.s.flags |= f_zero;
+				else if(f[i] == '#') cv.s.flags |= f_alt;
+				else break;
+			}
+			if(f[i] == '*') {
+				cv.s.width = from_arg;
+				++i;
+			} else if(is_digit(f[i])) {
+				i = parse_num(f, i, cv.s.width);
+			}
+			if(f[i] == '.') {
+				if(f[++i] == '*') {
+					cv.s.prec = from_arg;
+					++i;
+				} else {
+					i = parse_num(f, i, cv.s.prec);
+				}
+			}
+			if(f[i] == 'l') {
+				++i;
+				if(f[i] == 'l') {
+					++i;
+					cv.m = lmod::ll;
+				} else {
+					cv.m = lmod::l;
+				}
+			} else if(f[i] == 'h') {
+				++i;
+				if(f[i] == 'h') {
+					++i;
+					cv.m = lmod::hh;
+				} else {
+					cv.m = lmod::h;
+				}
+			} else if(f[i] == 'j') {
+				++i;
+				cv.m = lmod::j;
+			} else if(f[i] == 'z') {
+				++i;
+				cv.m = lmod::z;
+			}
+			if(f[i] == '\0')
+				return p;
+			if(cv.s.width == from_arg)
+				cv.warg = p.nargs++;
+			if(cv.s.prec == from_arg)
+				cv.parg = p.nargs++;
+			switch(f[i]) {
+			case 's': cv.c = conv::str; break;
+			case 'i':
+			case 'd': cv.c = conv::sint; break;
+			case 'u': cv.c = conv::uint; break;
+			case 'x': cv.c = conv::hex; break;
+			case 'X': cv.c = conv::HEX; break;
+			case 'p': cv.c = conv::ptr; break;
+			case 'f': cv.c = conv::dbl; break;
+			case 'F': cv.c = conv::DBL; break;
+			case 'c': cv.c = conv::chr; break;
+			default:
+				if(cv.s.width == from_arg || cv.s.prec == from_arg) {
+					cv.c = conv::skip;
+					p.pieces[p.npieces++] = cv;
+				}
+				add_char(f[i] == '%' ? '%' : '?');
+				continue;
+			}
+			cv.arg = p.nargs++;
+			p.pieces[p.npieces++] = cv;
+		} else {
+			add_char(f[i]);
+		}
+	}
+	return p;
+}
+
+template<fmt_string F>
+inline constexpr parsed<sizeof(F.str)> parsed_v = parse<sizeof(F.str)>(F.str);
+
+/* returns the conversion that consumes argument k */
+template<fmt_string F>
+consteval conv
+arg_conv(const std::size_t k)
+{
+	for(std::size_t i = 0 ; i < parsed_v<F>.npieces ; ++i) {
+		const piece &p = parsed_v<F>.pieces[i];
+		if(p.c == conv::lit)
+			continue;
+		if((p.s.width == from_arg && p.warg == k)
+		   || (p.s.prec == from_arg && p.parg == k))
+			return conv::star;
+		if(p.c != conv::skip && p.arg == k)
+			return p.c;
+	}
+	return conv::lit;
+}
+
+/* checks that an argument of type T fits conversion c */
+template<typename T>
+consteval bool
+arg_ok(const conv c)
+{
+	using U = std::remove_cvref_t<T>;
+
+	switch(c) {
+	case conv::str:
+		return std::is_convertible_v<U, const char *>;
+	case conv::sint:
+	case conv::uint:
+	case conv::hex:
+	case conv::HEX:
+	case conv::chr:
+	case conv::star:
+		return std::is_integral_v<U> || std::is_enum_v<U>;
+	case conv::ptr:
+		return std::is_pointer_v<std::decay_t<U>> || std::is_null_pointer_v<U>;
+	case conv::dbl:
+	case conv::DBL:
+		return std::is_floating_point_v<U>;
+	default:
+		return false;
+	}
+}
+
+template<fmt_string F, typename... Args, std::size_t... K>
+consteval bool
+args_ok(std::index_sequence<K...>)
+{
+	return (arg_ok<Args>(arg_conv<F>(K)) && ...);
+}
+
+/* the output buffer; cap excludes the space for the terminating NUL */
+struct out {
+	char *buf;
+	std::size_t cap;
+	std::size_t i;
+	std::size_t lost;	/* bytes that did not fit */
+};
+
+/* two-digit tables, as in formatter.c */
+struct digit_tables {
+	char dec2[200];
+	char hex2l[512];
+	char hex2u[512];
+};
+
+consteval digit_tables
+make_digit_tables()
+{
+	digit_tables t{};
+
+	for(int i = 0 ; i < 100 ; ++i) {
+		t.dec2[2 * i] = '0' + i / 10;
+		t.dec2[2 * i + 1] = '0' + i % 10;
+	}
+	for(int i = 0 ; i < 256 ; ++i) {
+		t.hex2l[2 * i] = "0123456789abcdef"[i >> 4];
+		t.hex2l[2 * i + 1] = "0123456789abcdef"[i & 0xf];
+		t.hex2u[2 * i] = "0123456789ABCDEF"[i >> 4];
+		t.hex2u[2 * i + 1] = "0123456789ABCDEF"[i & 0xf];
+	}
+	return t;
+}
+
+inline constexpr digit_tables tables = make_digit_tables();
+
+inline constexpr std::uint64_t pow10[20] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+	10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+	100000000000ull, 1000000000000ull, 10000000000000ull,
+	100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+	100000000000000000ull, 1000000000000000000ull,
+	10000000000000000000ull
+};
+
+inline int
+ndigits10(const std::uint64_t n)
+{
+	int nd;
+
+	if(n < 10)
+		return 1;
+	nd = ((64 - __builtin_clzll(n)) * 1233) >> 12;
+	return nd + (n >= pow10[nd]);
+}
+
+inline int
+ndigits16(const std::uint64_t n)
+{
+	return (67 - __builtin_clzll(n | 1)) >> 2;
+}
+
+inline void
+utoa10(char *end, std::uint64_t n)
+{
+	unsigned r;
+
+	while(n >= 100) {
+		r = (n % 100) * 2;
+		n /= 100;
+		*--end = tables.dec2[r + 1];
+		*--end = tables.dec2[r];
+	}
+	if(n >= 10) {
+		*--end = tables.dec2[n * 2 + 1];
+		*--end = tables.dec2[n * 2];
+	} else {
+		*--end = '0' + n;
+	}
+}
+
+inline void
+utoa16(char *end, std::uint64_t n, const char *const hex2)
+{
+	unsigned r;
+
+	while(n >= 0x100) {
+		r = (n & 0xff) * 2;
+		n >>= 8;
+		*--end = hex2[r + 1];
+		*--end = hex2[r];
+	}
+	if(n >= 0x10) {
+		*--end = hex2[n * 2 + 1];
+		*--end = hex2[n * 2];
+	} else {
+		*--end = hex2[n * 2 + 1];
+	}
+}
+
+inline void
+put_char(out &o, const char c)
+{
+	if(o.i < o.cap)
+		o.buf[o.i++] = c;
+	else
+		++o.lost;
+}
+
+inline void
+put_mem(out &o, const char *const s, const std::size_t len)
+{
+	const std::size_t n = (len < o.cap - o.i) ? len : o.cap - o.i;
+
+	std::memcpy(o.buf + o.i, s, n);
+	o.i += n;
+	o.lost += len - n;
+}
+
+inline void
+pad(out &o, const char c, const int n)
+{
+	std::size_t k;
+
+	if(n <= 0)
+		return;
+	k = (static_cast<std::size_t>(n) < o.cap - o.i) ? n : o.cap - o.i;
+	std::memset(o.buf + o.i, c, k);
+	o.i += k;
+	o.lost += n - k;
+}
+
+/* nd digits of n, decimal if hex2 is nullptr */
+inline void
+put_digits(out &o, const std::uint64_t n, const int nd, const char *const hex2)
+{
+	char tmp[20];
+	char *const dst = (o.i + nd <= o.cap) ? o.buf + o.i : tmp;
+
+	if(hex2 == nullptr)
+		utoa10(dst + nd, n);
+	else
+		utoa16(dst + nd, n, hex2);
+	if(dst == tmp)
+		put_mem(o, tmp, nd);
+	else
+		o.i += nd;
+}
+
+inline void
+put_integer(out &o, const std::uint64_t mag, const char sign,
+	const char *const prefix, const char *const hex2, const spec &s)
+{
+	int nd;
+	int nzeros;
+	int npad;
+
+	if(s.width < 0 && s.prec < 0 && prefix == nullptr) {
+		if(sign != '\0')
+			put_char(o, sign);
+		put_digits(o, mag, (hex2 == nullptr) ? ndigits10(mag) : ndigits16(mag), hex2);
+		return;
+	}
+	if(mag == 0 && s.prec == 0)
+		nd = 0;
+	else
+		nd = (hex2 == nullptr) ? ndigits10(mag) : ndigits16(mag);
+	nzeros = (s.prec > nd) ? s.prec - nd : 0;
+	npad = s.width - ((sign != '\0') + (prefix != nullptr ? 2 : 0) + nzeros + nd);
+	if((s.flags & (f_zero | f_left)) == f_zero && s.prec < 0 && npad > 0) {
+		nzeros += npad;
+		npad = 0;
+	}
+
+	if(!(s.flags & f_left))
+		pad(o, ' ', npad);
+	if(sign != '\0')
+		put_char(o, sign);
+	if(prefix != nullptr)
+		put_mem(o, prefix, 2);
+	pad(o, '0', nzeros);
+	if(nd > 0)
+		put_digits(o, mag, nd, hex2);
+	if(s.flags & f_left)
+		pad(o, ' ', npad);
+}
+
+inline void
+put_field(out &o, const char sign, const char *const str, const int len,
+	const spec &s)
+{
+	const int npad = s.width - len - (sign != '\0');
+
+	if(!(s.flags & f_left))
+		pad(o, ' ', npad);
+	if(sign != '\0')
+		put_char(o, sign);
+	put_mem(o, str, len);
+	if(s.flags & f_left)
+		pad(o, ' ', npad);
+}
+
+inline void
+put_str(out &o, const char *str, const spec &s)
+{
+	int len = 0;
+
+	if(str == nullptr)	/* as fmt_put_str() in formatter.c */
+		str = (s.prec < 0 || s.prec >= 6) ? "(null)" : "";
+	if(s.width <= 0 && s.prec < 0) {
+		while(o.i < o.cap && *str)
+			o.buf[o.i++] = *str++;
+		if(*str)
+			o.lost += std::strlen(str);
+		return;
+	}
+	while(str[len] && (s.prec < 0 || len < s.prec))
+		++len;
+	put_field(o, '\0', str, len, s);
+}
+
+/* exact fixed notation, see fmt_dtoa_fixed() in formatter.c */
+constexpr int dbl_maxprec = 128;
+constexpr int dbl_maxint = 320;
+constexpr int dbl_maxdigs = 1 + dbl_maxint + dbl_maxprec;
+constexpr int bigwords = 36;
+
+inline int
+bigtoa10(char *end, std::uint32_t *const w, int nw)
+{
+	std::uint64_t cur;
+	std::uint32_t rem;
+	int nd = 0;
+
+	while(nw > 0 && w[nw - 1] == 0)
+		--nw;
+	while(nw > 0) {
+		rem = 0;
+		for(int i = nw - 1 ; i >= 0 ; --i) {
+			cur = (static_cast<std::uint64_t>(rem) << 32) | w[i];
+			w[i] = cur / 1000000000u;
+			rem = cur % 1000000000u;
+		}
+		while(nw > 0 && w[nw - 1] == 0)
+			--nw;
+		for(int i = 0 ; i < 9 && (nw > 0 || rem != 0) ; ++i) {
+			*--end = '0' + rem % 10;
+			rem /= 10;
+			++nd;
+		}
+	}
+	return nd;
+}
+
+inline int
+dtoa_fixed(const double d, const int prec, char *const digs, int &nint)
+{
+	std::uint32_t w[bigwords];
+	std::uint64_t u;
+	std::uint64_t m;
+	std::uint64_t f = 0;
+	std::uint64_t t;
+	std::uint32_t carry;
+	int e;
+	int k = 0;
+	int n;
+	int cmp;
+	int i;
+
+	std::memcpy(&u, &d, sizeof(u));
+	e = (u >> 52) & 0x7ff;
+	m = u & ((1ull << 52) - 1);
+	if(e == 0) {
+		e = -1074;
+	} else {
+		m |= 1ull << 52;
+		e -= 1075;
+	}
+
+	if(e >= 0 && e <= 11) {
+		n = ndigits10(m << e);
+		utoa10(digs + 1 + n, m << e);
+	} else if(e > 11) {
+		for(i = 0 ; i < bigwords ; ++i)
+			w[i] = 0;
+		t = m << (e % 32);
+		w[e / 32] = static_cast<std::uint32_t>(t);
+		w[e / 32 + 1] = static_cast<std::uint32_t>(t >> 32);
+		w[e / 32 + 2] = (e % 32) ? static_cast<std::uint32_t>(m >> (64 - e % 32)) : 0;
+		n = bigtoa10(digs + 1 + dbl_maxint, w, e / 32 + 3);
+		std::memmove(digs + 1, digs + 1 + dbl_maxint - n, n);
+	} else {
+		k = -e;
+		t = (k < 64) ? m >> k : 0;
+		n = ndigits10(t);
+		utoa10(digs + 1 + n, t);
+		f = (k < 64) ? m & ((1ull << k) - 1) : m;
+	}
+	nint = n;
+	++n;
+
+	if(k == 0) {
+		for(i = 0 ; i < prec ; ++i)
+			digs[n++] = '0';
+		cmp = -1;
+	} else if(k <= 60) {
+		for(i = 0 ; i < prec ; ++i) {
+			f *= 10;
+			digs[n++] = '0' + (f >> k);
+			f &= (1ull << k) - 1;
+		}
+		cmp = (f > (1ull << (k - 1))) - (f < (1ull << (k - 1)));
+#ifdef __SIZEOF_INT128__
+	} else if(k <= 124) {
+		unsigned __int128 g = f;
+		const unsigned __int128 one = static_cast<unsigned __int128>(1) << k;
+
+		for(i = 0 ; i < prec ; ++i) {
+			g *= 10;
+			digs[n++] = '0' + static_cast<int>(g >> k);
+			g &= one - 1;
+		}
+		cmp = (g > one / 2) - (g < one / 2);
+#endif
+	} else {
+		const int nw = (k + 31) / 32;
+		const int sh = 32 * nw - k;
+		int lo = 0;
+
+		for(i = 0 ; i < nw ; ++i)
+			w[i] = 0;
+		t = f << sh;
+		w[0] = static_cast<std::uint32_t>(t);
+		w[1] = static_cast<std::uint32_t>(t >> 32);
+		if(nw > 2 && sh > 0)
+			w[2] = static_cast<std::uint32_t>(f >> (64 - sh));
+		for(i = 0 ; i < prec ; ++i) {
+			while(lo < nw && w[lo] == 0)
+				++lo;
+			carry = 0;
+			for(int j = lo ; j < nw ; ++j) {
+				t = static_cast<std::uint64_t>(w[j]) * 10 + carry;
+				w[j] = static_cast<std::uint32_t>(t);
+				carry = t >> 32;
+			}
+			digs[n++] = '0' + carry;
+		}
+		cmp = (w[nw - 1] > 0x80000000u) - (w[nw - 1] < 0x80000000u);
+		if(cmp == 0)
+			for(i = 0 ; i < nw - 1 ; ++i)
+				if(w[i] != 0)
+					cmp = 1;
+	}
+
+	if(cmp > 0 || (cmp == 0 && (digs[n - 1] - '0') % 2 == 1)) {
+		for(i = n - 1 ; i >= 1 && digs[i] == '9' ; --i)
+			digs[i] = '0';
+		if(i >= 1) {
+			++digs[i];
+		} else {
+			digs[0] = '1';
+			++nint;
+			return n;
+		}
+	}
+	std::memmove(digs, digs + 1, n - 1);
+	return n - 1;
+}
+
+inline void
+put_double(out &o, const double d, const bool upper, const spec &s)
+{
+	char digs[dbl_maxdigs];
+	const int prec = (s.prec < 0) ? 6 : s.prec;
+	const int dprec = (prec > dbl_maxprec) ? dbl_maxprec : prec;
+	std::uint64_t u;
+	int nint;
+	int point;
+	int npad;
+	char sign;
+
+	std::memcpy(&u, &d, sizeof(u));
+	sign = (u >> 63) ? '-' : (s.flags & f_plus) ? '+'
+	     : (s.flags & f_space) ? ' ' : '\0';
+	if(((u >> 52) & 0x7ff) == 0x7ff) {
+		put_field(o, sign, (u & ((1ull << 52) - 1)) ? (upper ? "NAN" : "nan")
+		                                          : (upper ? "INF" : "inf"),
+			3, s);
+		return;
+	}
+
+	dtoa_fixed(d < 0 ? -d : d, dprec, digs, nint);
+	point = (prec > 0 || (s.flags & f_alt));
+	npad = s.width - ((sign != '\0') + nint + point + prec);
+
+	if(!(s.flags & (f_left | f_zero)))
+		pad(o, ' ', npad);
+	if(sign != '\0')
+		put_char(o, sign);
+	if((s.flags & (f_left | f_zero)) == f_zero)
+		pad(o, '0', npad);
+	put_mem(o, digs, nint);
+	if(point)
+		put_char(o, '.');
+	put_mem(o, digs + nint, dprec);
+	pad(o, '0', prec - dprec);
+	if(s.flags & f_left)
+		pad(o, ' ', npad);
+}
+
+/* integer argument, converted as va_arg() would with modifier m */
+template<lmod m, typename T>
+inline std::int64_t
+to_sint(const T v)
+{
+	if constexpr(m == lmod::l)
+		return static_cast<long>(v);
+	else if constexpr(m == lmod::ll)
+		return static_cast<long long>(v);
+	else if constexpr(m == lmod::z)
+		return static_cast<std::make_signed_t<std::size_t>>(v);
+	else if constexpr(m == lmod::j)
+		return static_cast<std::intmax_t>(v);
+	else if constexpr(m == lmod::h)
+		return static_cast<short>(v);
+	else if constexpr(m == lmod::hh)
+		return static_cast<signed char>(v);
+	else
+		return static_cast<int>(v);
+}
+
+template<lmod m, typename T>
+inline std::uint64_t
+to_uint(const T v)
+{
+	if constexpr(m == lmod::l)
+		return static_cast<unsigned long>(v);
+	else if constexpr(m == lmod::ll)
+		return static_cast<unsigned long long>(v);
+	else if constexpr(m == lmod::z)
+		return static_cast<std::size_t>(v);
+	else if constexpr(m == lmod::j)
+		return static_cast<std::uintmax_t>(v);
+	else if constexpr(m == lmod::h)
+		return static_cast<unsigned short>(v);
+	else if constexpr(m == lmod::hh)
+		return static_cast<unsigned char>(v);
+	else
+		return static_cast<unsigned>(v);
+}
+
+template<fmt_string F, std::size_t K, typename Tuple>
+inline void
+emit(out &o, const Tuple &args)
+{
+	constexpr piece p = parsed_v<F>.pieces[K];
+
+	if constexpr(p.c == conv::lit) {
+		put_mem(o, parsed_v<F>.lit + p.off, p.len);
+	} else {
+		spec s = p.s;
+		if constexpr(p.s.width == from_arg) {
+			std::int64_t w = static_cast<int>(std::get<p.warg>(args));
+			if(w < 0) {
+				s.flags |= f_left;
+				w = -w;
+			}
+			s.width = (w > max_width) ? max_width : static_cast<int>(w);
+		}
+		if constexpr(p.s.prec == from_arg) {
+			const int pr = static_cast<int>(std::get<p.parg>(args));
+			s.prec = (pr < 0) ? -1 : (pr > max_width) ? max_width : pr;
+		}
+		if constexpr(p.c != conv::skip) {
+			const auto &a = std::get<p.arg>(args);
+			if constexpr(p.c == conv::str) {
+				put_str(o, a, s);
+			} else if constexpr(p.c == conv::sint) {
+				const std::int64_t v = to_sint<p.m>(a);
+				const char sign = (v < 0) ? '-' : (s.flags & f_plus) ? '+'
+				                : (s.flags & f_space) ? ' ' : '\0';
+				put_integer(o, (v < 0) ? std::uint64_t(0) - static_cast<std::uint64_t>(v)
+				                       : static_cast<std::uint64_t>(v),
+					sign, nullptr, nullptr, s);
+			} else if constexpr(p.c == conv::uint) {
+				put_integer(o, to_uint<p.m>(a), '\0', nullptr, nullptr, s);
+			} else if constexpr(p.c == conv::hex || p.c == conv::HEX) {
+				const std::uint64_t v = to_uint<p.m>(a);
+				put_integer(o, v, '\0',
+					((s.flags & f_alt) && v != 0)
+					  ? (p.c == conv::hex ? "0x" : "0X") : nullptr,
+					p.c == conv::hex ? tables.hex2l : tables.hex2u, s);
+			} else if constexpr(p.c == conv::ptr) {
+				const std::uintptr_t u = reinterpret_cast<std::uintptr_t>(
+					static_cast<const void *>(a));
+				if(u == 0) {
+					s.prec = -1;
+					put_str(o, "(null)", s);
+				} else {
+					put_integer(o, u, '\0', "0x", tables.hex2l, s);
+				}
+			} else if constexpr(p.c == conv::dbl || p.c == conv::DBL) {
+				put_double(o, a, p.c == conv::DBL, s);
+			} else if constexpr(p.c == conv::chr) {
+				const char c = static_cast<char>(static_cast<int>(a));
+				s.prec = -1;
+				put_field(o, '\0', &c, 1, s);
+			}
+		}
+	}
+}
+
+template<fmt_string F, typename Tuple, std::size_t... K>
+inline void
+emit_all(out &o, const Tuple &args, std::index_sequence<K...>)
+{
+	(emit<F, K>(o, args), ...);
+}
+
+/* formats into buf, returns the full length of the message */
+template<fmt_string F, typename... Args>
+inline std::size_t
+format_len(char *const buf, const std::size_t lenbuf, const Args &... args)
+{
+	constexpr auto &p = parsed_v<F>;
+	static_assert(p.nargs == sizeof...(Args),
+		"stdlog: number of arguments does not match format");
+	static_assert(p.nargs != sizeof...(Args)
+	              || args_ok<F, Args...>(std::index_sequence_for<Args...>{}),
+		"stdlog: argument type does not match format conversion");
+	out o{buf, lenbuf - 1, 0, 0};
+
+	emit_all<F>(o, std::forward_as_tuple(args...),
+		std::make_index_sequence<p.npieces>{});
+	buf[o.i] = '\0';
+	return o.i + o.lost;
+}
+
+} /* namespace detail */
+
+/* Formats into buf, which has room for lenbuf bytes including the
+ * terminating NUL. Returns the number of bytes written, excluding the
+ * NUL. The output is silently truncated if it does not fit.
+ */
+template<fmt_string F, typename... Args>
+inline int
+format(char *const buf, const std::size_t lenbuf, const Args &... args)
+{
+	const std::size_t len = detail::format_len<F>(buf, lenbuf, args...);
+
+	return static_cast<int>((len < lenbuf - 1) ? len : lenbuf - 1);
+}
+
+/* Log a message with a compile-time format. Use nullptr to select the
+ * default channel. Return values are those of stdlog_log(), including
+ * 1 for a truncated message. Nothing is formatted if the channel's log
+ * mask excludes the severity. Rate limiting treats each format as one
+ * call site, just as stdlog_log() does.
+ *
+ * The message is formatted on the stack; if it is longer, it is
+ * formatted again into a buffer from the heap. The whole message is
+ * then passed on, so the channel truncates it, as it does for
+ * stdlog_log(), and counts that in its statistics. Only if that buffer
+ * cannot be allocated, the message is truncated here and just the
+ * return value tells.
+ */
+template<fmt_string F, typename... Args>
+inline int
+log(stdlog_channel_t ch, const int severity, const Args &... args)
+{
+	char buf[detail::stackbuf_size];
+	char *big;
+	std::size_t len;
+	int r;
+
+	if(!STDLOG_ENABLED(ch, severity))
+		return (severity < 0 || severity > 7) ? -1 : 0;
+	len = detail::format_len<F>(buf, sizeof(buf), args...);
+	if(len < sizeof(buf))
+		return stdlog_log_msg_at(ch, severity, F.str, buf);
+	if((big = new(std::nothrow) char[len + 1]) == nullptr) {
+		r = stdlog_log_msg_at(ch, severity, F.str, buf);
+		return (r == 0) ? 1 : r;
+	}
+	detail::format_len<F>(big, len + 1, args...);
+	r = stdlog_log_msg_at(ch, severity, F.str, big);
+	delete[] big;
+	return r;
+}
+
+} /* namespace stdlog */
+
+#endif /* multi-include protection */
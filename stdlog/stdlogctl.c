@@ -1,6 +1,9 @@
 /* A small utility for handling stdlog functions.
- * Right now, it only spits out version information and buffer
- * sizes, but we could evolve it into something to manipulate
+ * Without arguments, it spits out version information and buffer
+ * sizes. "stdlogctl shm" is the collector for the "shm:" driver: it
+ * creates the shared-memory ring and drains it to a file or to the
+ * syslog socket. "stdlogctl stats" shows the statistics a channel
+ * publishes with "statsshm=". We could evolve it into something to manipulate
  * system default config files (once we have them).
  *
  * Copyright (C) 2014 Adiscon GmbH
@@ -27,13 +30,495 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "stdlog.h"
+#include "shmring.h"
+
+#define SHM_STUCK_MS 1000	/* skip a slot not published within this time */
+#define SHM_IDLE_MS 1000	/* max time to sleep unwoken */
+
+static volatile sig_atomic_t stop = 0;
+
+static void
+on_signal(int __attribute__((unused)) sig)
+{
+	stop = 1;
+}
+
+static int64_t
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* the ring and its geometry, as checked when it was set up */
+struct shm_ring {
+	struct __stdlog_shm_hdr *hdr;
+	uint32_t capacity;
+	uint32_t msgsize;
+	uint64_t stride;
+};
+
+/* maps the ring if it exists and is valid, returns NULL otherwise */
+static struct __stdlog_shm_hdr *
+shm_map(const int fd, size_t *const len, struct shm_ring *const ring)
+{
+	struct __stdlog_shm_hdr *hdr;
+	struct stat st;
+
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct __stdlog_shm_hdr))
+		return NULL;
+	*len = st.st_size;
+	if((hdr = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		return NULL;
+	ring->capacity = hdr->capacity;
+	ring->msgsize = hdr->msgsize;
+	ring->stride = hdr->stride;
+	if(hdr->magic != __STDLOG_SHM_MAGIC || hdr->version != __STDLOG_SHM_VERSION
+	   || !__stdlog_shm_valid(ring->capacity, ring->msgsize, ring->stride, *len)) {
+		munmap(hdr, *len);
+		return NULL;
+	}
+	return hdr;
+}
+
+/* Attaches to the ring or, if there is none (or an unusable one),
+ * creates it. An existing ring is kept, so that messages logged while
+ * no collector ran are not lost and loggers that attached to it stay
+ * connected. The ring is locked, as there must only be one reader.
+ */
+static int
+shm_setup(const char *const objname, uint32_t nslots, const uint32_t msgsize,
+	struct shm_ring *const ring)
+{
+	struct __stdlog_shm_hdr *hdr;
+	uint64_t stride;
+	uint64_t i;
+	size_t len;
+	int fd;
+
+	if((fd = shm_open(objname, O_RDWR, 0)) >= 0) {
+		if((hdr = shm_map(fd, &len, ring)) != NULL)
+			goto locked;
+		close(fd);
+		shm_unlink(objname);
+	}
+
+	for(i = 2 ; i < nslots ; i <<= 1)
+		/* round up to power of 2 */;
+	nslots = i;
+	stride = (sizeof(struct __stdlog_shm_slot) + msgsize + 63) & ~63;
+	len = __STDLOG_SHM_SIZE(nslots, stride);
+	if((fd = shm_open(objname, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0)
+		return -1;
+	if(ftruncate(fd, len) != 0
+	   || (hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		shm_unlink(objname);
+		return -1;
+	}
+	hdr->version = __STDLOG_SHM_VERSION;
+	hdr->capacity = ring->capacity = nslots;
+	hdr->msgsize = ring->msgsize = msgsize;
+	hdr->stride = ring->stride = stride;
+	for(i = 0 ; i < nslots ; ++i)
+		__STDLOG_SHM_SLOT(hdr, i, nslots, stride)->seq = i;
+	__atomic_store_n(&hdr->magic, __STDLOG_SHM_MAGIC, __ATOMIC_RELEASE);
+
+locked:
+	/* the descriptor is kept open to hold the lock */
+	if(flock(fd, LOCK_EX | LOCK_NB) != 0) {
+		munmap(hdr, len);
+		close(fd);
+		errno = EBUSY;
+		return -1;
+	}
+	ring->hdr = hdr;
+	return 0;
+}
+
+struct shm_output {
+	FILE *fp;	/* file output, or */
+	int sock;	/* socket output */
+	struct sockaddr_un addr;
+};
+
+static int
+shm_output_open(struct shm_output *const out, const char *const dest)
+{
+	const char *sockname = NULL;
+
+	out->fp = NULL;
+	out->sock = -1;
+	if(!strcmp(dest, "syslog:"))
+		sockname = "/dev/log";
+	else if(!strncmp(dest, "uxsock:", 7))
+		sockname = dest + 7;
+	if(sockname != NULL) {
+		memset(&out->addr, 0, sizeof(out->addr));
+		out->addr.sun_family = AF_UNIX;
+		strncpy(out->addr.sun_path, sockname, sizeof(out->addr.sun_path) - 1);
+		out->sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+		return (out->sock < 0) ? -1 : 0;
+	}
+	out->fp = strcmp(dest, "-") ? fopen(dest, "a") : stdout;
+	return (out->fp == NULL) ? -1 : 0;
+}
+
+static void
+shm_output_write(struct shm_output *const out, const char *const frame,
+	const size_t len)
+{
+	if(out->fp != NULL) {
+		fwrite(frame, 1, len, out->fp);
+		putc('\n', out->fp);
+	} else {
+		sendto(out->sock, frame, len, 0, (struct sockaddr*) &out->addr,
+			sizeof(out->addr));
+	}
+}
+
+/* Drains the ring until we are told to stop. A slot that was claimed,
+ * but not published for SHM_STUCK_MS, is skipped and marked abandoned,
+ * as its producer may have died (see shmring.h).
+ */
+static int
+shm_collect(const char *const name, const char *const dest,
+	const uint32_t nslots, const uint32_t msgsize)
+{
+	char objname[256];
+	struct shm_ring ring;
+	struct __stdlog_shm_hdr *hdr;
+	struct __stdlog_shm_slot *slot;
+	struct shm_output out;
+	struct sigaction sa;
+	uint64_t pos;
+	uint64_t seq;
+	uint64_t expected;
+	uint32_t len;
+	uint64_t nmsgs = 0;
+	uint64_t ndropped;
+	int64_t stuck = 0;	/* ms, when we began to wait for the slot */
+
+	snprintf(objname, sizeof(objname), "%s%s", __STDLOG_SHM_PREFIX, name);
+	if(strchr(name, '/') != NULL || shm_setup(objname, nslots, msgsize, &ring) != 0) {
+		fprintf(stderr, "stdlogctl: cannot set up ring %s: %s\n", objname,
+			strchr(name, '/') != NULL ? strerror(EINVAL) : strerror(errno));
+		return 1;
+	}
+	hdr = ring.hdr;
+	if(shm_output_open(&out, dest) != 0) {
+		perror(dest);
+		return 1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;	/* no SA_RESTART, to interrupt the sleep */
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pos = hdr->deq_pos;
+	ndropped = hdr->ndropped; /* only report new drops */
+	while(!stop) {
+		slot = __STDLOG_SHM_SLOT(hdr, pos, ring.capacity, ring.stride);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if(seq == pos + 1) {
+			len = slot->len;
+			shm_output_write(&out, slot->data,
+				(len < ring.msgsize) ? len : ring.msgsize);
+			__atomic_store_n(&slot->seq, pos + ring.capacity, __ATOMIC_RELEASE);
+			__atomic_store_n(&hdr->deq_pos, ++pos, __ATOMIC_RELAXED);
+			++nmsgs;
+			stuck = 0;
+			continue;
+		}
+		if(__atomic_load_n(&hdr->enq_pos, __ATOMIC_ACQUIRE) > pos) {
+			if(seq == (pos | __STDLOG_SHM_ABANDONED)) {
+				/* producers passed over it, so do we */
+				expected = seq;
+				if(__atomic_compare_exchange_n(&slot->seq, &expected,
+				       (pos + ring.capacity) | __STDLOG_SHM_ABANDONED, 0,
+				       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+					__atomic_store_n(&hdr->deq_pos, ++pos, __ATOMIC_RELAXED);
+				stuck = 0;
+				continue;
+			}
+			/* claimed, but not yet published */
+			if(stuck == 0) {
+				stuck = now_ms();
+			} else if(now_ms() - stuck > SHM_STUCK_MS) {
+				expected = pos;
+				if(__atomic_compare_exchange_n(&slot->seq, &expected,
+				       (pos + ring.capacity) | __STDLOG_SHM_ABANDONED, 0,
+				       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+					__atomic_add_fetch(&hdr->nskipped, 1, __ATOMIC_RELAXED);
+					__atomic_store_n(&hdr->deq_pos, ++pos, __ATOMIC_RELAXED);
+				}
+				stuck = 0;
+			}
+			sched_yield();
+			continue;
+		}
+
+		/* ring is empty, go to sleep -- but re-check after announcing
+		 * it, a producer may have published in the meantime.
+		 */
+		if(out.fp != NULL)
+			fflush(out.fp);
+		if(__atomic_load_n(&hdr->ndropped, __ATOMIC_RELAXED) != ndropped) {
+			ndropped = __atomic_load_n(&hdr->ndropped, __ATOMIC_RELAXED);
+			fprintf(stderr, "stdlogctl: %llu messages dropped so far, "
+				"ring was full\n", (unsigned long long) ndropped);
+		}
+		__atomic_store_n(&hdr->sleeping, 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == pos + 1
+		   || __atomic_load_n(&hdr->enq_pos, __ATOMIC_SEQ_CST) > pos) {
+			__atomic_store_n(&hdr->sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		__stdlog_shm_sleep(hdr, SHM_IDLE_MS);
+	}
+
+	if(out.fp != NULL)
+		fflush(out.fp);
+	fprintf(stderr, "stdlogctl: %llu messages read, %llu dropped by loggers, "
+		"%llu skipped\n", (unsigned long long) nmsgs,
+		(unsigned long long) hdr->ndropped, (unsigned long long) hdr->nskipped);
+	return 0;
+}
+
+/* Copies the counters from a statistics page. It may stem from a
+ * process with a different struct stdlog_stats: we take what both have
+ * and leave the rest zero.
+ */
+static int
+stats_read(const char *const objname, struct stdlog_stats *const stats,
+	int *const pid, char *const spec, const size_t lenspec)
+{
+	struct __stdlog_stats_page *page;
+	struct stat st;
+	const uint64_t *src;
+	size_t len;
+	size_t i;
+	int fd;
+
+	if((fd = shm_open(objname, O_RDONLY, 0)) < 0)
+		return -1;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) offsetof(struct __stdlog_stats_page, stats)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	page = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(page == MAP_FAILED)
+		return -1;
+	if(   __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != __STDLOG_STATS_MAGIC
+	   || page->version != __STDLOG_STATS_VERSION) {
+		munmap(page, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	len = page->lenstats;
+	if(len > sizeof(struct stdlog_stats))
+		len = sizeof(struct stdlog_stats);
+	if(len > st.st_size - offsetof(struct __stdlog_stats_page, stats))
+		len = st.st_size - offsetof(struct __stdlog_stats_page, stats);
+	memset(stats, 0, sizeof(struct stdlog_stats));
+	src = (const uint64_t *) &page->stats;
+	for(i = 0 ; i < len / sizeof(uint64_t) ; ++i)
+		((uint64_t *) stats)[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	*pid = page->pid;
+	snprintf(spec, lenspec, "%.*s", (int) sizeof(page->spec), page->spec);
+	munmap(page, st.st_size);
+	return 0;
+}
+
+static void
+stats_print_ns(const uint64_t ns)
+{
+	if(ns < 1000)
+		printf("%4lluns", (unsigned long long) ns);
+	else if(ns < 1000000)
+		printf("%4.0fus", ns / 1000.0);
+	else
+		printf("%4.0fms", ns / 1000000.0);
+}
+
+static void
+stats_print(const struct stdlog_stats *const stats, const double secs,
+	const struct stdlog_stats *const prev)
+{
+	int i;
+
+	printf("\tmessages....: %llu", (unsigned long long) stats->msgs);
+	if(prev != NULL)
+		printf(" (%.0f/s)", (stats->msgs - prev->msgs) / secs);
+	printf("\n\tbytes.......: %llu", (unsigned long long) stats->bytes);
+	if(prev != NULL)
+		printf(" (%.0f/s)", (stats->bytes - prev->bytes) / secs);
+	printf("\n\tsyscalls....: %llu\n", (unsigned long long) stats->syscalls);
+	printf("\ttruncated...: %llu\n", (unsigned long long) stats->truncated);
+	printf("\toutput full.: %llu\n", (unsigned long long) stats->eagain);
+	printf("\terrors......: %llu\n", (unsigned long long) stats->errors);
+	for(i = 0 ; i < STDLOG_STATS_NERRNO ; ++i) {
+		if(stats->errnos[i] == 0)
+			continue;
+		if(i == STDLOG_STATS_NERRNO - 1)
+			printf("\t  errno >= %d: %llu\n", i, (unsigned long long) stats->errnos[i]);
+		else
+			printf("\t  %s: %llu\n", strerror(i), (unsigned long long) stats->errnos[i]);
+	}
+	printf("\tlatency of sampled calls:\n");
+	for(i = 0 ; i < STDLOG_STATS_NLATENCY ; ++i) {
+		if(stats->latency[i] == 0)
+			continue;
+		if(i == STDLOG_STATS_NLATENCY - 1) {
+			printf("\t  >= ");
+			stats_print_ns(STDLOG_STATS_LATENCY_NS(i - 1));
+		} else {
+			printf("\t  <  ");
+			stats_print_ns(STDLOG_STATS_LATENCY_NS(i));
+		}
+		printf(": %llu\n", (unsigned long long) stats->latency[i]);
+	}
+}
+
+/* Returns the "statsshm=" name of the default channel spec, or NULL. */
+static const char *
+stats_dflt_name(char *const buf, const size_t lenbuf)
+{
+	const char *spec = getenv("LIBLOGGING_STDLOG_DFLT_LOG_CHANNEL");
+	const char *p;
+	size_t len;
+
+	if(spec == NULL)
+		return NULL;
+	for(p = spec ; *p != '\0' && *p != ':' ; ++p) {
+		if(*p == ',' && !strncmp(p + 1, "statsshm=", 9)) {
+			p += 10;
+			len = strcspn(p, ",:");
+			if(len == 0 || len >= lenbuf)
+				return NULL;
+			memcpy(buf, p, len);
+			buf[len] = '\0';
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+/* Shows the statistics of a channel that publishes them with
+ * "statsshm=name". With an interval, repeats until terminated and
+ * adds rates.
+ */
+static int
+stats_show(const char *name, const int interval)
+{
+	char namebuf[201];
+	char objname[256];
+	char spec[256];
+	struct stdlog_stats stats;
+	struct stdlog_stats prev;
+	struct sigaction sa;
+	int pid;
+	int n;
+
+	if(name == NULL && (name = stats_dflt_name(namebuf, sizeof(namebuf))) == NULL) {
+		fprintf(stderr, "stdlogctl: the default channel does not publish "
+			"statistics, add \"statsshm=name\" to "
+			"LIBLOGGING_STDLOG_DFLT_LOG_CHANNEL\n");
+		return 1;
+	}
+	snprintf(objname, sizeof(objname), "%s%s", __STDLOG_STATS_PREFIX, name);
+	memset(&prev, 0, sizeof(prev));
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	for(n = 0 ; !stop ; ++n) {
+		if(strchr(name, '/') != NULL
+		   || stats_read(objname, &stats, &pid, spec, sizeof(spec)) != 0) {
+			fprintf(stderr, "stdlogctl: cannot read statistics %s: %s\n",
+				objname, strchr(name, '/') != NULL ? strerror(EINVAL)
+				: strerror(errno));
+			return 1;
+		}
+		printf("statistics \"%s\", channel \"%s\", pid %d%s:\n", name, spec,
+			pid, (kill(pid, 0) != 0 && errno == ESRCH) ? " (exited)" : "");
+		stats_print(&stats, interval, n > 0 ? &prev : NULL);
+		fflush(stdout);
+		if(interval == 0)
+			break;
+		prev = stats;
+		sleep(interval);
+	}
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: stdlogctl\n"
+	                "       stdlogctl shm [-s slots] [-m msgsize] name [file|-|syslog:|uxsock:path]\n"
+	                "       stdlogctl stats [-i seconds] [name]\n");
+	exit(1);
+}
 
 int
-main(int __attribute__((unused)) argc, char __attribute__((unused)) *argv[])
+main(int argc, char *argv[])
 {
+	uint32_t nslots = __STDLOG_SHM_DFLT_SLOTS;
+	uint32_t msgsize = __STDLOG_SHM_DFLT_MSGSIZE;
+	int interval = 0;
+	int opt;
+
+	if(argc > 1 && !strcmp(argv[1], "shm")) {
+		optind = 2;
+		while((opt = getopt(argc, argv, "s:m:")) != -1) {
+			if(opt == 's' && atol(optarg) > 0 && atol(optarg) <= (1 << 24))
+				nslots = atol(optarg);
+			else if(opt == 'm' && atol(optarg) >= 64 && atol(optarg) <= (1 << 20))
+				msgsize = atol(optarg);
+			else
+				usage();
+		}
+		if(optind != argc - 1 && optind != argc - 2)
+			usage();
+		return shm_collect(argv[optind], (optind == argc - 2) ? argv[optind + 1]
+			: "syslog:", nslots, msgsize);
+	} else if(argc > 1 && !strcmp(argv[1], "stats")) {
+		optind = 2;
+		while((opt = getopt(argc, argv, "i:")) != -1) {
+			if(opt == 'i' && atoi(optarg) > 0)
+				interval = atoi(optarg);
+			else
+				usage();
+		}
+		if(optind < argc - 1)
+			usage();
+		return stats_show((optind == argc - 1) ? argv[optind] : NULL, interval);
+	} else if(argc > 1) {
+		usage();
+	}
+
 	printf("liblogging-stdlog version %s:\n", stdlog_version());
 
 	stdlog_init(0);
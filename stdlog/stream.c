@@ -0,0 +1,484 @@
+/* The stdlog stream socket drivers.
+ *
+ * Sends syslog frames over a SOCK_STREAM unix ("uxstream:") or TCP
+ * ("tcp:") socket, using the octet-counting framing of RFC 6587
+ * ("<length> <frame>"). As the frame length is sent along, frames need
+ * not be limited to the size of a datagram or of the caller's work
+ * buffer: messages are formatted straight into a per-channel buffer,
+ * so they may be up to "maxmsg=" bytes long. The buffer also collects
+ * frames until it is full, the flush interval passes or a message of
+ * the flush severity is logged, so many messages go out with one
+ * send() call.
+ *
+ * If the connection breaks, the driver reconnects at once and sends
+ * the frame that was cut off again, so the receiver sees no partial
+ * frames on the new connection. If the receiver is not reachable,
+ * frames stay in the buffer and connecting is retried after
+ * "reconnectms=" milliseconds, a pause that doubles with each failed
+ * attempt up to STRM_MAX_RECONNECTMS; messages that do not fit into
+ * the buffer then are dropped.
+ *
+ * A "tcp:" channel never waits for the network: the socket is
+ * non-blocking, connecting completes in the background (we check for
+ * it whenever we want to send) and what the socket does not take stays
+ * in the buffer for the next flush. So the buffer is a bounded queue
+ * in front of a slow or unreachable server, and logging only fails if
+ * it is full. A "uxstream:" channel waits for the local receiver when
+ * logging, but the periodic flush never does: it runs on the ticker
+ * thread shared by all channels, so it only sends what the socket takes
+ * right away and leaves the rest to the next log call or tick.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define STRM_DFLT_MAXMSG (64*1024)	/* default max frame size */
+#define STRM_DFLT_BUFSIZE (256*1024)
+#define STRM_MAX_BUFSIZE (64*1024*1024)	/* sanity limit for buffer size */
+#define STRM_DFLT_FLUSHMS 100
+#define STRM_DFLT_RECONNECTMS 1000
+#define STRM_MAX_RECONNECTMS 30000	/* reconnect pause doubles up to this */
+#define STRM_CLOSE_WAITMS 1000	/* "tcp:": max time to drain buffer at close */
+#define STRM_LOCK_SPINS 1000	/* sigsafe mode: max tries to get buffer lock */
+#define STRM_LENPREFIX 11	/* room for the octet count: 10 digits + SP */
+
+#define STRM_IS_FULL(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0	/* SO_NOSIGPIPE is used instead, if available */
+#endif
+
+static int64_t
+strm_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* schedules the next connect attempt, backing off exponentially */
+static void
+strm_connect_failed(stdlog_channel_t ch, const int64_t now)
+{
+	ch->d.strm.nextconnect = now + ch->d.strm.backoffms;
+	ch->d.strm.backoffms = (ch->d.strm.backoffms > STRM_MAX_RECONNECTMS / 2)
+		? STRM_MAX_RECONNECTMS : 2 * ch->d.strm.backoffms;
+}
+
+/* Checks if a non-blocking connect has completed. Returns 0 if we are
+ * connected, -1 otherwise.
+ */
+static int
+strm_connect_check(stdlog_channel_t ch)
+{
+	struct pollfd pfd;
+	socklen_t len = sizeof(int);
+	int err = 0;
+	int n;
+
+	pfd.fd = ch->d.strm.sock;
+	pfd.events = POLLOUT;
+	if((n = poll(&pfd, 1, 0)) == 0 || (n == -1 && errno == EINTR)) {
+		errno = ENOTCONN;
+		return -1;
+	}
+	if(n == -1 || getsockopt(ch->d.strm.sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+		err = errno;
+	if(err != 0) {
+		close(ch->d.strm.sock);
+		ch->d.strm.sock = -1;
+		ch->d.strm.connecting = 0;
+		strm_connect_failed(ch, strm_now());
+		errno = err;
+		return -1;
+	}
+	ch->d.strm.connecting = 0;
+	ch->d.strm.backoffms = ch->d.strm.reconnectms;
+	return 0;
+}
+
+/* must be called with the buffer mutex locked */
+static int
+strm_connect_locked(stdlog_channel_t ch)
+{
+	int64_t now;
+	int sock;
+	int one = 1;
+
+	if(ch->d.strm.sock >= 0)
+		return ch->d.strm.connecting ? strm_connect_check(ch) : 0;
+	now = strm_now();
+	if(now < ch->d.strm.nextconnect) {
+		errno = ENOTCONN;
+		return -1;
+	}
+	__STDLOG_STATS_ADD(ch, syscalls, 1);
+	if((sock = socket(ch->d.strm.addr.ss_family, SOCK_STREAM, 0)) < 0)
+		goto fail;
+#	ifdef SO_NOSIGPIPE
+	setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#	endif
+	if(ch->d.strm.nonblock) {
+		/* we do our own coalescing, do not let Nagle delay flushes */
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	}
+	ch->d.strm.sent = 0;
+	if(connect(sock, (struct sockaddr*) &ch->d.strm.addr, ch->d.strm.lenaddr) != 0) {
+		int errnosv = errno;
+		if(errnosv == EINPROGRESS && ch->d.strm.nonblock) {
+			ch->d.strm.sock = sock;
+			ch->d.strm.connecting = 1;
+			errno = ENOTCONN;
+			return -1;
+		}
+		close(sock);
+		errno = errnosv;
+		goto fail;
+	}
+	ch->d.strm.sock = sock;
+	ch->d.strm.backoffms = ch->d.strm.reconnectms;
+	return 0;
+
+fail:
+	strm_connect_failed(ch, now);
+	return -1;
+}
+
+/* Returns the offset of the frame containing byte off of the buffer.
+ * Frames are walked from the start, using their octet counts.
+ */
+static size_t
+strm_frame_start(stdlog_channel_t ch, const size_t off)
+{
+	const char *const buf = ch->d.strm.buf;
+	size_t start = 0;
+	size_t end;
+	size_t len;
+
+	while(1) {
+		len = 0;
+		for(end = start ; buf[end] != ' ' ; ++end)
+			len = len * 10 + buf[end] - '0';
+		end += 1 + len;
+		if(end > off)
+			return start;
+		start = end;
+	}
+}
+
+/* Removes the completely sent frames from the buffer, so that it
+ * starts with the first frame not yet (fully) sent. Must be called
+ * with the buffer mutex locked.
+ */
+static void
+strm_trim_sent(stdlog_channel_t ch)
+{
+	const size_t done = (ch->d.strm.sent == ch->d.strm.used) ? ch->d.strm.used
+		: strm_frame_start(ch, ch->d.strm.sent);
+
+	if(done > 0) {
+		memmove(ch->d.strm.buf, ch->d.strm.buf + done, ch->d.strm.used - done);
+		ch->d.strm.used -= done;
+		ch->d.strm.sent -= done;
+	}
+}
+
+/* Sends the buffered frames. Those not yet sent are kept for the next
+ * try. A frame may be sent partly if the socket is non-blocking or
+ * dontwait is set; it stays in the buffer until it is complete, so
+ * that it can be sent again if the connection breaks. The buffer thus
+ * always starts with a frame. Must be called with the buffer mutex
+ * locked.
+ */
+static int
+strm_flush_locked(stdlog_channel_t ch, const int dontwait)
+{
+	ssize_t lsent;
+	int reconnected = 0;
+	int r = 0;
+
+	while(ch->d.strm.sent < ch->d.strm.used) {
+		if(dontwait && !ch->d.strm.nonblock && ch->d.strm.sock < 0) {
+			r = -1; /* connecting a blocking socket may wait */
+			break;
+		}
+		if(strm_connect_locked(ch) != 0) {
+			r = -1;
+			break;
+		}
+		__STDLOG_STATS_ADD(ch, syscalls, 1);
+		lsent = send(ch->d.strm.sock, ch->d.strm.buf + ch->d.strm.sent,
+			ch->d.strm.used - ch->d.strm.sent,
+			MSG_NOSIGNAL | (dontwait ? MSG_DONTWAIT : 0));
+		if(lsent > 0) {
+			__STDLOG_STATS_ADD(ch, bytes, lsent);
+			if((size_t) lsent < ch->d.strm.used - ch->d.strm.sent)
+				__STDLOG_STATS_ADD(ch, eagain, 1);
+			ch->d.strm.sent += lsent;
+			continue;
+		}
+		if(lsent == -1 && errno == EINTR)
+			continue;
+		if(lsent == -1 && STRM_IS_FULL(errno)) {
+			__STDLOG_STATS_ADD(ch, eagain, 1);
+			r = -1;
+			break;
+		}
+		/* connection lost: drop the frames the old connection took and
+		 * start over with the frame that was cut off
+		 */
+		close(ch->d.strm.sock);
+		ch->d.strm.sock = -1;
+		strm_trim_sent(ch);
+		ch->d.strm.sent = 0;
+		if(reconnected++) {
+			r = -1;
+			break;
+		}
+		ch->d.strm.nextconnect = 0;
+	}
+	strm_trim_sent(ch);
+	return r;
+}
+
+/* Sends what is buffered at close. A non-blocking socket gets up to
+ * STRM_CLOSE_WAITMS to take it, also to complete a pending connect.
+ */
+static void
+strm_drain_locked(stdlog_channel_t ch)
+{
+	const int64_t deadline = strm_now() + STRM_CLOSE_WAITMS;
+	struct pollfd pfd;
+	int64_t left;
+
+	while(strm_flush_locked(ch, 0) != 0 && ch->d.strm.nonblock
+	      && ch->d.strm.sock >= 0 && (left = deadline - strm_now()) > 0) {
+		pfd.fd = ch->d.strm.sock;
+		pfd.events = POLLOUT;
+		poll(&pfd, 1, (int) left);
+	}
+}
+
+static int
+strm_flush(stdlog_channel_t ch)
+{
+	int r;
+
+	pthread_mutex_lock(&ch->d.strm.mut);
+	r = strm_flush_locked(ch, 0);
+	pthread_mutex_unlock(&ch->d.strm.mut);
+	return r;
+}
+
+/* The periodic flush, called by the ticker thread. It must not block
+ * the other channels' ticks: if a log call holds the buffer, it will
+ * flush itself, and a "uxstream:" channel is neither (re)connected nor
+ * waited for here.
+ */
+static int
+strm_tick(stdlog_channel_t ch)
+{
+	int r;
+
+	if(pthread_mutex_trylock(&ch->d.strm.mut) != 0)
+		return 0;
+	r = strm_flush_locked(ch, 1);
+	pthread_mutex_unlock(&ch->d.strm.mut);
+	return r;
+}
+
+static int
+strm_init(stdlog_channel_t ch)
+{
+	int64_t maxmsg;
+	int64_t lenbuf;
+	int flushms;
+
+	ch->d.strm.sock = -1;
+	ch->d.strm.connecting = 0;
+	memset(&ch->d.strm.addr, 0, sizeof(ch->d.strm.addr));
+	if(__stdlog_chanspec_is(ch->spec, "tcp")) {
+		if(__stdlog_chanspec_resolve(ch->spec, SOCK_STREAM,
+		                             &ch->d.strm.addr, &ch->d.strm.lenaddr) != 0)
+			return -1;
+		__stdlog_hdr_init_host(ch);
+		ch->d.strm.nonblock = 1;
+	} else {
+		struct sockaddr_un *const uaddr = (struct sockaddr_un*) &ch->d.strm.addr;
+		uaddr->sun_family = AF_UNIX;
+		strncpy(uaddr->sun_path, __stdlog_chanspec_arg(ch->spec),
+			sizeof(uaddr->sun_path) - 1);
+		ch->d.strm.lenaddr = sizeof(struct sockaddr_un);
+		ch->d.strm.nonblock = 0;
+	}
+
+	maxmsg = __stdlog_chanspec_param_int(ch->spec, "maxmsg", STRM_DFLT_MAXMSG);
+	ch->maxmsg = 0; /* we format large messages ourselves */
+	if(maxmsg < __STDLOG_MSGBUF_SIZE)
+		maxmsg = __STDLOG_MSGBUF_SIZE;
+	if(maxmsg > STRM_MAX_BUFSIZE - STRM_LENPREFIX - 1)
+		maxmsg = STRM_MAX_BUFSIZE - STRM_LENPREFIX - 1;
+	lenbuf = __stdlog_chanspec_param_int(ch->spec, "bufsize", STRM_DFLT_BUFSIZE);
+	if(lenbuf > STRM_MAX_BUFSIZE)
+		lenbuf = STRM_MAX_BUFSIZE;
+	if(lenbuf < STRM_LENPREFIX + maxmsg + 1)
+		lenbuf = STRM_LENPREFIX + maxmsg + 1;
+	flushms = __stdlog_chanspec_param_int(ch->spec, "flushms", STRM_DFLT_FLUSHMS);
+	ch->d.strm.flushsev = __stdlog_chanspec_param_sev(ch->spec, "flushsev", STDLOG_ERR);
+	ch->d.strm.reconnectms = __stdlog_chanspec_param_int(ch->spec, "reconnectms",
+		STRM_DFLT_RECONNECTMS);
+	if(ch->d.strm.reconnectms < 1)
+		ch->d.strm.reconnectms = 1;
+	if(ch->d.strm.reconnectms > STRM_MAX_RECONNECTMS)
+		ch->d.strm.reconnectms = STRM_MAX_RECONNECTMS;
+	ch->d.strm.backoffms = ch->d.strm.reconnectms;
+	ch->d.strm.nextconnect = 0;
+	ch->d.strm.maxmsg = maxmsg;
+	ch->d.strm.lenbuf = lenbuf;
+	ch->d.strm.used = 0;
+	ch->d.strm.sent = 0;
+	if((ch->d.strm.buf = malloc(lenbuf)) == NULL) {
+		errno = ENOMEM;
+		goto fail;
+	}
+	pthread_mutex_init(&ch->d.strm.mut, NULL);
+	if(flushms > 0 && __stdlog_ticker_register(ch, flushms, strm_tick) != 0) {
+		pthread_mutex_destroy(&ch->d.strm.mut);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	free(ch->d.strm.buf);
+	return -1;
+}
+
+static void
+strm_open(stdlog_channel_t ch)
+{
+	pthread_mutex_lock(&ch->d.strm.mut);
+	strm_connect_locked(ch);
+	pthread_mutex_unlock(&ch->d.strm.mut);
+}
+
+static void
+strm_close(stdlog_channel_t ch)
+{
+	__stdlog_ticker_unregister(ch, strm_tick);
+	pthread_mutex_lock(&ch->d.strm.mut);
+	strm_drain_locked(ch);
+	pthread_mutex_unlock(&ch->d.strm.mut);
+	pthread_mutex_destroy(&ch->d.strm.mut);
+	if(ch->d.strm.sock >= 0) {
+		close(ch->d.strm.sock);
+		ch->d.strm.sock = -1;
+	}
+	free(ch->d.strm.buf);
+}
+
+/* Formats the frame right into the buffer, behind room for the octet
+ * count. The count is then put in front of it, and both are moved
+ * down to close the gap to the previous frame. The work buffer is not
+ * needed.
+ */
+static int
+strm_log(stdlog_channel_t ch, int severity,
+	const char *fmt, va_list ap,
+	char __attribute__((unused)) *__restrict__ const wrkbuf,
+	const size_t __attribute__((unused)) buflen)
+{
+	char *frame;
+	size_t lenframe;
+	char lenstr[STRM_LENPREFIX];
+	int lenprefix = 0;
+	int spins = 0;
+	int r = 0;
+
+	if(ch->options & STDLOG_SIGSAFE) {
+		while(pthread_mutex_trylock(&ch->d.strm.mut) != 0) {
+			if(++spins >= STRM_LOCK_SPINS) {
+				errno = EAGAIN;
+				return -1;
+			}
+		}
+	} else {
+		pthread_mutex_lock(&ch->d.strm.mut);
+	}
+
+	if(ch->d.strm.lenbuf - ch->d.strm.used < STRM_LENPREFIX + ch->d.strm.maxmsg + 1) {
+		r = strm_flush_locked(ch, 0);
+		if(ch->d.strm.lenbuf - ch->d.strm.used < STRM_LENPREFIX + ch->d.strm.maxmsg + 1) {
+			r = -1; /* receiver gone or too slow, buffer full: drop message */
+			goto done;
+		}
+		if(ch->d.strm.nonblock)
+			r = 0;
+	}
+	frame = ch->d.strm.buf + ch->d.strm.used + STRM_LENPREFIX;
+	lenframe = __stdlog_build_syslog_frame(ch, severity, frame,
+		ch->d.strm.maxmsg + 1, fmt, ap); /* + 1 for the '\0' */
+	__stdlog_fmt_print_int(lenstr, sizeof(lenstr), &lenprefix, lenframe);
+	lenstr[lenprefix++] = ' ';
+	memmove(ch->d.strm.buf + ch->d.strm.used + lenprefix, frame, lenframe);
+	memcpy(ch->d.strm.buf + ch->d.strm.used, lenstr, lenprefix);
+	ch->d.strm.used += lenprefix + lenframe;
+	/* start connecting early, so we are connected when it is time to flush */
+	if(ch->d.strm.sock < 0)
+		strm_connect_locked(ch);
+	/* a non-blocking socket may take the frame later, it is queued */
+	if(severity <= ch->d.strm.flushsev)
+		r = (strm_flush_locked(ch, 0) == 0 || ch->d.strm.nonblock) ? 0 : -1;
+
+done:	pthread_mutex_unlock(&ch->d.strm.mut);
+	return r;
+}
+
+void
+__stdlog_set_strm_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = strm_init;
+	ch->drvr.open = strm_open;
+	ch->drvr.close = strm_close;
+	ch->drvr.log = strm_log;
+	ch->drvr.flush = strm_flush;
+}
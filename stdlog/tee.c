@@ -0,0 +1,211 @@
+/* The stdlog tee driver. It fans messages out to several child
+ * channels, given in the driver argument separated by '|', e.g.
+ * "tee:file:/var/log/app.log|syslog:". The message text is formatted
+ * only once, and the time is pinned for the children, so that all of
+ * them log the same text with the same timestamp. Each child only
+ * adds its own header. Children are regular channels, so each one
+ * can be given its own severity filter via the "upto=" parameter.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+#include "stdlog.h"
+
+#define TEE_HDRSIZE 128	/* room for a child's header, in addition to tag */
+
+static void
+tee_free(stdlog_channel_t ch)
+{
+	int i;
+
+	for(i = 0 ; i < ch->d.tee.nchildren ; ++i)
+		stdlog_close(ch->d.tee.children[i]);
+	free(ch->d.tee.children);
+	ch->d.tee.children = NULL;
+	ch->d.tee.nchildren = 0;
+}
+
+static int
+tee_init(stdlog_channel_t ch)
+{
+	const char *spec = __stdlog_chanspec_arg(ch->spec);
+	const char *end;
+	char *childspec;
+	stdlog_channel_t child;
+	int n;
+	int r;
+
+	for(n = 1, end = spec ; (end = strchr(end, '|')) != NULL ; ++end)
+		++n;
+	if((ch->d.tee.children = calloc(n, sizeof(stdlog_channel_t))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	while(1) {
+		if((end = strchr(spec, '|')) == NULL)
+			end = spec + strlen(spec);
+		if((childspec = strndup(spec, end - spec)) == NULL) {
+			errno = ENOMEM;
+			goto fail;
+		}
+		child = stdlog_open(ch->ident, ch->options, ch->facility, childspec);
+		free(childspec);
+		if(child == NULL)
+			goto fail;
+		ch->d.tee.children[ch->d.tee.nchildren++] = child;
+		if(*end == '\0')
+			break;
+		spec = end + 1;
+	}
+	return 0;
+
+fail:
+	r = errno;
+	tee_free(ch);
+	errno = r;
+	return -1;
+}
+
+static void
+tee_open(stdlog_channel_t ch)
+{
+	int i;
+
+	for(i = 0 ; i < ch->d.tee.nchildren ; ++i)
+		ch->d.tee.children[i]->drvr.open(ch->d.tee.children[i]);
+}
+
+static void
+tee_close(stdlog_channel_t ch)
+{
+	tee_free(ch);
+}
+
+static int
+tee_flush(stdlog_channel_t ch)
+{
+	int r = 0;
+	int i;
+
+	for(i = 0 ; i < ch->d.tee.nchildren ; ++i)
+		if(stdlog_flush(ch->d.tee.children[i]) != 0)
+			r = -1;
+	return r;
+}
+
+static int
+tee_reopen(stdlog_channel_t ch)
+{
+	int r = 0;
+	int i;
+
+	for(i = 0 ; i < ch->d.tee.nchildren ; ++i)
+		if(stdlog_reopen(ch->d.tee.children[i]) != 0)
+			r = -1;
+	return r;
+}
+
+/* The text is formatted into the caller's work buffer, the children
+ * get one of their own. That is on the stack, unless the caller's work
+ * buffer is larger than usual ("maxmsg=" or stdlog_log_b()); then it
+ * is allocated, except in signal-safe mode, where the children's
+ * messages may be truncated instead. Returns -1 if any child failed.
+ */
+static int
+tee_log_fields(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	char chbuf[__STDLOG_MSGBUF_SIZE];
+	char *chwrkbuf = chbuf;
+	size_t lenchwrkbuf = sizeof(chbuf);
+	const time_t pinned = __stdlog_pinned_time;
+	stdlog_channel_t child;
+	int r = 0;
+	int i;
+
+	ch->f_vsnprintf(wrkbuf, buflen, fmt, ap);
+	if(buflen > sizeof(chbuf) && !(ch->options & STDLOG_SIGSAFE)
+	   && (chwrkbuf = malloc(buflen + TEE_HDRSIZE + ch->hdr.lentagbuf)) != NULL) {
+		lenchwrkbuf = buflen + TEE_HDRSIZE + ch->hdr.lentagbuf;
+	} else {
+		chwrkbuf = chbuf;
+	}
+
+	if(pinned == 0)
+		__stdlog_pinned_time = time(NULL);
+	for(i = 0 ; i < ch->d.tee.nchildren ; ++i) {
+		child = ch->d.tee.children[i];
+		if(!(__atomic_load_n(&child->pub.logmask, __ATOMIC_RELAXED)
+		     & STDLOG_MASK(severity)))
+			continue;
+		if(__stdlog_drvr_log_msg_kv(child, severity, chwrkbuf, lenchwrkbuf, wrkbuf,
+		                            fields, nfields) != 0)
+			r = -1;
+	}
+	__stdlog_pinned_time = pinned;
+
+	if(chwrkbuf != chbuf)
+		free(chwrkbuf);
+	return r;
+}
+
+static int
+tee_log(stdlog_channel_t ch, const int severity,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	return tee_log_fields(ch, severity, NULL, 0, fmt, ap, wrkbuf, buflen);
+}
+
+/* structured data fields are passed on, so each child renders them */
+static int
+tee_log_kv(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	return tee_log_fields(ch, severity, fields, nfields, fmt, ap, wrkbuf, buflen);
+}
+
+void
+__stdlog_set_tee_drvr(stdlog_channel_t ch)
+{
+	ch->drvr.init = tee_init;
+	ch->drvr.open = tee_open;
+	ch->drvr.close = tee_close;
+	ch->drvr.log = tee_log;
+	ch->drvr.log_kv = tee_log_kv;
+	ch->drvr.flush = tee_flush;
+	ch->drvr.reopen = tee_reopen;
+}
@@ -1,8 +1,578 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "stdlog.h"
 
+#define STRESS_MSGS 1000	/* messages per thread and channel */
+
+struct stress_ctx {
+	stdlog_channel_t ch;
+	pthread_barrier_t start;
+	int nerr_dflt;
+	int nerr_chan;
+};
+
+static int
+count_fds(void)
+{
+	int fd;
+	int n = 0;
+
+	for(fd = 0 ; fd < 1024 ; ++fd)
+		if(fcntl(fd, F_GETFD) != -1)
+			++n;
+	return n;
+}
+
+static void *
+stress_thread(void *arg)
+{
+	struct stress_ctx *ctx = (struct stress_ctx *) arg;
+	int nerr_dflt = 0;
+	int nerr_chan = 0;
+	int i;
+
+	pthread_barrier_wait(&ctx->start);
+	for(i = 0 ; i < STRESS_MSGS ; ++i) {
+		if(stdlog_log(NULL, STDLOG_INFO, "stress dflt %d", i) != 0)
+			++nerr_dflt;
+		if(stdlog_log(ctx->ch, STDLOG_INFO, "stress chan %d", i) != 0)
+			++nerr_chan;
+	}
+	__atomic_add_fetch(&ctx->nerr_dflt, nerr_dflt, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ctx->nerr_chan, nerr_chan, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/* returns the output file of chanspec, looking through "async:" and
+ * "deferred:", or NULL if the channel does not write to a file.
+ * *exclusive is set if only one channel may write to the file.
+ */
+static const char *
+stress_file(const char *chanspec, int *const exclusive)
+{
+	*exclusive = 0;
+	while(   (!strncmp(chanspec, "async", 5) && strchr(":,", chanspec[5]))
+	      || (!strncmp(chanspec, "deferred", 8) && strchr(":,", chanspec[8])))
+		if((chanspec = strchr(chanspec, ':')) == NULL)
+			return NULL;
+		else
+			++chanspec;
+	if(!strncmp(chanspec, "mmapfile", 8) && strchr(":,", chanspec[8]))
+		*exclusive = 1;	/* it locks the file */
+	if(   (!strncmp(chanspec, "file", 4) && strchr(":,", chanspec[4]))
+	   || *exclusive)
+		return (chanspec = strchr(chanspec, ':')) == NULL ? NULL : chanspec + 1;
+	return NULL;
+}
+
+/* counts the stress messages in file fname */
+static void
+stress_count(const char *fname, int *const ndflt, int *const nchan)
+{
+	char line[1024];
+	FILE *fp;
+
+	*ndflt = *nchan = 0;
+	if((fp = fopen(fname, "r")) == NULL)
+		return;
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		if(strstr(line, "stress dflt ") != NULL)
+			++*ndflt;
+		else if(strstr(line, "stress chan ") != NULL)
+			++*nchan;
+	}
+	fclose(fp);
+}
+
+/* Many threads log their first messages at the same time, to the
+ * not yet initialized default channel and to a channel that has not
+ * yet been opened by its driver. Afterwards, exactly one channel's
+ * worth of descriptors must have been opened for each of them. If the
+ * channel writes to a file, each successfully logged message must
+ * have arrived there exactly once. Both channels share the file,
+ * unless the driver does not permit it ("mmapfile:"); the default
+ * channel then writes to the file name with ".dflt" appended.
+ */
+static int
+stress(const char *chanspec, const int nthreads)
+{
+	struct stress_ctx ctx;
+	pthread_t *thrds;
+	int exclusive;
+	const char *const fname = stress_file(chanspec, &exclusive);
+	char dfltspec[1024];
+	char dfltname[1024];
+	int ndflt_before, nchan_before;
+	int ndflt, nchan;
+	int unused;
+	int lost = 0;
+	int fds_chan;
+	int fds_before;
+	int fds_added;
+	int i;
+
+	if((thrds = calloc(nthreads, sizeof(pthread_t))) == NULL)
+		return 1;
+	if(exclusive) {
+		/* the file name ends the spec */
+		snprintf(dfltspec, sizeof(dfltspec), "%s.dflt", chanspec);
+		snprintf(dfltname, sizeof(dfltname), "%s.dflt", fname);
+	} else {
+		snprintf(dfltspec, sizeof(dfltspec), "%s", chanspec);
+		if(fname != NULL)
+			snprintf(dfltname, sizeof(dfltname), "%s", fname);
+	}
+	setenv("LIBLOGGING_STDLOG_DFLT_LOG_CHANNEL", dfltspec, 1);
+
+	/* find out how many descriptors a channel of this kind needs */
+	fds_before = count_fds();
+	ctx.ch = stdlog_open("tester", 0, STDLOG_LOCAL0, chanspec);
+	stdlog_log(ctx.ch, STDLOG_INFO, "stress reference");
+	stdlog_flush(ctx.ch); /* wrapping drivers open their child lazily, too */
+	fds_chan = count_fds() - fds_before;
+	stdlog_close(ctx.ch);
+
+	if(fname != NULL) {
+		stress_count(dfltname, &ndflt_before, &unused);
+		stress_count(fname, &unused, &nchan_before);
+	}
+	fds_before = count_fds();
+	ctx.ch = stdlog_open("tester", 0, STDLOG_LOCAL0, chanspec);
+	ctx.nerr_dflt = ctx.nerr_chan = 0;
+	pthread_barrier_init(&ctx.start, NULL, nthreads);
+	for(i = 0 ; i < nthreads ; ++i)
+		pthread_create(&thrds[i], NULL, stress_thread, &ctx);
+	for(i = 0 ; i < nthreads ; ++i)
+		pthread_join(thrds[i], NULL);
+	pthread_barrier_destroy(&ctx.start);
+	stdlog_flush(ctx.ch);
+	stdlog_flush(NULL);
+	fds_added = count_fds() - fds_before;
+	stdlog_close(ctx.ch);
+	free(thrds);
+
+	printf("stress: %d threads, %d messages, %d failed, %d descriptors "
+	       "opened (expected %d)\n", nthreads, nthreads * STRESS_MSGS * 2,
+	       ctx.nerr_dflt + ctx.nerr_chan, fds_added, 2 * fds_chan);
+	if(fname != NULL) {
+		stress_count(dfltname, &ndflt, &unused);
+		stress_count(fname, &unused, &nchan);
+		ndflt -= ndflt_before;
+		nchan -= nchan_before;
+		printf("stress: %d default and %d channel messages in %s%s "
+		       "(expected %d and %d)\n", ndflt, nchan, fname,
+		       exclusive ? "[.dflt]" : "",
+		       nthreads * STRESS_MSGS - ctx.nerr_dflt,
+		       nthreads * STRESS_MSGS - ctx.nerr_chan);
+		lost =    ndflt != nthreads * STRESS_MSGS - ctx.nerr_dflt
+		       || nchan != nthreads * STRESS_MSGS - ctx.nerr_chan;
+	}
+	return fds_added != 2 * fds_chan || lost;
+}
+
+/* A minimal stand-in for a syslog daemon receiving from the "uxstream:",
+ * "tcp:" or "udp:" driver: listens on a unix stream socket or, if given
+ * as "tcp:port" or "udp:port", on that port of the loopback interface,
+ * and prints each frame, prefixed by its length, on a line of its own.
+ * Stream frames are octet-counted, datagrams are one frame each. Stops
+ * after maxframes frames, if given. Given as "journal:path", it stands
+ * in for journald instead, see receive_journal().
+ */
+#define RECV_MAXCONN 64
+
+struct recv_conn {
+	char *buf;	/* data received, but not yet printed */
+	size_t used;
+	size_t size;
+};
+
+/* prints the complete frames in the buffer, returns -1 on framing error */
+static int
+recv_frames(struct recv_conn *const conn, long *const nframes)
+{
+	size_t off = 0;
+	size_t lenframe;
+	size_t i;
+
+	while(1) {
+		lenframe = 0;
+		for(i = off ; i < conn->used && conn->buf[i] >= '0' && conn->buf[i] <= '9' ; ++i)
+			lenframe = lenframe * 10 + conn->buf[i] - '0';
+		if(i == conn->used)
+			break;
+		if(conn->buf[i] != ' ' || i == off)
+			return -1;
+		if(i + 1 + lenframe > conn->used)
+			break;
+		printf("%zu %.*s\n", lenframe, (int) lenframe, conn->buf + i + 1);
+		++*nframes;
+		off = i + 1 + lenframe;
+	}
+	fflush(stdout);
+	memmove(conn->buf, conn->buf + off, conn->used - off);
+	conn->used -= off;
+	return 0;
+}
+
+/* creates the receiving socket, returns -1 on error */
+static int
+recv_socket(const char *sockname, int *const dgram)
+{
+	struct sockaddr_un uaddr;
+	struct sockaddr_in iaddr;
+	struct sockaddr *addr;
+	socklen_t lenaddr;
+	int one = 1;
+	int sock;
+
+	*dgram = !strncmp(sockname, "udp:", 4) || !strncmp(sockname, "journal:", 8);
+	if(!strncmp(sockname, "udp:", 4) || !strncmp(sockname, "tcp:", 4)) {
+		memset(&iaddr, 0, sizeof(iaddr));
+		iaddr.sin_family = AF_INET;
+		iaddr.sin_port = htons(atoi(sockname + 4));
+		iaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr = (struct sockaddr*) &iaddr;
+		lenaddr = sizeof(iaddr);
+		sock = socket(AF_INET, *dgram ? SOCK_DGRAM : SOCK_STREAM, 0);
+		if(sock >= 0)
+			setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	} else {
+		if(*dgram)
+			sockname += 8;
+		memset(&uaddr, 0, sizeof(uaddr));
+		uaddr.sun_family = AF_UNIX;
+		strncpy(uaddr.sun_path, sockname, sizeof(uaddr.sun_path) - 1);
+		unlink(sockname);
+		addr = (struct sockaddr*) &uaddr;
+		lenaddr = sizeof(uaddr);
+		sock = socket(AF_UNIX, *dgram ? SOCK_DGRAM : SOCK_STREAM, 0);
+	}
+	if(sock < 0 || bind(sock, addr, lenaddr) != 0
+	   || (!*dgram && listen(sock, 8) != 0)) {
+		perror(sockname);
+		return -1;
+	}
+	return sock;
+}
+
+static int
+receive_dgram(const int sock, const long maxframes)
+{
+	static char buf[64 * 1024];
+	long nframes = 0;
+	ssize_t r;
+
+	while(maxframes == 0 || nframes < maxframes) {
+		if((r = recv(sock, buf, sizeof(buf), 0)) < 0)
+			continue;
+		printf("%zd %.*s\n", r, (int) r, buf);
+		fflush(stdout);
+		++nframes;
+	}
+	close(sock);
+	return 0;
+}
+
+/* Prints the fields of a native journal protocol entry, one per line,
+ * followed by an empty line. Returns -1 if the entry is malformed.
+ */
+static int
+print_journal_entry(const char *buf, size_t len)
+{
+	const char *end;
+	uint64_t lenval;
+	int i;
+
+	while(len > 0) {
+		if((end = memchr(buf, '\n', len)) == NULL)
+			return -1;
+		if(memchr(buf, '=', end - buf) != NULL) {
+			printf("%.*s\n", (int) (end - buf), buf);
+		} else {
+			if((size_t) (end - buf) + 1 + 8 > len)
+				return -1;
+			for(lenval = 0, i = 7 ; i >= 0 ; --i)
+				lenval = (lenval << 8) | (unsigned char) end[1 + i];
+			if((size_t) (end - buf) + 1 + 8 + lenval + 1 > len)
+				return -1;
+			printf("%.*s=%.*s\n", (int) (end - buf), buf, (int) lenval, end + 9);
+			end += 9 + lenval;
+		}
+		len -= end + 1 - buf;
+		buf = end + 1;
+	}
+	printf("\n");
+	fflush(stdout);
+	return 0;
+}
+
+/* Stands in for journald: receives native protocol entries, inline or
+ * as a passed (memfd) descriptor, and prints their fields.
+ */
+static int
+receive_journal(const int sock, const long maxframes)
+{
+	char *buf = NULL;
+	size_t lenbuf = 0;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct cmsghdr *cmsg;
+	struct msghdr mh;
+	struct iovec iov;
+	struct stat st;
+	long nframes = 0;
+	void *map;
+	ssize_t r;
+	int fd;
+
+	while(maxframes == 0 || nframes < maxframes) {
+		/* entries may be large, so learn the size first */
+		if((r = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC)) < 0)
+			continue;
+		if((size_t) r + 1 > lenbuf) {
+			lenbuf = r + 1;
+			if((buf = realloc(buf, lenbuf)) == NULL)
+				return 1;
+		}
+		memset(&mh, 0, sizeof(mh));
+		iov.iov_base = buf;
+		iov.iov_len = lenbuf;
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = ctl.buf;
+		mh.msg_controllen = sizeof(ctl.buf);
+		if((r = recvmsg(sock, &mh, 0)) < 0)
+			continue;
+		cmsg = CMSG_FIRSTHDR(&mh);
+		if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+		   && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+			if(fstat(fd, &st) == 0 && st.st_size > 0
+			   && (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+				printf("# %lld bytes via descriptor\n", (long long) st.st_size);
+				if(print_journal_entry(map, st.st_size) != 0)
+					printf("# malformed entry\n\n");
+				munmap(map, st.st_size);
+			}
+			close(fd);
+		} else if(print_journal_entry(buf, r) != 0) {
+			printf("# malformed entry\n\n");
+		}
+		++nframes;
+	}
+	free(buf);
+	close(sock);
+	return 0;
+}
+
+/* Kills the receiver in the middle of a batch: a "uxstream:" or
+ * "tcp:" channel buffers KILL_MSGS messages, which are then flushed
+ * to a receiver that closes its connection after KILL_FIRSTBYTES
+ * bytes. The channel must reconnect and send the rest on a second
+ * connection. Frames cut off or still queued on the first connection
+ * may be lost, but no frame must arrive twice. The channel spec
+ * should give a buffer large enough for the whole batch, e.g.
+ * "uxstream,bufsize=8m,flushms=0:/tmp/kill.sock". The batch is larger
+ * than what the kernel buffers for a (loopback) TCP connection.
+ */
+#define KILL_MSGS 20000
+#define KILL_FIRSTBYTES (64 * 1024)
+#define KILL_WAITMS 10000
+
+struct kill_ctx {
+	int sock;
+	int nrecv[2];	/* frames received per connection */
+	int nbad;	/* frames without a valid sequence number */
+	unsigned char seen[KILL_MSGS];
+};
+
+/* records the complete frames in the buffer, returns their end */
+static size_t
+kill_frames(struct kill_ctx *const ctx, const int nconn,
+	const char *const buf, const size_t used)
+{
+	size_t off = 0;
+	size_t lenframe;
+	size_t i;
+	const char *p;
+	int seq;
+
+	while(1) {
+		lenframe = 0;
+		for(i = off ; i < used && buf[i] >= '0' && buf[i] <= '9' ; ++i)
+			lenframe = lenframe * 10 + buf[i] - '0';
+		if(i == used || buf[i] != ' ' || i + 1 + lenframe > used)
+			return off;
+		p = memchr(buf + i + 1, '#', lenframe);
+		seq = (p == NULL) ? -1 : atoi(p + 1);
+		if(seq < 0 || seq >= KILL_MSGS)
+			++ctx->nbad;
+		else if(ctx->seen[seq]++ == 1)
+			printf("kill: frame %d received twice\n", seq);
+		++ctx->nrecv[nconn];
+		off = i + 1 + lenframe;
+	}
+}
+
+static void *
+kill_receiver(void *arg)
+{
+	struct kill_ctx *const ctx = (struct kill_ctx *) arg;
+	static char buf[1024 * 1024];
+	struct pollfd pfd;
+	size_t total;
+	size_t used;
+	size_t done;
+	ssize_t r;
+	int conn;
+	int nconn;
+
+	for(nconn = 0 ; nconn < 2 ; ++nconn) {
+		/* do not wait forever if the channel does not reconnect */
+		pfd.fd = ctx->sock;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, KILL_WAITMS) != 1
+		   || (conn = accept(ctx->sock, NULL, NULL)) < 0)
+			break;
+		total = used = 0;
+		while((nconn == 1 || total < KILL_FIRSTBYTES)
+		      && (r = read(conn, buf + used, sizeof(buf) - used)) > 0) {
+			total += r;
+			used += r;
+			done = kill_frames(ctx, nconn, buf, used);
+			memmove(buf, buf + done, used - done);
+			used -= done;
+		}
+		close(conn); /* with data unread on the first connection */
+	}
+	return NULL;
+}
+
+static int
+kill_receiver_test(const char *sockname, const char *chanspec)
+{
+	struct kill_ctx ctx;
+	stdlog_channel_t ch;
+	pthread_t thrd;
+	char pad[201];
+	int nlost = 0;
+	int ndup = 0;
+	int tries;
+	int rcvbuf = 4096;
+	int dgram;
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(pad, 'x', sizeof(pad) - 1);
+	pad[sizeof(pad) - 1] = '\0';
+	if((ctx.sock = recv_socket(sockname, &dgram)) < 0 || dgram)
+		return 1;
+	setsockopt(ctx.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	if((ch = stdlog_open("tester", 0, STDLOG_LOCAL0, chanspec)) == NULL) {
+		perror(chanspec);
+		return 1;
+	}
+	pthread_create(&thrd, NULL, kill_receiver, &ctx);
+	for(i = 0 ; i < KILL_MSGS ; ++i)
+		stdlog_log(ch, STDLOG_INFO, "kill #%d %s", i, pad);
+	/* a "tcp:" channel does not wait, so give it time to reconnect */
+	for(tries = 0 ; stdlog_flush(ch) != 0 && tries < 500 ; ++tries)
+		usleep(10000);
+	stdlog_close(ch);
+	pthread_join(thrd, NULL);
+	close(ctx.sock);
+	if(strncmp(sockname, "tcp:", 4))
+		unlink(sockname);
+
+	for(i = 0 ; i < KILL_MSGS ; ++i) {
+		if(ctx.seen[i] == 0)
+			++nlost;
+		else if(ctx.seen[i] > 1)
+			++ndup;
+	}
+	printf("kill: %d messages, %d frames on the first and %d on the second "
+	       "connection, %d lost, %d duplicated, %d malformed\n", KILL_MSGS,
+	       ctx.nrecv[0], ctx.nrecv[1], nlost, ndup, ctx.nbad);
+	return ndup != 0 || ctx.nbad != 0 || ctx.nrecv[1] == 0;
+}
+
+static int
+receive(const char *sockname, const long maxframes)
+{
+	struct pollfd pfd[RECV_MAXCONN + 1];
+	struct recv_conn conn[RECV_MAXCONN + 1];
+	long nframes = 0;
+	ssize_t r;
+	int nconn = 0;
+	int dgram;
+	int i;
+
+	if((pfd[0].fd = recv_socket(sockname, &dgram)) < 0)
+		return 1;
+	if(!strncmp(sockname, "journal:", 8))
+		return receive_journal(pfd[0].fd, maxframes);
+	if(dgram)
+		return receive_dgram(pfd[0].fd, maxframes);
+	pfd[0].events = POLLIN;
+	while(maxframes == 0 || nframes < maxframes) {
+		if(poll(pfd, nconn + 1, -1) < 0)
+			continue;
+		/* backwards, so closed connections can be replaced by the last one */
+		for(i = nconn ; i > 0 ; --i) {
+			if(pfd[i].revents == 0)
+				continue;
+			if(conn[i].used == conn[i].size) {
+				conn[i].size *= 2;
+				if((conn[i].buf = realloc(conn[i].buf, conn[i].size)) == NULL)
+					return 1;
+			}
+			r = read(pfd[i].fd, conn[i].buf + conn[i].used, conn[i].size - conn[i].used);
+			if(r > 0) {
+				conn[i].used += r;
+				if(recv_frames(&conn[i], &nframes) == 0)
+					continue;
+			}
+			close(pfd[i].fd);
+			free(conn[i].buf);
+			pfd[i] = pfd[nconn];
+			conn[i] = conn[nconn];
+			--nconn;
+		}
+		if((pfd[0].revents & POLLIN) && nconn < RECV_MAXCONN) {
+			if((pfd[nconn + 1].fd = accept(pfd[0].fd, NULL, NULL)) < 0)
+				continue;
+			++nconn;
+			pfd[nconn].events = POLLIN;
+			conn[nconn].size = 64 * 1024;
+			conn[nconn].used = 0;
+			if((conn[nconn].buf = malloc(conn[nconn].size)) == NULL)
+				return 1;
+		}
+	}
+	for(i = 1 ; i <= nconn ; ++i) {
+		close(pfd[i].fd);
+		free(conn[i].buf);
+	}
+	close(pfd[0].fd);
+	if(strncmp(sockname, "tcp:", 4))
+		unlink(sockname);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char buf[40];
@@ -12,24 +582,39 @@ int main(int argc, char *argv[])
 	int option = 0;
 	char *chanspec = NULL;
 
-	if (3 == argc && (0 == strcmp(argv[1], "-p"))) {
+	if (4 == argc && (0 == strcmp(argv[1], "-t"))) {
+		return stress(argv[3], atoi(argv[2]) > 0 ? atoi(argv[2]) : 1);
+	} else if (argc >= 3 && argc <= 4 && (0 == strcmp(argv[1], "-r"))) {
+		return receive(argv[2], (argc == 4) ? atol(argv[3]) : 0);
+	} else if (4 == argc && (0 == strcmp(argv[1], "-k"))) {
+		return kill_receiver_test(argv[2], argv[3]);
+	} else if (3 == argc && (0 == strcmp(argv[1], "-p"))) {
 		dflt_option |= STDLOG_PID;
 		option |= STDLOG_PID;
 		chanspec = argv[2];
 	} else if (2 == argc) {
 		chanspec = argv[1];
 	} else if(argc < 2 || argc > 3) {
-		fprintf(stderr, "Usage: tester [-p] channelspec\n");
+		fprintf(stderr, "Usage: tester [-p] channelspec\n"
+		                "       tester -t nthreads channelspec\n"
+		                "       tester -r socketname|tcp:port|udp:port|journal:path [nframes]\n"
+		                "       tester -k socketname|tcp:port channelspec\n");
 		exit(1);
 	}
 
 	stdlog_init(dflt_option);
 	ch = stdlog_open("tester", option, STDLOG_LOCAL0, chanspec);
-	ch2 = stdlog_open("tester", STDLOG_USE_DFLT_OPTS, STDLOG_LOCAL0, chanspec);
+	/* fails for drivers that lock their output, like "mmapfile:" */
+	if((ch2 = stdlog_open("tester", STDLOG_USE_DFLT_OPTS, STDLOG_LOCAL0, chanspec)) == NULL)
+		perror("second channel");
 	stdlog_log(ch, STDLOG_DEBUG, "Test %10.6s, %u, %d, %c, %x, %p, %f",
 		   "abc", 4712, -4712, 'T', 0x129abcf0, NULL, 12.0345);
-	stdlog_log_b(ch2, STDLOG_DEBUG, buf, sizeof(buf), "Test %100.50s, %u, %d, %c, %x, %p, %f",
-		   "abc", 4712, -4712, 'T', 0x129abcf0, NULL, 12.03);
+	if(ch2 != NULL) {
+		stdlog_log_b(ch2, STDLOG_DEBUG, buf, sizeof(buf), "Test %100.50s, %u, %d, %c, %x, %p, %f",
+			   "abc", 4712, -4712, 'T', 0x129abcf0, NULL, 12.03);
+		stdlog_close(ch2);
+	}
+	stdlog_close(ch);
 	stdlog_deinit();
 	return 0;
 }
@@ -0,0 +1,230 @@
+/* The stdlog ticker. Drivers that buffer messages register their
+ * channel here to get their flush entry point called periodically,
+ * so that buffered messages do not linger when the application
+ * stops logging. Other periodic per-channel work (like emitting rate
+ * limiter summaries) uses it as well; each registration carries the
+ * function to call. A single background thread serves all channels. It
+ * is started when the first channel registers and terminates when
+ * the last one unregisters. A forked child does not inherit the thread,
+ * so it starts with no registrations; its inherited channels are no
+ * longer ticked, and closing them in the child does not wait for a
+ * thread that is not there.
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+
+struct ticker_entry {
+	struct ticker_entry *next;
+	stdlog_channel_t ch;
+	int (*tick)(stdlog_channel_t ch);
+	int64_t interval;	/* ms */
+	int64_t due;		/* ms, monotonic clock */
+};
+
+/* ctl_mut serializes (un)registration, including thread start and
+ * stop. mut protects the list and is held while a channel is flushed,
+ * so a channel is never flushed after it has been unregistered.
+ */
+static pthread_mutex_t ctl_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static struct ticker_entry *root = NULL;
+static int running = 0;
+static int stop = 0;
+static pthread_t thrd;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static int64_t
+ticker_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *
+ticker_thread(void __attribute__((unused)) *arg)
+{
+	struct ticker_entry *e;
+	struct timespec ts;
+	int64_t now;
+	int64_t next;
+
+	pthread_mutex_lock(&mut);
+	while(!stop) {
+		now = ticker_now();
+		next = now + 60000;
+		for(e = root ; e != NULL ; e = e->next) {
+			if(e->due <= now) {
+				e->tick(e->ch);
+				e->due = now + e->interval;
+			}
+			if(e->due < next)
+				next = e->due;
+		}
+		ts.tv_sec = next / 1000;
+		ts.tv_nsec = (next % 1000) * 1000000;
+		pthread_cond_timedwait(&cond, &mut, &ts);
+	}
+	pthread_mutex_unlock(&mut);
+	return NULL;
+}
+
+/* fork() with the locks held, so the child gets a consistent list */
+static void
+ticker_atfork_prepare(void)
+{
+	pthread_mutex_lock(&ctl_mut);
+	pthread_mutex_lock(&mut);
+}
+
+static void
+ticker_atfork_parent(void)
+{
+	pthread_mutex_unlock(&mut);
+	pthread_mutex_unlock(&ctl_mut);
+}
+
+static void
+ticker_atfork_child(void)
+{
+	struct ticker_entry *e;
+
+	while((e = root) != NULL) {
+		root = e->next;
+		free(e);
+	}
+	running = 0;
+	pthread_mutex_unlock(&mut);
+	pthread_mutex_unlock(&ctl_mut);
+}
+
+static void
+ticker_atfork_init(void)
+{
+	pthread_atfork(ticker_atfork_prepare, ticker_atfork_parent,
+	               ticker_atfork_child);
+}
+
+static int
+ticker_start(void)
+{
+	pthread_condattr_t attr;
+	int r;
+
+	pthread_once(&atfork_once, ticker_atfork_init);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond, &attr);
+	pthread_condattr_destroy(&attr);
+	stop = 0;
+	if((r = pthread_create(&thrd, NULL, ticker_thread, NULL)) != 0) {
+		pthread_cond_destroy(&cond);
+		errno = r;
+		return -1;
+	}
+	running = 1;
+	return 0;
+}
+
+/* Calls tick(ch) every interval milliseconds, from the ticker thread,
+ * until it is unregistered.
+ * Returns 0 on success, -1 with errno set otherwise.
+ */
+int
+__stdlog_ticker_register(stdlog_channel_t ch, const int interval,
+	int (*tick)(stdlog_channel_t ch))
+{
+	struct ticker_entry *e;
+	int r = -1;
+
+	if((e = malloc(sizeof(struct ticker_entry))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	e->ch = ch;
+	e->tick = tick;
+	e->interval = (interval > 0) ? interval : 1;
+	e->due = ticker_now() + e->interval;
+
+	pthread_mutex_lock(&ctl_mut);
+	if(!running && ticker_start() != 0) {
+		free(e);
+		goto done;
+	}
+	pthread_mutex_lock(&mut);
+	e->next = root;
+	root = e;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mut);
+	r = 0;
+done:
+	pthread_mutex_unlock(&ctl_mut);
+	return r;
+}
+
+/* Removes ch from the ticker. When this returns, the ticker thread
+ * no longer accesses the channel. Unregistering a channel that was
+ * never registered is a no-op.
+ */
+void
+__stdlog_ticker_unregister(stdlog_channel_t ch,
+	int (*tick)(stdlog_channel_t ch))
+{
+	struct ticker_entry **pe;
+	struct ticker_entry *e;
+	int do_stop = 0;
+
+	pthread_mutex_lock(&ctl_mut);
+	pthread_mutex_lock(&mut);
+	for(pe = &root ; *pe != NULL ; pe = &(*pe)->next) {
+		if((*pe)->ch == ch && (*pe)->tick == tick) {
+			e = *pe;
+			*pe = e->next;
+			free(e);
+			break;
+		}
+	}
+	if(running && root == NULL) {
+		stop = 1;
+		pthread_cond_signal(&cond);
+		do_stop = 1;
+	}
+	pthread_mutex_unlock(&mut);
+	if(do_stop) {
+		pthread_join(thrd, NULL);
+		pthread_cond_destroy(&cond);
+		running = 0;
+	}
+	pthread_mutex_unlock(&ctl_mut);
+}
@@ -29,6 +29,7 @@
 #include <time.h>
 #include <stdint.h>
 #include <limits.h>
+#include "stdlog-intern.h"
 
 
 /**
@@ -66,6 +67,106 @@ __stdlog_formatTimestamp3164(const struct tm *__restrict__ const tm,
 	return 15;	/* traditional: number of bytes written */
 }
 
+/**
+ * Format a timestamp as RFC 3339 (and thus RFC 5424) UTC time, like
+ * "2026-10-16T12:34:56Z". Exactly 20 bytes are written, no string
+ * terminator is added.
+ */
+int
+__stdlog_formatTimestamp3339(const struct tm *__restrict__ const tm,
+	char *__restrict__ const buf)
+{
+	const int year = tm->tm_year + 1900;
+
+	buf[0] = (year / 1000) % 10 + '0';
+	buf[1] = (year / 100) % 10 + '0';
+	buf[2] = (year / 10) % 10 + '0';
+	buf[3] = year % 10 + '0';
+	buf[4] = '-';
+	buf[5] = ((tm->tm_mon + 1) / 10) % 10 + '0';
+	buf[6] = (tm->tm_mon + 1) % 10 + '0';
+	buf[7] = '-';
+	buf[8] = (tm->tm_mday / 10) % 10 + '0';
+	buf[9] = tm->tm_mday % 10 + '0';
+	buf[10] = 'T';
+	buf[11] = (tm->tm_hour / 10) % 10 + '0';
+	buf[12] = tm->tm_hour % 10 + '0';
+	buf[13] = ':';
+	buf[14] = (tm->tm_min / 10) % 10 + '0';
+	buf[15] = tm->tm_min % 10 + '0';
+	buf[16] = ':';
+	buf[17] = (tm->tm_sec / 10) % 10 + '0';
+	buf[18] = tm->tm_sec % 10 + '0';
+	buf[19] = 'Z';
+	return 20;
+}
+
+/* Per-thread cache of the last rendered timestamp. The text only
+ * changes once per second, so usually we just need to copy it.
+ * Being per-thread, the cache needs no inter-thread synchronization.
+ * But a signal handler may interrupt us while we read or update it,
+ * and the handler may log itself. So the cache is protected by a
+ * sequence counter, which is odd while an update is in progress. A
+ * reader retries if the counter changed while it copied, and a
+ * context that finds an update in progress (i.e. a handler that
+ * interrupted it) renders without the cache.
+ * Note: initial-exec TLS is required, as other models may allocate
+ * memory on first access, which is not signal-safe.
+ */
+static __thread struct {
+	unsigned seq;
+	time_t t;
+	char ts[16];
+} tscache __attribute__((tls_model("initial-exec"))) = { 0, -1, "" };
+
+#define TSCACHE_BARRIER() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+/**
+ * Same as __stdlog_formatTimestamp3164(), but takes the time as
+ * time_t and renders via the per-thread cache. Exactly 15 bytes
+ * are written, no string terminator is added.
+ */
+int
+__stdlog_formatTimestamp3164_cached(const time_t t, char *__restrict__ const buf)
+{
+	struct tm tm;
+	char tmp[16];
+	unsigned seq;
+	int i;
+
+	do {
+		seq = tscache.seq;
+		TSCACHE_BARRIER();
+		if(seq & 1)
+			goto uncached; /* we interrupted an update */
+		if(tscache.t != t)
+			goto update;
+		for(i = 0 ; i < 15 ; ++i)
+			buf[i] = tscache.ts[i];
+		TSCACHE_BARRIER();
+	} while(seq != tscache.seq);
+	return 15;
+
+update:
+	tscache.seq = seq + 1;
+	TSCACHE_BARRIER();
+	__stdlog_timesub(&t, 0, &tm);
+	__stdlog_formatTimestamp3164(&tm, tscache.ts);
+	tscache.t = t;
+	for(i = 0 ; i < 15 ; ++i)
+		buf[i] = tscache.ts[i];
+	TSCACHE_BARRIER();
+	tscache.seq = seq + 2;
+	return 15;
+
+uncached:
+	__stdlog_timesub(&t, 0, &tm);
+	__stdlog_formatTimestamp3164(&tm, tmp);
+	for(i = 0 ; i < 15 ; ++i)
+		buf[i] = tmp[i];
+	return 15;
+}
+
 /* ==================================================================================== *
  * The following code is taken from BSD sources, as described below.
  * ==================================================================================== */
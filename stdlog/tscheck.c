@@ -0,0 +1,91 @@
+/* tscheck: checks that __stdlog_formatTimestamp3164_cached() renders
+ * byte-identical timestamps to the uncached __stdlog_timesub() plus
+ * __stdlog_formatTimestamp3164() path, around second, minute, day,
+ * month and year boundaries, when time goes backwards and across a
+ * real second boundary of the system clock. Run by "make check".
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stdlog-intern.h"
+
+static int nchecks = 0;
+static int nfailed = 0;
+
+/* compares the cached rendering of t with the uncached one */
+static void
+check(const time_t t)
+{
+	struct tm tm;
+	char expect[16];
+	char got[16];
+
+	++nchecks;
+	__stdlog_timesub(&t, 0, &tm);
+	__stdlog_formatTimestamp3164(&tm, expect);
+	memset(got, 'Z', sizeof(got));
+	__stdlog_formatTimestamp3164_cached(t, got);
+	got[15] = '\0';
+	if(memcmp(got, expect, 15) != 0) {
+		fprintf(stderr, "tscheck: time %lld: expected \"%s\", got \"%s\"\n",
+		        (long long) t, expect, got);
+		++nfailed;
+	}
+}
+
+int
+main(void)
+{
+	/* the last second of a minute, hour, day, Feb 28 in a leap
+	 * year, Feb 29, Dec 31 and 2038-01-19 03:14:07
+	 */
+	static const time_t bounds[] = { 59, 3599, 86399, 951782399,
+		951868799, 1704067199, 2147483647 };
+	time_t t;
+	time_t t0;
+	size_t i;
+	int k;
+
+	for(i = 0 ; i < sizeof(bounds) / sizeof(bounds[0]) ; ++i) {
+		for(t = bounds[i] - 2 ; t <= bounds[i] + 2 ; ++t)
+			for(k = 0 ; k < 3 ; ++k)	/* first miss, then hits */
+				check(t);
+		for(t = bounds[i] + 2 ; t >= bounds[i] - 2 ; --t)
+			check(t);
+	}
+
+	/* the same with the clock, until it has passed a second boundary */
+	t0 = time(NULL);
+	do {
+		t = time(NULL);
+		check(t);
+	} while(t == t0);
+
+	printf("tscheck: %d checks, %d failed\n", nchecks, nfailed);
+	return nfailed != 0;
+}
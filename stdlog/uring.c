@@ -0,0 +1,360 @@
+/* io_uring submission for the file driver.
+ *
+ * The file driver fills one of a small set of buffers, which are
+ * registered with the kernel, and submits it as a single write when
+ * it is full or due for flushing. It then continues with the next
+ * buffer while the kernel works on the previous one. Each write is
+ * marked IOSQE_IO_DRAIN, so the writes are executed in submission
+ * order. Completions are reaped lazily, when a buffer is needed again
+ * or the driver is flushed. Messages are always copied into a buffer,
+ * so callers may reuse their work buffer as soon as the log call
+ * returns.
+ *
+ * The ring is set up with a kernel submission thread (SQPOLL). This is
+ * not primarily about saving the io_uring_enter() call: requests are
+ * owned by the task that submitted them and are cancelled if it exits.
+ * As any application thread may log and exit right after, submissions
+ * must not be made by them.
+ *
+ * This talks to the kernel directly, without liburing. All calls must
+ * be serialized by the caller (the file driver holds its buffer mutex).
+ *
+ * Copyright (C) 2026 Adiscon GmbH
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ADISCON AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL ADISCON OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stdlog-intern.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+#define URING_SQ_IDLE_MS 50	/* submission thread sleeps when idle this long */
+
+struct __stdlog_uring {
+	int fd;			/* the ring */
+	unsigned *sq_tail;
+	unsigned *sq_flags;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqring;
+	void *cqring;		/* same as sqring with IORING_FEAT_SINGLE_MMAP */
+	size_t lensqring;
+	size_t lencqring;
+	size_t lensqes;
+	char *bufs;		/* nbufs buffers of lenbuf bytes each */
+	size_t lenbuf;
+	int nbufs;
+	int fixed;		/* buffers are registered */
+	int next;		/* buffer to hand out next */
+	int inflight;		/* writes submitted but not yet reaped */
+	unsigned char *busy;	/* per buffer: write submitted, not reaped */
+	int err;		/* errno of first failed write, 0 if none */
+	struct stdlog_stats *stats; /* channel statistics to account our calls to */
+};
+
+static int
+uring_enter(struct __stdlog_uring *const u, const unsigned mincomplete)
+{
+	int r;
+
+	do {
+		__atomic_add_fetch(&u->stats->syscalls, 1, __ATOMIC_RELAXED);
+		r = syscall(__NR_io_uring_enter, u->fd, 0, mincomplete,
+		            mincomplete ? IORING_ENTER_GETEVENTS
+		                        : IORING_ENTER_SQ_WAKEUP, NULL, 0);
+	} while(r == -1 && errno == EINTR);
+	return r;
+}
+
+/* reaps all available completions, without a system call */
+static void
+uring_reap(struct __stdlog_uring *const u)
+{
+	unsigned head = *u->cq_head;
+	struct io_uring_cqe *cqe;
+	int idx;
+
+	while(head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &u->cqes[head & *u->cq_mask];
+		idx = (int) (cqe->user_data & 0xffffffff);
+		if(cqe->res < 0) {
+			if(u->err == 0)
+				u->err = -cqe->res;
+		} else if((uint64_t) cqe->res != cqe->user_data >> 32) {
+			__atomic_add_fetch(&u->stats->eagain, 1, __ATOMIC_RELAXED);
+			if(u->err == 0)
+				u->err = EAGAIN; /* partial write, as in file_writev() */
+		}
+		u->busy[idx] = 0;
+		--u->inflight;
+		++head;
+	}
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Waits until all submitted writes have completed. Returns -1 with
+ * errno set if any of them failed since the last call.
+ */
+int
+__stdlog_uring_wait(struct __stdlog_uring *const u)
+{
+	int r = 0;
+
+	uring_reap(u);
+	while(u->inflight > 0) {
+		if(uring_enter(u, 1) == -1) {
+			r = -1;
+			goto done;
+		}
+		uring_reap(u);
+	}
+	if(u->err != 0) {
+		errno = u->err;
+		u->err = 0;
+		r = -1;
+	}
+done:	return r;
+}
+
+/* Returns the next buffer to fill, waiting for its previous write to
+ * complete if need be. Returns NULL if waiting failed.
+ */
+char *
+__stdlog_uring_buf(struct __stdlog_uring *const u)
+{
+	const int idx = u->next;
+
+	uring_reap(u);
+	while(u->busy[idx]) {
+		if(uring_enter(u, 1) == -1)
+			return NULL;
+		uring_reap(u);
+	}
+	u->next = (idx + 1 == u->nbufs) ? 0 : idx + 1;
+	return u->bufs + (size_t) idx * u->lenbuf;
+}
+
+/* Submits len bytes of buf, which must have been obtained from
+ * __stdlog_uring_buf(), for writing to fd. The submission thread only
+ * needs to be woken up if it went to sleep after being idle. Errors
+ * are reported by the next __stdlog_uring_wait().
+ */
+void
+__stdlog_uring_write(struct __stdlog_uring *const u, const int fd,
+	char *const buf, const size_t len)
+{
+	const int idx = (buf - u->bufs) / u->lenbuf;
+	const unsigned tail = *u->sq_tail;
+	const unsigned pos = tail & *u->sq_mask;
+	struct io_uring_sqe *const sqe = &u->sqes[pos];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = u->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) -1; /* current position, i.e. append */
+	sqe->addr = (uintptr_t) buf;
+	sqe->len = len;
+	sqe->buf_index = idx;
+	sqe->user_data = ((uint64_t) len << 32) | idx;
+	u->sq_array[pos] = pos;
+	u->busy[idx] = 1;
+	++u->inflight;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(u->sq_flags, __ATOMIC_SEQ_CST) & IORING_SQ_NEED_WAKEUP)
+		uring_enter(u, 0);
+}
+
+/* Sets up a ring with nbufs buffers of lenbuf bytes. Returns NULL with
+ * errno set if io_uring is not available; the caller then uses plain
+ * write() instead.
+ */
+struct __stdlog_uring *
+__stdlog_uring_new(const int nbufs, const size_t lenbuf, struct stdlog_stats *const stats)
+{
+	struct __stdlog_uring *u;
+	struct io_uring_params p;
+	struct iovec *iov = NULL;
+	char *sq;
+	char *cq;
+	int i;
+
+	if((u = calloc(1, sizeof(struct __stdlog_uring))) == NULL)
+		goto nomem;
+	u->fd = -1;
+	u->sqring = u->cqring = MAP_FAILED;
+	u->sqes = MAP_FAILED;
+	u->bufs = MAP_FAILED;
+	u->nbufs = nbufs;
+	u->lenbuf = lenbuf;
+	u->stats = stats;
+	if((u->busy = calloc(nbufs, 1)) == NULL)
+		goto nomem;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_SQPOLL;
+	p.sq_thread_idle = URING_SQ_IDLE_MS;
+	if((u->fd = syscall(__NR_io_uring_setup, nbufs, &p)) == -1)
+		goto fail;
+	/* we need writes at the current position and SQPOLL without
+	 * registered files (both Linux 5.11 and above)
+	 */
+	if(!(p.features & IORING_FEAT_RW_CUR_POS) || !(p.features & IORING_FEAT_SQPOLL_NONFIXED)) {
+		errno = ENOSYS;
+		goto fail;
+	}
+	u->lensqring = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->lencqring = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(u->lencqring > u->lensqring)
+			u->lensqring = u->lencqring;
+		u->lencqring = 0;
+	}
+	u->sqring = mmap(NULL, u->lensqring, PROT_READ|PROT_WRITE,
+	                 MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if(u->sqring == MAP_FAILED)
+		goto fail;
+	if(u->lencqring == 0) {
+		u->cqring = u->sqring;
+	} else {
+		u->cqring = mmap(NULL, u->lencqring, PROT_READ|PROT_WRITE,
+		                 MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if(u->cqring == MAP_FAILED)
+			goto fail;
+	}
+	u->lensqes = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->lensqes, PROT_READ|PROT_WRITE,
+	               MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if(u->sqes == MAP_FAILED)
+		goto fail;
+	sq = u->sqring;
+	cq = u->cqring;
+	u->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	u->sq_flags = (unsigned *) (sq + p.sq_off.flags);
+	u->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *) (sq + p.sq_off.array);
+	u->cq_head = (unsigned *) (cq + p.cq_off.head);
+	u->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	u->bufs = mmap(NULL, (size_t) nbufs * lenbuf, PROT_READ|PROT_WRITE,
+	               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(u->bufs == MAP_FAILED)
+		goto fail;
+	/* registration may fail, e.g. due to RLIMIT_MEMLOCK on older
+	 * kernels; unregistered buffers still work, just a bit slower
+	 */
+	if((iov = malloc(nbufs * sizeof(struct iovec))) == NULL)
+		goto nomem;
+	for(i = 0 ; i < nbufs ; ++i) {
+		iov[i].iov_base = u->bufs + (size_t) i * lenbuf;
+		iov[i].iov_len = lenbuf;
+	}
+	u->fixed = syscall(__NR_io_uring_register, u->fd,
+	                   IORING_REGISTER_BUFFERS, iov, nbufs) == 0;
+	free(iov);
+	return u;
+
+nomem:
+	errno = ENOMEM;
+fail:
+	if(u != NULL)
+		__stdlog_uring_free(u);
+	return NULL;
+}
+
+/* waits for outstanding writes and releases all resources */
+void
+__stdlog_uring_free(struct __stdlog_uring *const u)
+{
+	const int err = errno;
+
+	if(u->inflight > 0)
+		__stdlog_uring_wait(u);
+	if(u->bufs != MAP_FAILED)
+		munmap(u->bufs, (size_t) u->nbufs * u->lenbuf);
+	if(u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->lensqes);
+	if(u->cqring != MAP_FAILED && u->cqring != u->sqring)
+		munmap(u->cqring, u->lencqring);
+	if(u->sqring != MAP_FAILED)
+		munmap(u->sqring, u->lensqring);
+	if(u->fd != -1)
+		close(u->fd);
+	free(u->busy);
+	free(u);
+	errno = err;
+}
+
+#else /* no io_uring */
+
+struct __stdlog_uring *
+__stdlog_uring_new(const int __attribute__((unused)) nbufs,
+	const size_t __attribute__((unused)) lenbuf,
+	struct stdlog_stats __attribute__((unused)) *const stats)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+char *
+__stdlog_uring_buf(struct __stdlog_uring __attribute__((unused)) *const u)
+{
+	return NULL;
+}
+
+void
+__stdlog_uring_write(struct __stdlog_uring __attribute__((unused)) *const u,
+	const int __attribute__((unused)) fd, char __attribute__((unused)) *const buf,
+	const size_t __attribute__((unused)) len)
+{
+}
+
+int
+__stdlog_uring_wait(struct __stdlog_uring __attribute__((unused)) *const u)
+{
+	return 0;
+}
+
+void
+__stdlog_uring_free(struct __stdlog_uring __attribute__((unused)) *const u)
+{
+}
+#endif
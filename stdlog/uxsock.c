@@ -1,6 +1,9 @@
 /* The stdlog unix socket driver. Syslog protocol is spoken on
  * all unix sockets.
  *
+ * The "udp:" driver is the same, just with a datagram socket to a
+ * remote syslog server; its frames also carry our hostname.
+ *
  * Copyright (C) 2014-2017 Adiscon GmbH
  * All rights reserved.
  *
@@ -33,15 +36,39 @@
 #include <stdint.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #include <errno.h>
+#include <pthread.h>
 #include "stdlog-intern.h"
 #include "stdlog.h"
 
 #define _PATH_LOG "/dev/log" /* default syslog socket on Linux */
+#define UXS_MAX_BATCH 1024	/* sanity limit for frames per batch */
+#define UXS_DFLT_BATCHMS 100	/* default max time a frame stays batched */
+#define UXS_LOCK_SPINS 1000	/* sigsafe mode: max tries to get batch lock */
+#define UXS_FULL_BLOCK 0	/* values for "full=" */
+#define UXS_FULL_DROP 1
+#define UXS_FULL_RETRY 2
+#define UXS_FULL_SPOOL 3
+#define UXS_DFLT_RETRYMS 10	/* default retry budget per message */
+#define UXS_RETRY_MINUS 50	/* first pause between retries */
+#define UXS_RETRY_MAXUS 1000	/* pause doubles up to this */
+#define UXS_DFLT_SPOOL (64*1024)	/* default spool size */
+#define UXS_SPOOL_TICKMS 100	/* drain spool at least this often */
+#define UXS_NOTICE_MS 1000	/* min interval between loss notices */
+#define UXS_IS_FULL(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
+#define UXS_DFLT_SDID "stdlog@32473"	/* 32473: enterprise number for examples */
+#define UXS_MAXAPPNAME 48	/* RFC 5424 limit for APP-NAME */
 
-static int
-build_syslog_frame(stdlog_channel_t ch,
+/* Builds a syslog frame as sent by the socket drivers. The frame
+ * is not NUL-terminated. Returns its length.
+ */
+size_t
+__stdlog_build_syslog_frame(stdlog_channel_t ch,
 	const int severity,
 	char *__restrict__ const frame,
 	const size_t lenframe,
@@ -49,67 +76,714 @@ build_syslog_frame(stdlog_channel_t ch,
 	va_list ap)
 {
 	int i = 0;
-	struct tm tm;
-	int64_t pri;
-	const time_t t = time(NULL);
-
-	pri = (ch->facility << 3) | (severity & 0x07);
-	__stdlog_timesub(&t, 0, &tm);
-	__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, '<');
-	__stdlog_fmt_print_int(frame, lenframe, &i, pri);
-	__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, '>');
-	i += __stdlog_formatTimestamp3164(&tm, frame+i);
-	__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, ' ');
-	__stdlog_fmt_print_str(frame, lenframe, &i, ch->ident);
-	if (ch->options & STDLOG_PID) {
-		__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, '[');
-		__stdlog_fmt_print_int(frame, lenframe, &i, getpid());
-		__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, ']');
-	}
-	__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, ':');
+	const time_t t = __STDLOG_MSGTIME();
+
+	__stdlog_hdr_add_pri(ch, severity, frame, lenframe, &i);
+	i += __stdlog_formatTimestamp3164_cached(t, frame+i);
 	__STDLOG_STRBUILD_ADD_CHAR(frame, lenframe, i, ' ');
+	__stdlog_hdr_add_host(ch, frame, lenframe, &i);
+	__stdlog_hdr_add_tag(ch, frame, lenframe, &i);
 	i += ch->f_vsnprintf(frame+i, lenframe-i, fmt, ap);
 	return i;
 }
 
+/* Builds the header of an RFC 5424 frame, as sent for messages with
+ * structured data: "<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - ". The
+ * structured data follows, and then the message with a leading space.
+ * Returns the header length.
+ */
+static int
+uxs_build_5424_hdr(stdlog_channel_t ch, const int severity,
+	char *__restrict__ const buf, const size_t lenbuf)
+{
+	const time_t t = __STDLOG_MSGTIME();
+	const unsigned char *p;
+	struct tm tm;
+	int i = 0;
+	int n;
+
+	__stdlog_hdr_add_pri(ch, severity, buf, lenbuf, &i);
+	__stdlog_fmt_print_str(buf, lenbuf, &i, "1 ");
+	if(i + 20 < (int) lenbuf) {
+		__stdlog_timesub(&t, 0, &tm);
+		i += __stdlog_formatTimestamp3339(&tm, buf + i);
+	}
+	__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i, ' ');
+	if(ch->hdr.lenhost > 0) {
+		__stdlog_hdr_add_host(ch, buf, lenbuf, &i);
+	} else {
+		__stdlog_fmt_print_str(buf, lenbuf, &i, "- ");
+	}
+	p = (const unsigned char *) ch->ident;
+	for(n = 0 ; p[n] != '\0' && n < UXS_MAXAPPNAME ; ++n)
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i,
+			(p[n] > ' ' && p[n] < 0x7f) ? p[n] : '_');
+	if(n == 0)
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i, '-');
+	__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i, ' ');
+	if(ch->options & STDLOG_PID)
+		__stdlog_fmt_print_int(buf, lenbuf, &i, __stdlog_hdr_pid());
+	else
+		__STDLOG_STRBUILD_ADD_CHAR(buf, lenbuf, i, '-');
+	__stdlog_fmt_print_str(buf, lenbuf, &i, " - ");
+	return i;
+}
+
+/* Non-blocking mode.
+ * If the syslog daemon falls behind, the socket's receive queue fills
+ * up and sendto() blocks until there is room again. With "full=" other
+ * than "block", the socket is non-blocking and a frame that does not
+ * fit is dropped ("drop"), sent again with growing pauses until the
+ * retry budget is used up ("retry"), or put into a small in-process
+ * spool that is drained before the next frame is sent and by the
+ * ticker ("spool"). Lost messages are counted per severity and reported
+ * by a "N messages lost" notice once a frame could be sent again, at
+ * most once per UXS_NOTICE_MS.
+ */
+static int64_t
+uxs_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* returns the severity of a frame, taken from its "<PRI>" */
+static int
+uxs_frame_sev(const char *const frame, const size_t lenframe)
+{
+	size_t i;
+	int pri = 0;
+
+	for(i = 1 ; i < lenframe && frame[i] >= '0' && frame[i] <= '9' ; ++i)
+		pri = pri * 10 + frame[i] - '0';
+	return pri & 0x07;
+}
+
+static void
+uxs_count_lost(stdlog_channel_t ch, const int severity)
+{
+	__atomic_add_fetch(&ch->d.uxs.lost[severity], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ch->d.uxs.nlost, 1, __ATOMIC_RELAXED);
+}
+
+/* Pauses before the next try in full=retry mode. Returns 0 if the
+ * retry budget is used up. nanosleep() is async-signal-safe.
+ */
+static int
+uxs_backoff(stdlog_channel_t ch, int64_t *const deadline, long *const delayus)
+{
+	struct timespec ts;
+	const int64_t now = uxs_now();
+
+	if(ch->d.uxs.full != UXS_FULL_RETRY)
+		return 0;
+	if(*deadline == 0)
+		*deadline = now + ch->d.uxs.retryms;
+	else if(now >= *deadline)
+		return 0;
+	ts.tv_sec = 0;
+	ts.tv_nsec = *delayus * 1000;
+	nanosleep(&ts, NULL);
+	if(*delayus < UXS_RETRY_MAXUS)
+		*delayus *= 2;
+	return 1;
+}
+
+/* sends a single frame given as iovecs, retrying if so configured */
+static int
+uxs_sendv(stdlog_channel_t ch, struct iovec *const iov, const int iovcnt,
+	const size_t lenframe)
+{
+	int64_t deadline = 0;
+	long delayus = UXS_RETRY_MINUS;
+	struct msghdr mh;
+	ssize_t lsent;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &ch->d.uxs.addr;
+	mh.msg_namelen = ch->d.uxs.lenaddr;
+	mh.msg_iov = iov;
+	mh.msg_iovlen = iovcnt;
+	do {
+		__STDLOG_STATS_ADD(ch, syscalls, 1);
+		lsent = (iovcnt == 1)
+			? sendto(ch->d.uxs.sock, iov[0].iov_base, lenframe, 0,
+			         (struct sockaddr*) &ch->d.uxs.addr, ch->d.uxs.lenaddr)
+			: sendmsg(ch->d.uxs.sock, &mh, 0);
+		if(lsent == -1 && UXS_IS_FULL(errno))
+			__STDLOG_STATS_ADD(ch, eagain, 1);
+	} while(lsent == -1 && UXS_IS_FULL(errno) && uxs_backoff(ch, &deadline, &delayus));
+	if(lsent == -1)
+		return -1;
+	if(lsent != (ssize_t)lenframe) {
+		__STDLOG_STATS_ADD(ch, eagain, 1);
+		errno = EAGAIN;
+		return -1;
+	}
+	__STDLOG_STATS_ADD(ch, bytes, lenframe);
+	return 0;
+}
+
+/* sends a single frame, retrying if so configured */
+static int
+uxs_sendto(stdlog_channel_t ch, const char *frame, const size_t lenframe)
+{
+	struct iovec iov;
+
+	iov.iov_base = (char *) frame;
+	iov.iov_len = lenframe;
+	return uxs_sendv(ch, &iov, 1, lenframe);
+}
+
+/* Sends spooled frames until the spool is empty (returns 0) or the
+ * socket is full (returns -1). Frames which fail for other reasons
+ * are counted as lost. Must be called with the spool mutex locked.
+ */
+static int
+uxs_spool_drain_locked(stdlog_channel_t ch)
+{
+	uint32_t len;
+
+	while(ch->d.uxs.spoolhead < ch->d.uxs.spooltail) {
+		memcpy(&len, ch->d.uxs.spool + ch->d.uxs.spoolhead, sizeof(len));
+		if(uxs_sendto(ch, ch->d.uxs.spool + ch->d.uxs.spoolhead + sizeof(len), len) != 0) {
+			if(UXS_IS_FULL(errno))
+				return -1;
+			uxs_count_lost(ch, uxs_frame_sev(ch->d.uxs.spool
+				+ ch->d.uxs.spoolhead + sizeof(len), len));
+		}
+		ch->d.uxs.spoolhead += sizeof(len) + len;
+	}
+	ch->d.uxs.spoolhead = 0;
+	__atomic_store_n(&ch->d.uxs.spooltail, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Sends a frame via the spool: earlier frames still in the spool go
+ * first, and if the socket is full, the frame is added to it. Returns
+ * -1 with errno EAGAIN if the frame had to be dropped.
+ * Note: memmove() is async-signal-safe as of POSIX.1-2016.
+ */
+static int
+uxs_spool_send(stdlog_channel_t ch, const char *frame, const size_t lenframe)
+{
+	const uint32_t len = lenframe;
+	const size_t needed = sizeof(len) + lenframe;
+	int spins = 0;
+	int r = 0;
+
+	if(ch->options & STDLOG_SIGSAFE) {
+		while(pthread_mutex_trylock(&ch->d.uxs.spoolmut) != 0) {
+			if(++spins >= UXS_LOCK_SPINS) {
+				uxs_count_lost(ch, uxs_frame_sev(frame, lenframe));
+				errno = EAGAIN;
+				return -1;
+			}
+		}
+	} else {
+		pthread_mutex_lock(&ch->d.uxs.spoolmut);
+	}
+
+	if(uxs_spool_drain_locked(ch) == 0) {
+		if((r = uxs_sendto(ch, frame, lenframe)) == 0 || !UXS_IS_FULL(errno))
+			goto done;
+	}
+	if(ch->d.uxs.spooltail + needed > ch->d.uxs.lenspool && ch->d.uxs.spoolhead > 0) {
+		memmove(ch->d.uxs.spool, ch->d.uxs.spool + ch->d.uxs.spoolhead,
+			ch->d.uxs.spooltail - ch->d.uxs.spoolhead);
+		ch->d.uxs.spooltail -= ch->d.uxs.spoolhead;
+		ch->d.uxs.spoolhead = 0;
+	}
+	if(ch->d.uxs.spooltail + needed > ch->d.uxs.lenspool) {
+		uxs_count_lost(ch, uxs_frame_sev(frame, lenframe));
+		errno = EAGAIN;
+		r = -1;
+		goto done;
+	}
+	memcpy(ch->d.uxs.spool + ch->d.uxs.spooltail, &len, sizeof(len));
+	memcpy(ch->d.uxs.spool + ch->d.uxs.spooltail + sizeof(len), frame, lenframe);
+	__atomic_store_n(&ch->d.uxs.spooltail, ch->d.uxs.spooltail + needed, __ATOMIC_RELEASE);
+	r = 0;
+done:
+	pthread_mutex_unlock(&ch->d.uxs.spoolmut);
+	return r;
+}
+
+/* Sends a single frame. In non-blocking mode, a frame that does not fit
+ * into the socket is spooled or dropped, see above.
+ */
+static int
+uxs_send(stdlog_channel_t ch, const char *frame, const size_t lenframe)
+{
+	if(ch->d.uxs.spool != NULL)
+		return uxs_spool_send(ch, frame, lenframe);
+	if(uxs_sendto(ch, frame, lenframe) == 0)
+		return 0;
+	if(ch->d.uxs.full != UXS_FULL_BLOCK && UXS_IS_FULL(errno)) {
+		uxs_count_lost(ch, uxs_frame_sev(frame, lenframe));
+		errno = EAGAIN;
+	}
+	return -1;
+}
+
+/* Logs the "N messages lost" notice if messages were lost and the
+ * last notice is long enough ago.
+ */
+static void
+uxs_report_loss(stdlog_channel_t ch, char *__restrict__ const wrkbuf,
+	const size_t buflen)
+{
+	static const char *const sevname[8] = { "emerg", "alert", "crit",
+		"err", "warning", "notice", "info", "debug" };
+	const int64_t now = uxs_now();
+	int64_t last = __atomic_load_n(&ch->d.uxs.lastnotice, __ATOMIC_RELAXED);
+	char msg[256];
+	uint32_t nlost[8];
+	int64_t total = 0;
+	const char *sep = " (";
+	int sev;
+	int i = 0;
+
+	if(now - last < UXS_NOTICE_MS
+	   || !__atomic_compare_exchange_n(&ch->d.uxs.lastnotice, &last, now, 0,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+	__atomic_store_n(&ch->d.uxs.nlost, 0, __ATOMIC_RELAXED);
+	for(sev = 0 ; sev < 8 ; ++sev) {
+		nlost[sev] = __atomic_exchange_n(&ch->d.uxs.lost[sev], 0, __ATOMIC_RELAXED);
+		total += nlost[sev];
+	}
+	if(total == 0)
+		return;
+	__stdlog_fmt_print_int(msg, sizeof(msg) - 2, &i, total);
+	__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, " messages lost, log socket was full");
+	for(sev = 0 ; sev < 8 ; ++sev) {
+		if(nlost[sev] == 0)
+			continue;
+		__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, sep);
+		__stdlog_fmt_print_int(msg, sizeof(msg) - 2, &i, nlost[sev]);
+		__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, " ");
+		__stdlog_fmt_print_str(msg, sizeof(msg) - 2, &i, sevname[sev]);
+		sep = ", ";
+	}
+	msg[i++] = ')';
+	msg[i] = '\0';
+	__stdlog_drvr_log_msg(ch, STDLOG_WARNING, wrkbuf, buflen, msg);
+}
+
+/* reports loss only once the socket took a frame again */
+static void
+uxs_check_loss(stdlog_channel_t ch, const int r,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	if(r == 0 && ch->d.uxs.full != UXS_FULL_BLOCK
+	   && __atomic_load_n(&ch->d.uxs.nlost, __ATOMIC_RELAXED) != 0
+	   && __atomic_load_n(&ch->d.uxs.spooltail, __ATOMIC_RELAXED) == 0
+	   && (ch->d.uxs.frames == NULL
+	       || __atomic_load_n(&ch->d.uxs.nbatch, __ATOMIC_RELAXED) == 0))
+		uxs_report_loss(ch, wrkbuf, buflen);
+}
+
+/* ticker callback for full=spool */
+static int
+uxs_spool_tick(stdlog_channel_t ch)
+{
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+	int r;
+
+	pthread_mutex_lock(&ch->d.uxs.spoolmut);
+	r = uxs_spool_drain_locked(ch);
+	pthread_mutex_unlock(&ch->d.uxs.spoolmut);
+	if(r == 0 && __atomic_load_n(&ch->d.uxs.nlost, __ATOMIC_RELAXED) != 0)
+		uxs_report_loss(ch, wrkbuf, sizeof(wrkbuf));
+	return r;
+}
+
+/* Removes the first nsent frames from the batch, keeping the rest for
+ * the next flush. Must be called with the batch mutex locked.
+ */
+static void
+uxs_batch_trim(stdlog_channel_t ch, const int nsent)
+{
+	const size_t off = (char *) ch->d.uxs.iov[nsent].iov_base - ch->d.uxs.frames;
+	int i;
+
+	memmove(ch->d.uxs.frames, ch->d.uxs.frames + off, ch->d.uxs.used - off);
+	for(i = nsent ; i < ch->d.uxs.nbatch ; ++i) {
+		ch->d.uxs.iov[i - nsent].iov_base = (char *) ch->d.uxs.iov[i].iov_base - off;
+		ch->d.uxs.iov[i - nsent].iov_len = ch->d.uxs.iov[i].iov_len;
+	}
+	ch->d.uxs.nbatch -= nsent;
+	ch->d.uxs.used -= off;
+}
+
+/* Sends the batched frames, with a single sendmmsg() call where
+ * available. Each frame stays an independent datagram. If the kernel
+ * accepts only part of the batch, we retry with the rest; frames
+ * which fail to send are discarded. In non-blocking mode, frames that
+ * do not fit into the socket are handled as for unbatched sending.
+ * If dontwait is set, we neither block nor back off: frames the socket
+ * does not take right away stay in the batch for the next flush.
+ * Must be called with the batch mutex locked.
+ */
+static int
+uxs_flush_locked(stdlog_channel_t ch, const int dontwait)
+{
+	const int flags = dontwait ? MSG_DONTWAIT : 0;
+	int64_t deadline = 0;
+	long delayus = UXS_RETRY_MINUS;
+	int nsent = 0;
+	int r = 0;
+	int i;
+#	ifdef HAVE_SENDMMSG
+	struct mmsghdr *const msgs = (struct mmsghdr *) ch->d.uxs.msgs;
+#	endif
+
+	if(ch->d.uxs.nbatch == 0)
+		return 0;
+	if(ch->d.uxs.sock < 0) {
+		r = -1;
+		goto done;
+	}
+	if(ch->d.uxs.spool != NULL
+	   && __atomic_load_n(&ch->d.uxs.spooltail, __ATOMIC_ACQUIRE) != 0)
+		goto undeliverable; /* keep order with frames already spooled */
+	while(nsent < ch->d.uxs.nbatch) {
+		__STDLOG_STATS_ADD(ch, syscalls, 1);
+#		ifdef HAVE_SENDMMSG
+		for(i = nsent ; i < ch->d.uxs.nbatch ; ++i) {
+			memset(&msgs[i], 0, sizeof(struct mmsghdr));
+			msgs[i].msg_hdr.msg_name = &ch->d.uxs.addr;
+			msgs[i].msg_hdr.msg_namelen = ch->d.uxs.lenaddr;
+			msgs[i].msg_hdr.msg_iov = &ch->d.uxs.iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		i = sendmmsg(ch->d.uxs.sock, msgs + nsent, ch->d.uxs.nbatch - nsent, flags);
+#		else
+		i = (sendto(ch->d.uxs.sock, ch->d.uxs.iov[nsent].iov_base,
+			ch->d.uxs.iov[nsent].iov_len, flags, (struct sockaddr*) &ch->d.uxs.addr,
+			ch->d.uxs.lenaddr) == -1) ? -1 : 1;
+#		endif
+		if(i <= 0) {
+			if(UXS_IS_FULL(errno)) {
+				__STDLOG_STATS_ADD(ch, eagain, 1);
+				if(dontwait) {
+					uxs_batch_trim(ch, nsent);
+					return 0;
+				}
+				if(uxs_backoff(ch, &deadline, &delayus))
+					continue;
+			}
+			r = -1;
+			break;
+		}
+		for(i += nsent ; nsent < i ; ++nsent)
+			__STDLOG_STATS_ADD(ch, bytes, ch->d.uxs.iov[nsent].iov_len);
+	}
+	if(r == 0 || ch->d.uxs.full == UXS_FULL_BLOCK || !UXS_IS_FULL(errno))
+		goto done;
+
+undeliverable:
+	r = 0;
+	for(i = nsent ; i < ch->d.uxs.nbatch ; ++i) {
+		if(ch->d.uxs.spool != NULL) {
+			if(uxs_spool_send(ch, ch->d.uxs.iov[i].iov_base, ch->d.uxs.iov[i].iov_len) != 0)
+				r = -1;
+		} else {
+			uxs_count_lost(ch, uxs_frame_sev(ch->d.uxs.iov[i].iov_base,
+				ch->d.uxs.iov[i].iov_len));
+			r = -1;
+		}
+	}
+	if(r != 0)
+		errno = EAGAIN;
+done:
+	ch->d.uxs.nbatch = 0;
+	ch->d.uxs.used = 0;
+	return r;
+}
+
+static int
+uxs_flush(stdlog_channel_t ch)
+{
+	int r;
+
+	if(ch->d.uxs.frames == NULL)
+		return 0;
+	pthread_mutex_lock(&ch->d.uxs.mut);
+	r = uxs_flush_locked(ch, 0);
+	pthread_mutex_unlock(&ch->d.uxs.mut);
+	return r;
+}
+
+/* Ticker callback for batched mode. It must not block the other
+ * channels' ticks: if a log call holds the batch, it will flush it
+ * itself, and what the socket does not take right away is left to the
+ * next log call, tick or close.
+ */
+static int
+uxs_batch_tick(stdlog_channel_t ch)
+{
+	char wrkbuf[__STDLOG_MSGBUF_SIZE];
+	int r;
+
+	if(pthread_mutex_trylock(&ch->d.uxs.mut) != 0)
+		return 0;
+	r = uxs_flush_locked(ch, 1);
+	pthread_mutex_unlock(&ch->d.uxs.mut);
+	if(r == 0 && ch->d.uxs.full != UXS_FULL_BLOCK
+	   && __atomic_load_n(&ch->d.uxs.nlost, __ATOMIC_RELAXED) != 0
+	   && __atomic_load_n(&ch->d.uxs.spooltail, __ATOMIC_RELAXED) == 0
+	   && __atomic_load_n(&ch->d.uxs.nbatch, __ATOMIC_RELAXED) == 0)
+		uxs_report_loss(ch, wrkbuf, sizeof(wrkbuf));
+	return r;
+}
+
+/* Adds a frame to the batch, sending the batch if a limit is reached.
+ * Locking follows the same rules as for the buffered file driver: in
+ * signal-safe mode we do not block on the mutex but send the frame
+ * directly if it stays busy.
+ */
+static int
+uxs_batched_send(stdlog_channel_t ch, const int severity,
+	const char *__restrict__ const frame, const size_t lenframe)
+{
+	int spins = 0;
+	int r = 0;
+
+	if(lenframe > ch->d.uxs.lenframes)
+		return uxs_send(ch, frame, lenframe);
+	if(ch->options & STDLOG_SIGSAFE) {
+		while(pthread_mutex_trylock(&ch->d.uxs.mut) != 0) {
+			if(++spins >= UXS_LOCK_SPINS)
+				return uxs_send(ch, frame, lenframe);
+		}
+	} else {
+		pthread_mutex_lock(&ch->d.uxs.mut);
+	}
+
+	if(ch->d.uxs.used + lenframe > ch->d.uxs.lenframes)
+		r = uxs_flush_locked(ch, 0);
+	ch->d.uxs.iov[ch->d.uxs.nbatch].iov_base = ch->d.uxs.frames + ch->d.uxs.used;
+	ch->d.uxs.iov[ch->d.uxs.nbatch].iov_len = lenframe;
+	memcpy(ch->d.uxs.frames + ch->d.uxs.used, frame, lenframe);
+	ch->d.uxs.used += lenframe;
+	++ch->d.uxs.nbatch;
+	if(ch->d.uxs.nbatch == ch->d.uxs.maxbatch || severity <= ch->d.uxs.flushsev) {
+		if(uxs_flush_locked(ch, 0) != 0)
+			r = -1;
+	}
+
+	pthread_mutex_unlock(&ch->d.uxs.mut);
+	return r;
+}
+
+static int
+uxs_init_batch(stdlog_channel_t ch)
+{
+	int64_t maxbatch;
+	int64_t lenframes;
+	int flushms;
+
+	maxbatch = __stdlog_chanspec_param_int(ch->spec, "batch", 0);
+	if(maxbatch <= 1)
+		return 0; /* not batching */
+	if(maxbatch > UXS_MAX_BATCH)
+		maxbatch = UXS_MAX_BATCH;
+	lenframes = __stdlog_chanspec_param_int(ch->spec, "batchbytes",
+		maxbatch * 512);
+	if(lenframes < __STDLOG_MSGBUF_SIZE)
+		lenframes = __STDLOG_MSGBUF_SIZE;
+	flushms = __stdlog_chanspec_param_int(ch->spec, "batchms", UXS_DFLT_BATCHMS);
+	ch->d.uxs.flushsev = __stdlog_chanspec_param_sev(ch->spec, "flushsev", STDLOG_ERR);
+	ch->d.uxs.maxbatch = maxbatch;
+	ch->d.uxs.lenframes = lenframes;
+	ch->d.uxs.frames = malloc(lenframes);
+	ch->d.uxs.iov = malloc(maxbatch * sizeof(struct iovec));
+#	ifdef HAVE_SENDMMSG
+	ch->d.uxs.msgs = malloc(maxbatch * sizeof(struct mmsghdr));
+#	else
+	ch->d.uxs.msgs = ch->d.uxs.iov; /* just a marker, not used */
+#	endif
+	if(ch->d.uxs.frames == NULL || ch->d.uxs.iov == NULL || ch->d.uxs.msgs == NULL) {
+		errno = ENOMEM;
+		goto fail;
+	}
+	pthread_mutex_init(&ch->d.uxs.mut, NULL);
+	if(flushms > 0 && __stdlog_ticker_register(ch, flushms, uxs_batch_tick) != 0) {
+		pthread_mutex_destroy(&ch->d.uxs.mut);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	free(ch->d.uxs.frames);
+	free(ch->d.uxs.iov);
+#	ifdef HAVE_SENDMMSG
+	free(ch->d.uxs.msgs);
+#	endif
+	ch->d.uxs.frames = NULL;
+	return -1;
+}
+
+/* sets up the SD-ID for structured data, invalid characters are
+ * replaced
+ */
+static void
+uxs_init_sdid(stdlog_channel_t ch)
+{
+	const char *sdid;
+	size_t len;
+	size_t i;
+	char c;
+
+	if((sdid = __stdlog_chanspec_param(ch->spec, "sdid", &len)) == NULL || len == 0) {
+		sdid = UXS_DFLT_SDID;
+		len = strlen(sdid);
+	}
+	if(len > sizeof(ch->d.uxs.sdid) - 1)
+		len = sizeof(ch->d.uxs.sdid) - 1;
+	for(i = 0 ; i < len ; ++i) {
+		c = sdid[i];
+		ch->d.uxs.sdid[i] = ((unsigned char) c <= ' ' || (unsigned char) c >= 0x7f
+			|| c == '=' || c == ']' || c == '"') ? '_' : c;
+	}
+	ch->d.uxs.sdid[len] = '\0';
+}
+
+/* sets up non-blocking mode if the channel spec asks for it */
 static void
+uxs_init_full(stdlog_channel_t ch)
+{
+	ch->d.uxs.full = UXS_FULL_BLOCK;
+	if(__stdlog_chanspec_param_is(ch->spec, "full", "drop"))
+		ch->d.uxs.full = UXS_FULL_DROP;
+	else if(__stdlog_chanspec_param_is(ch->spec, "full", "retry"))
+		ch->d.uxs.full = UXS_FULL_RETRY;
+	else if(__stdlog_chanspec_param_is(ch->spec, "full", "spool"))
+		ch->d.uxs.full = UXS_FULL_SPOOL;
+	ch->d.uxs.retryms = __stdlog_chanspec_param_int(ch->spec, "retryms", UXS_DFLT_RETRYMS);
+	if(ch->d.uxs.retryms < 1)
+		ch->d.uxs.retryms = 1;
+}
+
+/* allocates the spool for full=spool, done after batching is set up
+ * as the spool must be drained after the batch is flushed on close
+ */
+static int
+uxs_init_spool(stdlog_channel_t ch)
+{
+	int64_t lenspool;
+
+	if(ch->d.uxs.full != UXS_FULL_SPOOL)
+		return 0;
+	lenspool = __stdlog_chanspec_param_int(ch->spec, "spool", UXS_DFLT_SPOOL);
+	if(lenspool < __STDLOG_MSGBUF_SIZE + 4)
+		lenspool = __STDLOG_MSGBUF_SIZE + 4;
+	if((ch->d.uxs.spool = malloc(lenspool)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ch->d.uxs.lenspool = lenspool;
+	pthread_mutex_init(&ch->d.uxs.spoolmut, NULL);
+	if(__stdlog_ticker_register(ch, UXS_SPOOL_TICKMS, uxs_spool_tick) != 0) {
+		pthread_mutex_destroy(&ch->d.uxs.spoolmut);
+		free(ch->d.uxs.spool);
+		ch->d.uxs.spool = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void
+uxs_close_batch(stdlog_channel_t ch)
+{
+	if (ch->d.uxs.frames == NULL)
+		return;
+	__stdlog_ticker_unregister(ch, uxs_batch_tick);
+	uxs_flush(ch);
+	pthread_mutex_destroy(&ch->d.uxs.mut);
+	free(ch->d.uxs.frames);
+	free(ch->d.uxs.iov);
+#	ifdef HAVE_SENDMMSG
+	free(ch->d.uxs.msgs);
+#	endif
+	ch->d.uxs.frames = NULL;
+}
+
+static int
 uxs_init(stdlog_channel_t ch)
 {
 	ch->d.uxs.sock = -1;
-	/* Note: we handle both "syslog:" as well as "uxsock:" as
-	 * they are essentially the same. Here we configure the
-	 * difference.
+	/* Note: we handle "syslog:", "uxsock:" and "udp:" as they
+	 * are essentially the same. Here we configure the difference.
 	 */
-	if (!strncmp(ch->spec, "uxsock:", 7))
-		ch->d.uxs.sockname = strdup(ch->spec+7);
-	else
-		ch->d.uxs.sockname = strdup(_PATH_LOG);
+	memset(&ch->d.uxs.addr, 0, sizeof(ch->d.uxs.addr));
+	if (__stdlog_chanspec_is(ch->spec, "udp")) {
+		if (__stdlog_chanspec_resolve(ch->spec, SOCK_DGRAM,
+		                              &ch->d.uxs.addr, &ch->d.uxs.lenaddr) != 0)
+			return -1;
+		__stdlog_hdr_init_host(ch);
+	} else {
+		struct sockaddr_un *const uaddr = (struct sockaddr_un*) &ch->d.uxs.addr;
+		const char *const sockname = __stdlog_chanspec_is(ch->spec, "uxsock")
+			? __stdlog_chanspec_arg(ch->spec) : _PATH_LOG;
+		uaddr->sun_family = AF_UNIX;
+		strncpy(uaddr->sun_path, sockname, sizeof(uaddr->sun_path));
+		ch->d.uxs.lenaddr = sizeof(struct sockaddr_un);
+	}
+	uxs_init_sdid(ch);
+	uxs_init_full(ch);
+	if (uxs_init_batch(ch) != 0)
+		return -1;
+	if (uxs_init_spool(ch) != 0) {
+		uxs_close_batch(ch);
+		return -1;
+	}
+	return 0;
 }
 
+/* Creates the socket. Threads logging their first message at the
+ * same time may all get here; only one socket is installed, the
+ * others are closed again. The address is set up by uxs_init(), so
+ * it never changes while other threads use it.
+ */
 static void
 uxs_open(stdlog_channel_t ch)
 {
-	if (ch->d.uxs.sock == -1) {
-		if((ch->d.uxs.sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
-			return;
-		memset(&ch->d.uxs.addr, 0, sizeof(ch->d.uxs.addr));
-		ch->d.uxs.addr.sun_family = AF_UNIX;
-		strncpy(ch->d.uxs.addr.sun_path, ch->d.uxs.sockname,
-			sizeof(ch->d.uxs.addr.sun_path));
-	}
+	int expected = -1;
+	int sock;
+
+	if (__atomic_load_n(&ch->d.uxs.sock, __ATOMIC_ACQUIRE) != -1)
+		return;
+	if((sock = socket(ch->d.uxs.addr.ss_family, SOCK_DGRAM, 0)) < 0)
+		return;
+	if(ch->d.uxs.full != UXS_FULL_BLOCK)
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	if(!__atomic_compare_exchange_n(&ch->d.uxs.sock, &expected, sock, 0,
+	                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		close(sock);
 }
 
 static void
 uxs_close(stdlog_channel_t ch)
 {
+	uxs_close_batch(ch);
+	if (ch->d.uxs.spool != NULL) {
+		__stdlog_ticker_unregister(ch, uxs_spool_tick);
+		pthread_mutex_lock(&ch->d.uxs.spoolmut);
+		if (ch->d.uxs.sock >= 0)
+			uxs_spool_drain_locked(ch);
+		pthread_mutex_unlock(&ch->d.uxs.spoolmut);
+		pthread_mutex_destroy(&ch->d.uxs.spoolmut);
+		free(ch->d.uxs.spool);
+		ch->d.uxs.spool = NULL;
+	}
 	if (ch->d.uxs.sock >= 0) {
 		close(ch->d.uxs.sock);
 		ch->d.uxs.sock = -1;
 	}
-	/* we need to free buffers no matter if the socket was ever
-	 * opened or not.
-	 */
-	free(ch->d.uxs.sockname);
 }
 
 
@@ -118,27 +792,94 @@ uxs_log(stdlog_channel_t ch, int severity,
 	const char *fmt, va_list ap,
 	char *__restrict__ const wrkbuf, const size_t buflen)
 {
-	ssize_t lsent;
 	size_t lenframe;
 	int r;
 
-	if(ch->d.uxs.sock < 0)
+	if(__atomic_load_n(&ch->d.uxs.sock, __ATOMIC_ACQUIRE) < 0) {
 		uxs_open(ch);
-	if(ch->d.uxs.sock < 0) {
-		r = -1;
-		goto done;
+		if(__atomic_load_n(&ch->d.uxs.sock, __ATOMIC_ACQUIRE) < 0) {
+			r = -1;
+			goto done;
+		}
 	}
-	lenframe = build_syslog_frame(ch, severity, wrkbuf, buflen, fmt, ap);
-	lsent = sendto(ch->d.uxs.sock, wrkbuf, lenframe, 0,
-		(struct sockaddr*) &ch->d.uxs.addr, sizeof(ch->d.uxs.addr));
-	if(lsent == -1) {
-		r = -1;
-	} else if(lsent != (ssize_t)lenframe) {
-		r = -1;
-		errno = EAGAIN;
+	lenframe = __stdlog_build_syslog_frame(ch, severity, wrkbuf, buflen, fmt, ap);
+	if(ch->d.uxs.frames != NULL)
+		r = uxs_batched_send(ch, severity, wrkbuf, lenframe);
+	else
+		r = uxs_send(ch, wrkbuf, lenframe);
+	uxs_check_loss(ch, r, wrkbuf, buflen);
+done:	return r;
+}
+
+/* Messages with structured data are sent as RFC 5424 frames, with the
+ * fields as one SD-ELEMENT. Header and message are formatted into
+ * wrkbuf, and the frame is sent as iovecs of header, fields and
+ * message. Batched and spooled frames need to be in one piece, so in
+ * these modes the fields are copied in between.
+ */
+static int
+uxs_log_kv(stdlog_channel_t ch, const int severity,
+	const struct stdlog_kv *const fields, const int nfields,
+	const char *fmt, va_list ap,
+	char *__restrict__ const wrkbuf, const size_t buflen)
+{
+	struct __stdlog_kv_out kv;
+	struct iovec *iov;
+	size_t lenhdr;
+	size_t lenmsg = 0;
+	size_t lenframe;
+	int r;
+
+	if(__atomic_load_n(&ch->d.uxs.sock, __ATOMIC_ACQUIRE) < 0) {
+		uxs_open(ch);
+		if(__atomic_load_n(&ch->d.uxs.sock, __ATOMIC_ACQUIRE) < 0) {
+			r = -1;
+			goto done;
+		}
+	}
+	lenhdr = uxs_build_5424_hdr(ch, severity, wrkbuf, buflen);
+	if(lenhdr + 2 <= buflen) {
+		wrkbuf[lenhdr] = ' ';
+		lenmsg = 1 + ch->f_vsnprintf(wrkbuf + lenhdr + 1, buflen - lenhdr - 1, fmt, ap);
+	} else {
+		__stdlog_truncated = 1;
+	}
+	__stdlog_kv_render(&kv, __STDLOG_KV_SD, ch->d.uxs.sdid, fields, nfields);
+
+	if(ch->d.uxs.frames == NULL && ch->d.uxs.spool == NULL) {
+		iov = kv.iov + __STDLOG_KV_IOVHEAD - 1;
+		iov[0].iov_base = wrkbuf;
+		iov[0].iov_len = lenhdr;
+		iov[kv.niov + 1].iov_base = wrkbuf + lenhdr;
+		iov[kv.niov + 1].iov_len = lenmsg;
+		lenframe = lenhdr + kv.len + lenmsg;
+		r = uxs_sendv(ch, iov, kv.niov + 2, lenframe);
+		if(r != 0 && ch->d.uxs.full != UXS_FULL_BLOCK && UXS_IS_FULL(errno)) {
+			uxs_count_lost(ch, severity);
+			errno = EAGAIN;
+		}
 	} else {
-		r = 0;
+		if(lenhdr + kv.len > buflen) {
+			__stdlog_kv_render(&kv, __STDLOG_KV_SD, ch->d.uxs.sdid, NULL, 0);
+			__stdlog_truncated = 1;
+			if(lenhdr + kv.len > buflen) { /* tiny caller-provided buffer */
+				kv.niov = 0;
+				kv.len = 0;
+			}
+		}
+		if(lenhdr + kv.len + lenmsg > buflen) {
+			lenmsg = buflen - lenhdr - kv.len;
+			__stdlog_truncated = 1;
+		}
+		memmove(wrkbuf + lenhdr + kv.len, wrkbuf + lenhdr, lenmsg);
+		__stdlog_kv_copy(&kv, wrkbuf + lenhdr, kv.len);
+		lenframe = lenhdr + kv.len + lenmsg;
+		if(ch->d.uxs.frames != NULL)
+			r = uxs_batched_send(ch, severity, wrkbuf, lenframe);
+		else
+			r = uxs_send(ch, wrkbuf, lenframe);
 	}
+	uxs_check_loss(ch, r, wrkbuf, buflen);
 done:	return r;
 }
 
@@ -149,4 +890,6 @@ __stdlog_set_uxs_drvr(stdlog_channel_t ch)
 	ch->drvr.open = uxs_open;
 	ch->drvr.close = uxs_close;
 	ch->drvr.log = uxs_log;
+	ch->drvr.log_kv = uxs_log_kv;
+	ch->drvr.flush = uxs_flush;
 }